@@ -0,0 +1,118 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_chainlinker_h
+#define ps2s_chainlinker_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/types.h"
+
+class CSCDmaPacket;
+
+/********************************************
+ * class DmaChainLinker
+ */
+
+// Lets source chains jump to tags that haven't been built yet.  Instead of an
+// address, Next() and Call() take a label, which can be defined later, and in
+// this packet or another; Link() then fills in the addresses.  This way the
+// passes of a frame (opaque, translucent, ui..) can be built in any order,
+// each into its own packet, and stitched together once they're all done:
+//
+//     linker.Next(opaque, translucentStart);  // (not defined yet)
+//     ...
+//     linker.Define(translucentStart, translucent);
+//     translucent.Cnt();
+//     ...
+//     linker.Link();
+//
+// A label is a place in a packet, not an address, so a packet that has been
+// copied somewhere else whole (to the scratchpad, say) can be linked again with
+// Relocate(): its labels then point into the copy, and the tags in the copy are
+// the ones patched.  Only tags added through the linker are patched; anything
+// else in the copy that points into the original (a call to the packet itself,
+// say) still does.
+//
+// Linking writes the tags, so it has to happen before the packets are sent
+// (and flushed).  Reset() forgets where the labels were defined and what
+// referenced them, for when the packets are rebuilt.
+
+class CDmaChainLinker {
+public:
+    typedef uint32_t tLabel;
+
+    CDmaChainLinker(void);
+
+    // the name is only for Print() and errors
+    tLabel NewLabel(const char* name = NULL);
+    // the label is the next tag added to the packet, which can't have an open tag
+    void Define(tLabel label, CSCDmaPacket& packet);
+    bool IsDefined(tLabel label) const { return Labels[label].Packet != NULL; }
+
+    // like CSCDmaPacket::Next() and Call(), but to a label; the tag is left open
+    // for data, as usual, and has to be closed before Link()
+    void Next(CSCDmaPacket& packet, tLabel label, bool irq = false, uint32_t pce = 0);
+    void Call(CSCDmaPacket& packet, tLabel label, bool irq = false, uint32_t pce = 0);
+
+    // the (unchunked) packet's contents have been copied to copy; NULL undoes it
+    void Relocate(const CSCDmaPacket& packet, const void* copy);
+
+    // fills in every tag added with Next() or Call(), and can be done again after
+    // Relocate().  Returns false (GetError() says why) if a label isn't defined,
+    // in which case nothing is written.
+    bool Link(void);
+
+    // the address a label links to
+    const void* GetAddress(tLabel label) const;
+
+    void Reset(void);
+    const char* GetError(void) const { return pError; }
+    void Print(void) const;
+
+private:
+    typedef struct {
+        const char* Name;
+        // the tag (Packet is NULL until the label is defined)
+        const CSCDmaPacket* Packet;
+        uint32_t Chunk;
+        uint32_t Offset; // in bytes from the start of the chunk
+    } tLabelDef;
+
+    typedef struct {
+        CSCDmaPacket* Packet;
+        uint32_t Chunk, Offset; // of the tag to fill in
+        tLabel Label;
+        bool IsCall;
+        // whether Chunk and Offset have been moved to where the tag ended up
+        bool IsResolved;
+    } tFixup;
+
+    typedef struct {
+        const CSCDmaPacket* Packet;
+        const void* Copy;
+    } tRelocation;
+
+    void AddFixup(CSCDmaPacket& packet, tLabel label, bool isCall);
+    // follows the tag of a fixup into the next chunk if its data was carried there
+    void ResolveFixup(tFixup& fixup);
+    // where a place in a packet is now, after any relocation
+    uint8_t* GetPtr(const CSCDmaPacket* packet, uint32_t chunk, uint32_t offset) const;
+
+    std::vector<tLabelDef> Labels;
+    std::vector<tFixup> Fixups;
+    std::vector<tRelocation> Relocations;
+
+    const char* pError;
+    // for the error about an undefined label
+    char ErrorBuf[96];
+};
+
+#endif // ps2s_chainlinker_h
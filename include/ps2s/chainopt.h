@@ -0,0 +1,120 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_chainopt_h
+#define ps2s_chainopt_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/dmac.h"
+#include "ps2s/types.h"
+
+class CSCDmaPacket;
+
+/********************************************
+ * class DmaChainOptimizer
+ */
+
+// Rebuilds a finished source chain with fewer tags.  Building per object
+// (Cnt()..CloseTag() in CSprite::Draw, CTexEnv::SendSettings, GS::Flush..)
+// leaves long runs of tiny tags, and every one costs the dmac a tag fetch.
+// The optimizer:
+//
+//  - merges runs of cnt/next tags (and the chunk links of chunked packets)
+//    into one tag
+//  - copies the data of small refs into the merged tag instead of referencing it
+//  - on vif channels, drops qwords of vif NOPs, and joins a DIRECT that follows
+//    another with nothing but NOPs between them onto the first
+//
+// Tags with an interrupt or PCE set are left alone, as are calls (and what they
+// call), refs from the scratchpad, and refs bigger than the inline limit.  With
+// tte on, the vifcodes in a tag's upper half are kept in the data stream, so
+// tags are only merged where the vifcode stream can be followed.
+//
+// Small refs are copied when the optimizer runs, so it should run on a chain
+// that's ready to send.
+
+class CDmaChainOptimizer {
+public:
+    typedef struct {
+        // qwords are everything the dmac reads: tags and data
+        uint32_t NumTagsBefore, NumQwordsBefore;
+        uint32_t NumTagsAfter, NumQwordsAfter;
+
+        uint32_t NumMergedTags, NumInlinedRefs;
+        uint32_t NumDroppedNopQwords, NumMergedDirects;
+    } tStats;
+
+    CDmaChainOptimizer(void);
+
+    // refs of this many qwords or less are copied into the chain
+    void SetMaxInlineRefQwords(uint32_t numQwords) { uiMaxInlineRefQwords = numQwords; }
+    void SetMaxTags(uint32_t maxTags) { uiMaxTags = maxTags; }
+
+    // builds the optimized version of source in dest, which should be empty and use
+    // the same channel and tte setting.  Returns false (GetError() says why) if
+    // source is malformed, in which case dest is left alone.
+    bool Optimize(const CSCDmaPacket& source, CSCDmaPacket& dest);
+
+    const tStats& GetStats(void) const { return Stats; }
+    const char* GetError(void) const { return pError; }
+    void Print(void) const;
+
+private:
+    // one tag of the output chain
+    typedef struct {
+        uint32_t ID;
+        bool IRQ, SPR;
+        uint32_t PCE;
+        uint32_t Addr;      // refs and calls
+        uint32_t RefQWC;    // refs
+        uint32_t TagQword;  // where in OutData the tag goes (its upper half holds the tte vifcodes)
+        uint32_t NumQwords; // data following the tag in OutData
+        bool Sealed;        // nothing else can be merged into this tag
+    } tItem;
+
+    void Reset(void);
+    // follows the chain counting tags and qwords, and building the output if asked to
+    bool Walk(const void* firstTag, bool build, uint32_t& numTags, uint32_t& numQwords);
+
+    // building
+    void StartItem(const tDmaTag& tag, uint32_t id, bool sealed);
+    void AddInline(const tDmaTag& tag, const uint128_t* data, uint32_t numQwords);
+    void AddRef(const tDmaTag& tag);
+    void AddCall(const tDmaTag& tag, const uint128_t* data);
+    void AppendData(const uint128_t* data, uint32_t numQwords);
+    void AppendQword(const uint128_t& qword);
+    void Emit(CSCDmaPacket& dest, uint32_t terminator);
+
+    // following the vif stream
+    void FeedWord(uint32_t word, int outWord);
+    void FeedExternal(const uint128_t* data, uint32_t numQwords);
+    void FollowCall(uint32_t chainAddr);
+    bool AtVifCodeBoundary(void) const { return bVifChannel && !bStreamLost && uiVifWordsLeft == 0; }
+    uint32_t* GetOutWords(void) { return (uint32_t*)&OutData[0]; }
+
+    std::vector<tItem> Items;
+    std::vector<uint128_t> OutData;
+
+    tStats Stats;
+    const char* pError;
+    uint32_t uiMaxInlineRefQwords, uiMaxTags;
+
+    bool bTTE, bVifChannel;
+    // the tag the source chain ended with (end or ret)
+    uint32_t uiTerminator;
+    bool bStreamLost;
+    uint32_t uiVifWordsLeft, uiWL, uiCL;
+    // the word of OutData holding the last DIRECT, if nothing has been sent since
+    // its data (otherwise -1)
+    int iLastDirect;
+};
+
+#endif // ps2s_chainopt_h
@@ -0,0 +1,136 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_chainverify_h
+#define ps2s_chainverify_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/dmac.h"
+#include "ps2s/types.h"
+
+class CSCDmaPacket;
+
+/********************************************
+ * class DmaChainVerifier
+ */
+
+// Follows a source chain the way the dmac would and looks for the things that
+// hang it or send garbage down the channel.  On vif channels it also follows
+// the vifcodes, and on the gif and inside DIRECTs it follows the gif tags.
+//
+// Chains are checked against the "regions" of memory they are expected to live
+// in (a packet's buffer, or its chunks).  Tags outside every region (called
+// texture uploads, for example) are followed but not scanned for unreachable
+// tags.
+
+class CDmaChainVerifier {
+public:
+    typedef enum {
+        kTagMisaligned,   // a next/call address isn't on a qword boundary
+        kRefMisaligned,   // a ref's data isn't on a qword boundary
+        kUnterminated,    // the chain runs off the end of its region, or loops
+        kStackOverflow,   // a call with the address stack already full
+        kUnreachable,     // a tag in a region that the chain never gets to
+        kQWCMismatch,     // a qwc runs past the end of the region or over another tag
+        kBadVifCode,      // an unknown or misaligned vifcode
+        kVifTruncated,    // the chain ends in the middle of a vifcode's data
+        kDirectMismatch,  // the gif tags inside DIRECTs don't add up to their size
+        kGifMismatch,     // gif channel data doesn't end on a gif packet boundary
+        kNumIssueTypes
+    } tIssueType;
+
+    typedef struct {
+        tIssueType Type;
+        uint32_t TagAddr; // the tag being transferred (as a tag address)
+        uint32_t Value;   // depends on the type; usually an address or a size
+    } tIssue;
+
+    // where the data ends up
+    typedef enum {
+        kDestGs,       // gif tags and gs data, through the gif or DIRECT
+        kDestVuData,   // unpacks
+        kDestVuCode,   // mpgs
+        kDestVif,      // vifcodes and their immediate data (stmask, strow, ..)
+        kDestOther,    // anything on a channel that isn't the gif or a vif
+        kNumDests
+    } tDest;
+
+    CDmaChainVerifier(void);
+
+    void AddRegion(const void* start, uint32_t numBytes);
+    void ClearRegions(void) { Regions.clear(); }
+
+    // returns true if no problems were found
+    bool Verify(tDmaChannelId channel, const void* firstTag, bool tte);
+    // uses the packet's chunks as the regions
+    bool Verify(const CSCDmaPacket& packet);
+
+    uint32_t GetNumIssues(void) const { return Issues.size(); }
+    const tIssue& GetIssue(uint32_t issue) const { return Issues[issue]; }
+    static const char* GetIssueName(tIssueType type);
+
+    uint32_t GetNumBytes(tDest dest) const { return NumBytes[dest]; }
+    uint32_t GetNumQwords(tDest dest) const { return (NumBytes[dest] + 15) / 16; }
+    uint32_t GetNumTags(void) const { return uiNumTags; }
+
+    void Print(void) const;
+
+    // see CSoftDmac
+    void SetScratchpad(const void* scratchpad) { pScratchpad = (const uint8_t*)scratchpad; }
+    void SetMaxTags(uint32_t maxTags) { uiMaxTags = maxTags; }
+
+private:
+    typedef struct {
+        uint32_t Start, End; // tag addresses
+    } tRegion;
+
+    static bool StartsBefore(const tRegion& a, const tRegion& b) { return a.Start < b.Start; }
+
+    void Reset(void);
+    void AddIssue(tIssueType type, uint32_t value);
+    int FindRegion(uint32_t addr) const;
+    uint32_t SkipRefData(uint32_t addr) const;
+    void ScanRegions(void);
+    const uint8_t* GetDataPtr(uint32_t addr, bool fromSpr) const;
+
+    // stream checking
+    void Feed(const uint8_t* data, uint32_t numWords, uint32_t firstWordPos);
+    void FeedVifWord(uint32_t word, uint32_t wordPos);
+    void FeedGifWord(uint32_t word);
+    void CheckGifBoundary(tIssueType type);
+    void FinishStreams(void);
+
+    std::vector<tRegion> Regions;
+    std::vector<uint32_t> Visited;
+    // memory the refs in the chain send (which isn't tags, even inside a region)
+    std::vector<tRegion> RefData;
+    std::vector<tIssue> Issues;
+
+    tDmaChannelId dmaChannelId;
+    uint32_t uiCurTagAddr;
+    uint32_t uiNumTags, uiMaxTags;
+    uint32_t NumBytes[kNumDests];
+    const uint8_t* pScratchpad;
+
+    // vif state
+    bool bStreamLost;
+    uint32_t uiVifWordsLeft;
+    tDest VifDataDest;
+    bool bInDirect;
+    uint32_t uiWL, uiCL;
+
+    // gif state (path3, or inside DIRECTs)
+    uint32_t GifTagWords[4];
+    uint32_t uiGifTagWord;
+    uint32_t uiGifWordsLeft;
+};
+
+#endif // ps2s_chainverify_h
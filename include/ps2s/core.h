@@ -33,22 +33,37 @@ namespace MemMappings {
                       VU1Data = 0x1100c000;
 }
 
+// off-console (see softdmac.h) pointers don't carry memory mappings, so these
+// leave them alone
+
 template <class ptrType>
 inline ptrType MakePtrNormal(ptrType ptr)
 {
+#ifdef _EE
     return reinterpret_cast<ptrType>((uint32_t)ptr & 0x0fffffff);
+#else
+    return ptr;
+#endif
 }
 
 template <class ptrType>
 inline ptrType MakePtrUncached(ptrType ptr)
 {
+#ifdef _EE
     return reinterpret_cast<ptrType>((uint32_t)MakePtrNormal(ptr) | MemMappings::Uncached);
+#else
+    return ptr;
+#endif
 }
 
 template <class ptrType>
 inline ptrType MakePtrUncachedAccl(ptrType ptr)
 {
+#ifdef _EE
     return reinterpret_cast<ptrType>((uint32_t)MakePtrNormal(ptr) | MemMappings::UncachedAccl);
+#else
+    return ptr;
+#endif
 }
 
 /********************************************
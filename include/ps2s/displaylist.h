@@ -0,0 +1,108 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_displaylist_h
+#define ps2s_displaylist_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/dmafence.h"
+#include "ps2s/types.h"
+
+class CVifSCDmaPacket;
+
+/********************************************
+ * class VifDisplayList
+ */
+
+// A vif chain that's built once and then sent (or called) every frame, with
+// slots for what changes between frames: a STROW, the data of an unpack (a
+// matrix, say, as 4 qwords of v4_32), or the values of gs registers sent with
+// A+D.  Patching a slot writes straight into the chain, so a frame costs what
+// has changed instead of what the scene has in it.
+//
+// The list is recorded into a packet of the caller's, through the packet itself
+// for everything that stays the same and through the list for the slots:
+//
+//     packet.Cnt();
+//     tSlot mvp = list.Unpack(Vifs::UnpackModes::v4_32, 0, &matrix, 64, "mvp");
+//     packet.Mscal(0);
+//     ...
+//     packet.Ret();
+//     packet.CloseTag();
+//
+// and then per frame
+//
+//     list.Patch(mvp, &newMatrix);
+//     if (!frame.CallIfPossible(packet.GetBase()))
+//         ...
+//     list.SetFence(frame.Send());
+//
+// The packet shouldn't be reset or added to once the list is in use.  A slot
+// can't be patched while the chain is being read, so tell the list which
+// transfer it went out in with SetFence(), and Patch() will wait for it.
+
+class CVifDisplayList {
+public:
+    typedef uint32_t tSlot;
+    static const tSlot kNoSlot = 0xffffffff;
+
+    CVifDisplayList(CVifSCDmaPacket& packet);
+
+    // recording (the packet needs an open tag).  Names are for FindSlot().
+
+    tSlot Strow(const void* row, const char* name = NULL);
+    // numBytes of data for the unpack (a whole number of words), which is sized
+    // by CloseUnpack() with the current STCYCL settings
+    tSlot Unpack(uint32_t mode, uint32_t vuAddr, const void* data, uint32_t numBytes,
+        const char* name = NULL, bool dblBuffered = false);
+    // a DIRECT with a giftag and a register per qword (A+D)
+    tSlot GsRegs(const uint32_t* regAddrs, const uint64_t* values, uint32_t numRegs, const char* name = NULL);
+    tSlot GsReg(uint32_t regAddr, uint64_t value, const char* name = NULL)
+    {
+        return GsRegs(&regAddr, &value, 1, name);
+    }
+
+    tSlot FindSlot(const char* name) const;
+    uint32_t GetNumSlots(void) const { return Slots.size(); }
+    // the data Patch() takes: 16 bytes for a STROW, the unpack's data, or a uint64_t
+    // per register
+    uint32_t GetSlotBytes(tSlot slot) const { return Slots[slot].NumElems * Slots[slot].ElemBytes; }
+
+    // patching
+
+    void SetFence(const CDmaFence& fence) { LastSend = fence; }
+    void Patch(tSlot slot, const void* data);
+    void PatchGsReg(tSlot slot, uint32_t reg, uint64_t value);
+    // for writing the data in place (a STROW or unpack slot; registers are
+    // 16 bytes apart).  Waits for the fence like Patch().
+    void* GetSlotPtr(tSlot slot);
+
+    uint32_t GetNumBytesPatched(void) const { return uiNumBytesPatched; }
+    void ResetStats(void) { uiNumBytesPatched = 0; }
+
+private:
+    typedef struct {
+        const char* Name;
+        uint8_t* Data;
+        uint32_t NumElems;
+        uint32_t ElemBytes;
+        uint32_t Stride; // between elements in the chain
+    } tSlotDef;
+
+    tSlot AddSlot(const char* name, void* data, uint32_t numElems, uint32_t elemBytes, uint32_t stride);
+
+    CVifSCDmaPacket& Packet;
+    std::vector<tSlotDef> Slots;
+    CDmaFence LastSend;
+    uint32_t uiNumBytesPatched;
+};
+
+#endif // ps2s_displaylist_h
@@ -0,0 +1,57 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_dmabackend_h
+#define ps2s_dmabackend_h
+
+/********************************************
+ * includes
+ */
+
+#include "ps2s/dmac.h"
+#include "ps2s/types.h"
+
+/********************************************
+ * class DmaBackend
+ */
+
+// The packet classes never touch the dmac directly; they go through the
+// current backend.  By default that's the ee's dmac, but it can be swapped
+// for a CSoftDmac (see softdmac.h) to run packets off-console.  Off-console the
+// default is a CSoftDmac with nothing on the end of its channels.
+
+class CDmaBackend {
+public:
+    virtual ~CDmaBackend(void) {}
+
+    virtual void SendNormal(tDmaChannelId channel, const void* data, uint32_t numQwords) = 0;
+    virtual void SendChain(tDmaChannelId channel, const void* firstTag, bool tte)        = 0;
+    virtual void Wait(tDmaChannelId channel)                                             = 0;
+    virtual bool IsBusy(tDmaChannelId channel)                                           = 0;
+    virtual void FlushCache(void)                                                        = 0;
+
+    static CDmaBackend& Get(void) { return *pCurrent; }
+    // passing NULL restores the default
+    static void Set(CDmaBackend* backend);
+
+private:
+    static CDmaBackend* pCurrent;
+};
+
+/********************************************
+ * class EEDmaBackend
+ */
+
+class CEEDmaBackend : public CDmaBackend {
+public:
+    virtual void SendNormal(tDmaChannelId channel, const void* data, uint32_t numQwords);
+    virtual void SendChain(tDmaChannelId channel, const void* firstTag, bool tte);
+    virtual void Wait(tDmaChannelId channel);
+    virtual bool IsBusy(tDmaChannelId channel);
+    virtual void FlushCache(void);
+};
+
+#endif // ps2s_dmabackend_h
@@ -87,6 +87,28 @@ enum { kRefe,
     kRet,
     kEnd };
 
+// Tags only have room for a 31 bit address.  On the ee that's just the pointer,
+// but off-console pointers don't fit, so there tag addresses are offsets from
+// AddrBase, which the host points at the arena its packets and data live in.
+#ifdef _EE
+static const uintptr_t AddrBase = 0;
+#else
+extern uintptr_t AddrBase;
+#endif
+
+inline uint32_t MakeTagAddr(const void* ptr)
+{
+    return (ptr) ? (uint32_t)((uintptr_t)ptr - AddrBase) : 0;
+}
+
+inline void* GetTagPtr(uint32_t tagAddr)
+{
+    return (void*)(AddrBase + tagAddr);
+}
+
+// the dmac's address stack only has two entries (ASR0 and ASR1)
+static const uint32_t kMaxCallDepth = 2;
+
 /*
 	namespace ChannelPtrs {
 		const volatile tDmaChannel *vif0 = (volatile tDmaChannel*)D0_CHCR,
@@ -0,0 +1,198 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_dmacapture_h
+#define ps2s_dmacapture_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/dmabackend.h"
+#include "ps2s/dmac.h"
+#include "ps2s/types.h"
+
+/********************************************
+ * capture file format
+ */
+
+// A capture is a sequence of records, one per send, each holding a snapshot of
+// all the memory its chain touched (tags and ref'd data).  The snapshot is
+// stored as "segments" of contiguous memory, and the tags that point at other
+// memory (next, call, and the refs) are listed as "fixups" so that the chain
+// can be relocated to wherever the file is loaded.
+//
+// The file is laid out so that it can be used in place (read or mmap'd into
+// qword-aligned memory):  a header, the record, segment, and fixup tables, and
+// then the payload, which starts on a qword boundary.  Every segment is a whole
+// number of qwords.  All offsets are in bytes; the payload offsets of segments
+// and fixups are relative to the start of the payload.  Everything is stored
+// in the native (little endian) byte order of both the ee and x86 hosts.
+
+namespace DmaCapture {
+static const uint32_t kMagic   = 0x43414d44; // "DMAC"
+static const uint32_t kVersion = 1;
+
+// header flags
+static const uint32_t kFixedUp = 1; // only ever set in memory, once relocated
+
+typedef struct {
+    uint32_t Magic, Version;
+    uint32_t FileSize, Flags;
+    uint32_t NumRecords, RecordsOffset;
+    uint32_t NumSegments, SegmentsOffset;
+    uint32_t NumFixups, FixupsOffset;
+    uint32_t PayloadOffset, PayloadSize;
+} tHeader;
+
+typedef enum { kRecordChain,
+    kRecordNormal } tRecordType;
+
+typedef struct {
+    uint32_t Type, Channel, TTE;
+    uint32_t FirstSegment, NumSegments;
+    uint32_t FirstFixup, NumFixups;
+    uint32_t Start;     // payload offset of the first tag (or the data of a normal send)
+    uint32_t NumQwords; // normal sends only
+    uint32_t pad[3];
+} tRecord;
+
+// segment flags
+static const uint32_t kSegmentSpr = 1; // a copy of scratchpad memory
+
+typedef struct {
+    uint32_t OrigAddr; // tag address (or scratchpad offset) the memory was captured from
+    uint32_t NumBytes;
+    uint32_t PayloadOffset;
+    uint32_t Flags;
+} tSegment;
+}
+
+/********************************************
+ * class DmaCapture
+ */
+
+// A backend that records everything sent through it before passing it on to
+// another backend (or dropping it, if there isn't one).  To capture a frame:
+//
+//   CDmaCapture capture(&CDmaBackend::Get());
+//   CDmaBackend::Set(&capture);
+//   ... draw the frame ...
+//   CDmaBackend::Set(NULL);
+//   capture.Write("host:frame.dmc");
+
+class CDmaCapture : public CDmaBackend {
+public:
+    CDmaCapture(CDmaBackend* target = NULL);
+    virtual ~CDmaCapture(void) {}
+
+    // CDmaBackend
+
+    virtual void SendNormal(tDmaChannelId channel, const void* data, uint32_t numQwords);
+    virtual void SendChain(tDmaChannelId channel, const void* firstTag, bool tte);
+    virtual void Wait(tDmaChannelId channel);
+    virtual bool IsBusy(tDmaChannelId channel);
+    virtual void FlushCache(void);
+
+    // these record without sending.  AddChain() returns false (and records
+    // nothing) if the chain is malformed; GetError() says why.
+    void AddNormal(tDmaChannelId channel, const void* data, uint32_t numQwords);
+    bool AddChain(tDmaChannelId channel, const void* firstTag, bool tte);
+
+    void Clear(void);
+    bool Write(const char* fileName);
+
+    uint32_t GetNumRecords(void) const { return Records.size(); }
+    uint32_t GetPayloadSize(void) const { return Payload.size(); }
+    const char* GetError(void) const { return pError; }
+
+    // see CSoftDmac
+    void SetScratchpad(const void* scratchpad) { pScratchpad = (const uint8_t*)scratchpad; }
+    void SetMaxTags(uint32_t maxTags) { uiMaxTags = maxTags; }
+
+private:
+    typedef struct tRange_t {
+        uint32_t Start, End;
+        bool Spr;
+
+        bool operator<(const struct tRange_t& rhs) const
+        {
+            return (Spr != rhs.Spr) ? rhs.Spr : Start < rhs.Start;
+        }
+    } tRange;
+
+    const uint8_t* GetMemPtr(uint32_t addr, bool spr) const;
+    void AddSegments(std::vector<tRange>& ranges, DmaCapture::tRecord& record);
+    uint32_t FindPayloadOffset(const DmaCapture::tRecord& record, uint32_t addr, bool spr) const;
+
+    CDmaBackend* pTarget;
+    const uint8_t* pScratchpad;
+    uint32_t uiMaxTags;
+    const char* pError;
+
+    std::vector<DmaCapture::tRecord> Records;
+    std::vector<DmaCapture::tSegment> Segments;
+    std::vector<uint32_t> Fixups;
+    std::vector<uint8_t> Payload;
+};
+
+/********************************************
+ * class DmaReplay
+ */
+
+// Relocates a capture and sends it again.  Hand it a CSoftDmac (with sinks) to
+// replay a capture on a host.
+
+class CDmaReplay {
+public:
+    CDmaReplay(void);
+    ~CDmaReplay(void) { Release(); }
+
+    // reads the whole file into a qword-aligned buffer that the replay owns
+    bool Load(const char* fileName);
+    // uses an image that's already in memory (an mmap'd file, for example).  It must
+    // be qword aligned and writable, since the tags are relocated in place.  Off-console
+    // the image has to be addressable from DMAC::AddrBase like any other chain.
+    bool Attach(void* image, uint32_t numBytes);
+    void Release(void);
+
+    uint32_t GetNumRecords(void) const { return (pHeader) ? pHeader->NumRecords : 0; }
+    tDmaChannelId GetChannel(uint32_t record) const { return (tDmaChannelId)GetRecord(record).Channel; }
+    bool GetTTE(uint32_t record) const { return GetRecord(record).TTE; }
+    bool IsChain(uint32_t record) const { return GetRecord(record).Type == DmaCapture::kRecordChain; }
+    // the first tag of a chain, or the data of a normal send
+    void* GetStart(uint32_t record) const { return pPayload + GetRecord(record).Start; }
+    uint32_t GetNumQwords(uint32_t record) const { return GetRecord(record).NumQwords; }
+    // the memory a record was captured from, as relocated into the image (the
+    // regions to check a chain against, see CDmaChainVerifier)
+    uint32_t GetNumSegments(uint32_t record) const { return GetRecord(record).NumSegments; }
+    void* GetSegment(uint32_t record, uint32_t segment) const { return pPayload + GetSegmentInfo(record, segment).PayloadOffset; }
+    uint32_t GetSegmentByteLength(uint32_t record, uint32_t segment) const { return GetSegmentInfo(record, segment).NumBytes; }
+
+    // sends the records in order, waiting for each channel to finish before
+    // starting another transfer on it
+    void Replay(CDmaBackend& backend);
+    void Replay(void) { Replay(CDmaBackend::Get()); }
+    void ReplayRecord(uint32_t record, CDmaBackend& backend);
+
+    const char* GetError(void) const { return pError; }
+
+private:
+    const DmaCapture::tRecord& GetRecord(uint32_t record) const;
+    const DmaCapture::tSegment& GetSegmentInfo(uint32_t record, uint32_t segment) const;
+    bool FixUp(void);
+
+    uint8_t* pImage;
+    uint32_t uiImageSize;
+    bool bOwnsImage;
+    DmaCapture::tHeader* pHeader;
+    uint8_t* pPayload;
+    const char* pError;
+};
+
+#endif // ps2s_dmacapture_h
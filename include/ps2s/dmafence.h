@@ -0,0 +1,92 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_dmafence_h
+#define ps2s_dmafence_h
+
+/********************************************
+ * includes
+ */
+
+#include "ps2s/dmac.h"
+#include "ps2s/types.h"
+
+/********************************************
+ * class DmaFence
+ */
+
+// Marks the end of one transfer.  The packet classes' Send() returns one, so
+// whatever the transfer reads (the packet's buffer, a texture, a ring slot) can
+// be reused as soon as the fence has passed instead of after a blind wait on
+// the channel.
+//
+// Sends on a channel are numbered, and a fence is just (channel, number).  The
+// packet classes wait for the channel before sending, so a transfer has
+// finished once the channel is idle or a later one has been started.  Fences
+// are small and can be copied around freely; a default-constructed one has
+// already passed.
+//
+// Callbacks run from the dmac's channel interrupt if EnableInterrupt() has been
+// called for the channel; otherwise they run when the fence is seen to pass:
+// from IsDone(), Wait(), Update() or the next send on the channel.  Either way
+// they should be short -- they can be called with interrupts disabled.
+
+class CDmaFence {
+public:
+    typedef void (*tCallback)(void* arg);
+
+    static const uint32_t kNumChannels = 10;
+    static const uint32_t kMaxCallbacks = 16; // pending, per channel
+    static const uint32_t kForever = 0xffffffff;
+
+    CDmaFence(void)
+        : dmaChannelId(DMAC::Channels::vif0)
+        , uiSequence(0)
+    {
+    }
+
+    bool IsDone(void) const;
+    // spins until the fence passes or maxCycles ee cycles have gone by, and returns
+    // whether it passed.  (Off-console there's no clock, so this blocks on the
+    // channel like kForever does.)
+    bool Wait(uint32_t maxCycles = kForever) const;
+    // calls callback(arg) once the fence has passed (right away if it already has,
+    // or after waiting for it if kMaxCallbacks are already pending on the channel)
+    void OnDone(tCallback callback, void* arg) const;
+
+    tDmaChannelId GetDmaChannel(void) const { return dmaChannelId; }
+
+    // used by the packet classes: BeginSend() gives the fence of a transfer that's
+    // about to start on a channel that's been waited on, and EndSend() is called
+    // once the channel has been started.  The fence can't pass in between, however
+    // idle the channel looks.
+    static CDmaFence BeginSend(tDmaChannelId channel);
+    static void EndSend(const CDmaFence& fence);
+
+    // checks the channel(s) and runs the callbacks of fences that have passed
+    static void Update(tDmaChannelId channel);
+    static void Update(void);
+
+    // run callbacks from the channel's dma-end interrupt (ee only)
+    static void EnableInterrupt(tDmaChannelId channel, bool enable);
+
+private:
+    CDmaFence(tDmaChannelId channel, uint32_t sequence)
+        : dmaChannelId(channel)
+        , uiSequence(sequence)
+    {
+    }
+
+    // everything started on the channel so far has finished
+    static void MarkDone(tDmaChannelId channel);
+    static void RunCallbacks(tDmaChannelId channel);
+    static int InterruptHandler(int channel);
+
+    tDmaChannelId dmaChannelId;
+    uint32_t uiSequence;
+};
+
+#endif // ps2s_dmafence_h
@@ -0,0 +1,78 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_dmastats_h
+#define ps2s_dmastats_h
+
+/********************************************
+ * includes
+ */
+
+#include "ps2s/dmac.h"
+#include "ps2s/types.h"
+
+class CDmaBackend;
+
+/********************************************
+ * DmaStats
+ */
+
+// Per-channel counts of what the packet classes send, kept per frame.  It's off
+// by default; once enabled every CDmaPacket::Send() and CSCDmaPacket::Send() is
+// counted (chains are walked, calls included, to count their tags and data),
+// and so is the time spent waiting for the channel to be free.  Call EndFrame()
+// once a frame to close the counts and roll them into the averages.
+
+namespace DmaStats {
+
+static const uint32_t kNumChannels = 10;
+static const uint32_t kMaxWindow   = 64;
+
+typedef struct {
+    uint32_t NumSends;
+    uint32_t NumTags;
+    uint32_t NumTagsById[8]; // indexed by DMAC::kRefe, DMAC::kCnt, ..
+    uint32_t InlineBytes;    // data that follows its tag (cnt, next, call, ret, end)
+    uint32_t RefBytes;       // data pulled from elsewhere (ref, refs, refe)
+    uint32_t TagBytes;       // tags transferred with tte on
+    uint32_t WaitCycles;     // ee cycles spent waiting for the channel (0 off-console)
+} tChannelStats;
+
+// everything the channel moved, in qwords
+inline uint32_t
+GetNumQwords(const tChannelStats& stats)
+{
+    return (stats.InlineBytes + stats.RefBytes + stats.TagBytes) / 16;
+}
+
+void Enable(bool enable);
+bool IsEnabled(void);
+
+// how many frames the averages cover (up to kMaxWindow)
+void SetWindow(uint32_t numFrames);
+void EndFrame(void);
+void Reset(void);
+
+// the frame being counted, and the last one finished
+const tChannelStats& GetCurrent(tDmaChannelId channel);
+const tChannelStats& GetLastFrame(tDmaChannelId channel);
+// the per-frame average over the window (or as many frames as have finished)
+void GetAverage(tDmaChannelId channel, tChannelStats& average);
+uint32_t GetNumFramesAveraged(void);
+
+// a line per channel with any traffic
+void Print(void);
+
+// used by the packet classes
+
+void RecordNormal(tDmaChannelId channel, uint32_t numQwords);
+void RecordChain(tDmaChannelId channel, const void* firstTag, bool tte);
+// waits for the channel, counting the time if stats are on
+void Wait(CDmaBackend& backend, tDmaChannelId channel);
+void AddWaitCycles(tDmaChannelId channel, uint32_t numCycles);
+}
+
+#endif // ps2s_dmastats_h
@@ -12,6 +12,7 @@
  */
 
 #include "ps2s/debug.h"
+#include "ps2s/gs_consts.h"
 #include "ps2s/gs_reg_types.h"
 #include "ps2s/types.h"
 
@@ -19,94 +20,11 @@ class CSCDmaPacket;
 
 namespace GS {
 
-/********************************************
-    * constants
-    */
-
-typedef enum { kContext1,
-    kContext2 } tContext;
-
-typedef enum { kPsm32 = 0,
-    kPsm24            = 1,
-    kPsm16            = 2,
-    kPsm16s           = 10,
-    kPsm8             = 19,
-    kPsm8h            = 27,
-    kPsm4             = 20,
-    kPsm4hh           = 44,
-    kPsm4hl           = 36,
-
-    kPsmz32  = 48,
-    kPsmz24  = 49,
-    kPsmz16  = 50,
-    kPsmz16s = 58,
-
-    kInvalidPsm = -1
-} tPSM;
-
 /********************************************
     * register addresses
     */
 
-// "normal" registers
-
-namespace RegAddrs {
-    static const int prim       = 0x00;
-    static const int rgbaq      = 0x01;
-    static const int st         = 0x02;
-    static const int uv         = 0x03;
-    static const int xyzf2      = 0x04;
-    static const int xyz2       = 0x05;
-    static const int tex0_1     = 0x06;
-    static const int tex0_2     = 0x07;
-    static const int clamp_1    = 0x08;
-    static const int clamp_2    = 0x09;
-    static const int fog        = 0x0a;
-    static const int xyzf3      = 0x0c;
-    static const int xyz3       = 0x0d;
-    static const int tex1_1     = 0x14;
-    static const int tex1_2     = 0x15;
-    static const int tex2_1     = 0x16;
-    static const int tex2_2     = 0x17;
-    static const int xyoffset_1 = 0x18;
-    static const int xyoffset_2 = 0x19;
-    static const int prmodecont = 0x1a;
-    static const int prmode     = 0x1b;
-    static const int texclut    = 0x1c;
-    static const int scanmsk    = 0x22;
-    static const int miptbp1_1  = 0x34;
-    static const int miptbp1_2  = 0x35;
-    static const int miptbp2_1  = 0x36;
-    static const int miptbp2_2  = 0x37;
-    static const int texa       = 0x3b;
-    static const int fogcol     = 0x3d;
-    static const int texflush   = 0x3f;
-    static const int scissor_1  = 0x40;
-    static const int scissor_2  = 0x41;
-    static const int alpha_1    = 0x42;
-    static const int alpha_2    = 0x43;
-    static const int dimx       = 0x44;
-    static const int dthe       = 0x45;
-    static const int colclamp   = 0x46;
-    static const int test_1     = 0x47;
-    static const int test_2     = 0x48;
-    static const int pabe       = 0x49;
-    static const int fba_1      = 0x4a;
-    static const int fba_2      = 0x4b;
-    static const int frame_1    = 0x4c;
-    static const int frame_2    = 0x4d;
-    static const int zbuf_1     = 0x4e;
-    static const int zbuf_2     = 0x4f;
-    static const int bitbltbuf  = 0x50;
-    static const int trxpos     = 0x51;
-    static const int trxreg     = 0x52;
-    static const int trxdir     = 0x53;
-    static const int hwreg      = 0x54;
-    static const int signal     = 0x60;
-    static const int finish     = 0x61;
-    static const int label      = 0x62;
-    static const int nop        = 0x7f;
-}
+// (the constants, pixel formats and "normal" registers are in gs_consts.h)
 
 // the "special" registers
 
@@ -162,9 +80,9 @@ inline uint32_t PackRGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
 void Init(void);
 
 void Flush(void);
+// calls a shared flush chain if the packet's embed mode is kEmbedCall
 void Flush(CSCDmaPacket& packet);
 
-inline unsigned int GetBitsPerPixel(tPSM psm);
 void ReorderClut(uint32_t* oldClut, uint32_t* newClut);
 
 } // namespace GS
@@ -204,41 +122,4 @@ typedef struct tGifTag_t {
     unsigned long long REGS15 : 4;
 } __attribute__((packed,aligned(16))) tGifTag;
 
-inline unsigned int
-GS::GetBitsPerPixel(tPSM psm)
-{
-    uint32_t bpp = 0;
-
-    switch (psm) {
-    case kPsm32:
-    case kPsmz32:
-        bpp = 32;
-        break;
-    case kPsm24:
-    case kPsmz24:
-        bpp = 24;
-        break;
-    case kPsm16:
-    case kPsm16s:
-    case kPsmz16:
-    case kPsmz16s:
-        bpp = 16;
-        break;
-    case kPsm8:
-    case kPsm8h:
-        bpp = 8;
-        break;
-    case kPsm4:
-    case kPsm4hl:
-    case kPsm4hh:
-        bpp = 4;
-        break;
-    default:
-        mAssert(false);
-        break;
-    }
-
-    return bpp;
-}
-
 #endif // ps2s_gs_h
@@ -14,6 +14,9 @@
 #include <list>
 
 #include "ps2s/gs.h"
+#include "ps2s/vramalloc.h"
+
+class CSCDmaPacket;
 
 // There are 5 possible types of slot:
 // 32bit, 24bit, high 8 bit, high-low 4bit, and high-high 4bit
@@ -34,11 +37,18 @@ class CMemSlotList;
 
 class CMemSlot {
     int FirstPage, PageLength;
+    int FirstBlock, NumBlocks;
     GS::tPSM PixFormat;
     CMemArea* BoundMemArea;
     int LastFrameUsed;
     CMemSlotList* List;
     bool Locked;
+    bool Dynamic;
+    bool InPlanes;
+    // the owning list, most recently used first
+    CMemSlot *Prev, *Next;
+
+    friend class CMemSlotList;
 
     // with all the pointers around, lets disallow copy constructing
     CMemSlot(const CMemSlot& rhs);
@@ -47,27 +57,65 @@ public:
     CMemSlot(int firstPage, int pageLength, GS::tPSM pixFormat)
         : FirstPage(firstPage)
         , PageLength(pageLength)
+        , FirstBlock(firstPage * CVramAllocator::kBlocksPerPage)
+        , NumBlocks(pageLength * CVramAllocator::kBlocksPerPage)
         , PixFormat(pixFormat)
         , BoundMemArea(NULL)
         , LastFrameUsed(0)
         , List(NULL)
         , Locked(false)
+        , Dynamic(false)
+        , InPlanes(false)
+        , Prev(NULL)
+        , Next(NULL)
+    {
+    }
+    // made by the mem manager's allocator for one area (see CMemManager::UseAllocator()),
+    // either in whole blocks or in the upper bits of plane host pages
+    CMemSlot(GS::tPSM pixFormat, int firstBlock, int numBlocks, bool inPlanes = false)
+        : FirstPage(firstBlock / CVramAllocator::kBlocksPerPage)
+        , PageLength((firstBlock % CVramAllocator::kBlocksPerPage + numBlocks + CVramAllocator::kBlocksPerPage - 1)
+              / CVramAllocator::kBlocksPerPage)
+        , FirstBlock(firstBlock)
+        , NumBlocks(numBlocks)
+        , PixFormat(pixFormat)
+        , BoundMemArea(NULL)
+        , LastFrameUsed(0)
+        , List(NULL)
+        , Locked(false)
+        , Dynamic(true)
+        , InPlanes(inPlanes)
+        , Prev(NULL)
+        , Next(NULL)
     {
     }
     ~CMemSlot();
 
     void SetOwningList(CMemSlotList* slotList) { List = slotList; }
+    CMemSlotList* GetOwningList() const { return List; }
 
     int GetLastFrameUsed() const { return LastFrameUsed; }
     inline void RecordAccess(int curFrame);
 
     int GetFirstPage() const { return FirstPage; }
     int GetPageLength() const { return PageLength; }
+    int GetFirstBlock() const { return FirstBlock; }
+    int GetNumBlocks() const { return NumBlocks; }
     GS::tPSM GetPixFormat() const { return PixFormat; }
+    bool IsDynamic() const { return Dynamic; }
+    bool IsInPlanes() const { return InPlanes; }
 
     void Bind(CMemArea& memArea, int curFrame);
     void Unbind();
     bool IsBound() const { return (BoundMemArea != NULL); }
+    CMemArea* GetBoundMemArea() const { return BoundMemArea; }
+
+    // the next slot towards the LRU end of the list, and towards the MRU end
+    CMemSlot* GetNext() const { return Next; }
+    CMemSlot* GetPrev() const { return Prev; }
+
+    // (a dynamic slot, when the mem manager compacts gs memory)
+    void MoveTo(int firstBlock);
 
     inline void Lock();
     inline void Unlock();
@@ -80,15 +128,23 @@ public:
  * CMemSlotList
  */
 
+// The slots are linked through CMemSlot::Prev/Next, so that touching one on
+// every bind (see CMemArea::IsAllocated()) doesn't have to look for it.
+
 class CMemSlotList {
-    std::list<CMemSlot*> Slots;
+    CMemSlot *Head, *Tail; // MRU, LRU
     int PageLength;
     GS::tPSM PixFormat;
-    typedef std::list<CMemSlot*>::iterator tSlotIter;
+
+    inline void Unlink(CMemSlot* slot);
+    inline void LinkHead(CMemSlot* slot);
+    inline void LinkTail(CMemSlot* slot);
 
 public:
     CMemSlotList(int pageLength, GS::tPSM pixFormat)
-        : PageLength(pageLength)
+        : Head(NULL)
+        , Tail(NULL)
+        , PageLength(pageLength)
         , PixFormat(pixFormat)
     {
     }
@@ -101,24 +157,82 @@ public:
 
     void AddSlot(CMemSlot* newSlot)
     {
-        Slots.push_back(newSlot);
+        LinkTail(newSlot);
         newSlot->SetOwningList(this);
     }
-    void RemoveSlot(CMemSlot* slot);
+    inline void RemoveSlot(CMemSlot* slot);
 
-    void MakeSlotLRU(CMemSlot* slot);
-    void MakeSlotMRU(CMemSlot* slot);
+    inline void MakeSlotLRU(CMemSlot* slot);
+    inline void MakeSlotMRU(CMemSlot* slot);
 
     GS::tPSM GetPixFormat() const { return PixFormat; }
     int GetPageLength() const { return PageLength; }
 
-    CMemSlot* GetLRUSlot() const { return Slots.back(); }
+    CMemSlot* GetLRUSlot() const { return Tail; }
+    CMemSlot* GetMRUSlot() const { return Head; }
 
     void RemoveAllSlots();
 
     void PrintSlots();
 };
 
+void CMemSlotList::Unlink(CMemSlot* slot)
+{
+    if (slot->Prev)
+        slot->Prev->Next = slot->Next;
+    else
+        Head = slot->Next;
+    if (slot->Next)
+        slot->Next->Prev = slot->Prev;
+    else
+        Tail = slot->Prev;
+    slot->Prev = slot->Next = NULL;
+}
+
+void CMemSlotList::LinkHead(CMemSlot* slot)
+{
+    slot->Prev = NULL;
+    slot->Next = Head;
+    if (Head)
+        Head->Prev = slot;
+    else
+        Tail = slot;
+    Head = slot;
+}
+
+void CMemSlotList::LinkTail(CMemSlot* slot)
+{
+    slot->Next = NULL;
+    slot->Prev = Tail;
+    if (Tail)
+        Tail->Next = slot;
+    else
+        Head = slot;
+    Tail = slot;
+}
+
+void CMemSlotList::RemoveSlot(CMemSlot* slot)
+{
+    mErrorIf(slot->List != this, "This list does not contain the specified slot!");
+    Unlink(slot);
+}
+
+void CMemSlotList::MakeSlotLRU(CMemSlot* slot)
+{
+    if (slot != Tail) {
+        Unlink(slot);
+        LinkTail(slot);
+    }
+}
+
+void CMemSlotList::MakeSlotMRU(CMemSlot* slot)
+{
+    if (slot != Head) {
+        Unlink(slot);
+        LinkHead(slot);
+    }
+}
+
 // needs to be after the definition of CMemSlotList
 void CMemSlot::RecordAccess(int curFrame)
 {
@@ -136,6 +250,12 @@ class CMemManager {
     CMemSlotList LockedSlots;
     int CurFrame;
 
+    // see UseAllocator()
+    CVramAllocator* Allocator;
+    CMemSlotList DynamicSlots;
+    CMemSlotList PlaneSlots;
+    int CompactionBudget;
+
     typedef std::list<CMemSlotList*>::iterator tSlotListIter;
 
     CMemSlotList* FindSlotListOfType(const CMemSlot& slot);
@@ -146,6 +266,13 @@ class CMemManager {
     void Alloc24(CMemArea& memArea);
     void Alloc32(CMemArea& memArea);
 
+    void AllocDynamic(CMemArea& memArea);
+    bool AllocPlanes(CMemArea& memArea);
+    void FreeDynamic(CMemSlot& slot);
+    void FreePlaneTenants(int firstPage, int numPages);
+    bool HasLockedTenants(const CMemSlot& slot);
+    void AddMove(CSCDmaPacket& packet, int fromPage, int toPage, int numPages);
+
     int GetFreePriority(CMemSlot& slot, int areaPageLength);
     CMemSlot* FindLRUSlot(GS::tPSM pixFormat, int pageLength);
 
@@ -153,6 +280,10 @@ public:
     CMemManager()
         : LockedSlots(0, (GS::tPSM)-1)
         , CurFrame(0)
+        , Allocator(NULL)
+        , DynamicSlots(0, (GS::tPSM)-1)
+        , PlaneSlots(0, (GS::tPSM)-1)
+        , CompactionBudget(0)
     {
     }
     ~CMemManager();
@@ -164,10 +295,42 @@ public:
     void RemoveLockedSlot(CMemSlot* slot)
     {
         LockedSlots.RemoveSlot(slot);
-        CMemSlotList* slotList = FindSlotListOfType(*slot);
+        CMemSlotList* slotList;
+        if (slot->IsInPlanes())
+            slotList = &PlaneSlots;
+        else
+            slotList = (slot->IsDynamic()) ? &DynamicSlots : FindSlotListOfType(*slot);
         slotList->AddSlot(slot);
     }
 
+    // Instead of the slots added with AddSlot(), areas get exactly the space they
+    // need from an allocator over [firstPage, firstPage + numPages), and give it back
+    // when they're freed.  When it's full the least recently used unlocked areas
+    // are freed to make room, as with slots.  (Can't be mixed with AddSlot().)
+    //
+    // The upper 8 bits of 24-bit areas of a page or more (and of 32-bit areas
+    // marked with CMemArea::SetAlphaUnused()) are used for 8h, 4hl and 4hh areas
+    // before any free pages are.  A 4hl area can end up in the 4hh bits and vice
+    // versa, so check the area's format after Alloc().  Freeing the 24-bit area
+    // frees the areas in its upper bits.  (It's an error while one of them is
+    // locked; the pages then stay allocated until the area in them is unlocked.)
+    void UseAllocator(int firstPage, int numPages);
+    CVramAllocator* GetAllocator() const { return Allocator; }
+
+    // Gathers the allocator's free pages by moving areas down into the lowest
+    // space they fit in, highest areas first.  The moves are gs local-to-local
+    // transfers added to packet (a gif chain; a tag is opened if none is), so they
+    // happen in order with the drawing in it.  Moved areas get new word addresses
+    // and their move callbacks are called (see CMemArea::SetMoveCallback()).
+    // Locked areas, areas smaller than a page, areas in the upper bits of others
+    // and the areas they're in aren't moved.
+    //
+    // Moves stop at the budget, which is in blocks (256 bytes each) copied per
+    // call (0 for no limit), so that compaction can be spread over frames.
+    // Returns the number of blocks moved.
+    int Compact(CSCDmaPacket& packet);
+    void SetCompactionBudget(int numBlocks) { CompactionBudget = numBlocks; }
+
     void Alloc(CMemArea& memArea);
     void Free(CMemArea& memArea);
 
@@ -183,21 +346,35 @@ public:
  * CMemArea
  */
 
+// With the mem manager's allocator, an area that's kAlignBlock and smaller than
+// a page only takes the blocks it covers (textures and cluts; frame and depth
+// buffers need kAlignPage).  Slots are always whole pages.
 typedef enum { kAlignBlock,
     kAlignPage } tMemAlignment;
 
 class CMemArea {
+public:
+    typedef void (*tMoveCallback)(CMemArea& area, void* arg);
+
+private:
     int Width, Height, PageLength;
+    // the blocks the area covers from its first one (see tMemAlignment)
+    int NumBlocks;
     CMemSlot* Slot;
     unsigned int GSWordAddr;
     GS::tPSM PixFormat;
     tMemAlignment Alignment;
+    tMoveCallback MoveCallback;
+    void* MoveCallbackArg;
+    bool AlphaUnused;
 
     void XformDimensions(int* width, int* height, GS::tPSM pixFormat);
+    static int GetBlockFootprint(int width, int height, GS::tPSM pixFormat);
 
     bool IsResident() const { return (Slot != NULL); }
 
 protected:
+    friend class CMemManager;
     friend void CMemSlot::Lock();
     friend void CMemSlot::Unlock();
     // this should probably just be in the GS:: namespace and called directly
@@ -248,11 +425,28 @@ public:
     int GetHeight() const { return Height; }
     GS::tPSM GetPixFormat() const { return PixFormat; }
     int GetPageLength() const { return PageLength; }
+    int GetNumBlocks() const { return NumBlocks; }
     unsigned int GetWordAddr() const { return GSWordAddr; }
 
     // for debugging and compatibility
     void SetWordAddr(unsigned int addr) { GSWordAddr = addr; }
 
+    // A 32-bit area whose upper 8 bits aren't used can have 8h, 4hl and 4hh areas
+    // put in them, like a 24-bit area (see CMemManager::UseAllocator()).  Its own
+    // uploads should then be psmct24 so as not to overwrite them.  Takes effect at
+    // the next Alloc().
+    void SetAlphaUnused(bool unused) { AlphaUnused = unused; }
+    bool IsAlphaUnused() const { return AlphaUnused; }
+
+    // called when CMemManager::Compact() moves the area, to update whatever has
+    // its word address (CTexEnv::ImageAreaMoved() and ClutAreaMoved() do it for
+    // a texture)
+    void SetMoveCallback(tMoveCallback callback, void* arg)
+    {
+        MoveCallback    = callback;
+        MoveCallbackArg = arg;
+    }
+
     void Bind(CMemSlot& slot);
     void Unbind();
 
@@ -0,0 +1,117 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_gsmemsim_h
+#define ps2s_gsmemsim_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/gs_consts.h"
+#include "ps2s/softdmac.h"
+#include "ps2s/types.h"
+
+/********************************************
+ * class GsMemSim
+ */
+
+// A model of the gs's 4 MB of local memory, with the page, block and column
+// layout of every pixel format, so that where the pixels of an upload really
+// land (and what else they land on) can be checked off-console.
+//
+// Pixels are addressed as in the gs registers:  a base pointer in blocks (64
+// words) and a buffer width in units of 64 pixels.  Write() and Read() move a
+// rectangle of pixels packed as in a host <-> local transfer (24-bit pixels in
+// 3 bytes, 4-bit pixels two to a byte, low nibble first).  8h, 4hl and 4hh are
+// laid out as 32-bit pixels and only touch bits 24-31, 24-27 and 28-31 of their
+// words; 24-bit pixels leave bits 24-31 alone.
+//
+// As a CDmaSink (for the gif channel, or a CVifSim's gif sink) it runs the
+// image transfers in a gif stream:  BITBLTBUF, TRXPOS, TRXREG and TRXDIR sent
+// with A+D, the IMAGE mode data of host -> local transfers, and local -> local
+// transfers.  Everything else in the stream is skipped.
+
+class CGsMemSim : public CDmaSink {
+public:
+    static const uint32_t kNumWords = 1024 * 1024;
+
+    CGsMemSim(void);
+    virtual ~CGsMemSim(void) {}
+
+    // clears memory, the transfer registers and the stats
+    void Reset(void);
+    void ResetStats(void);
+
+    // addressing:  the word pixel (x, y) is in, and how far up the word it is.  A
+    // pixel has GS::GetBitsPerPixel() bits.
+    static uint32_t GetWordAddr(GS::tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y,
+        uint32_t* shift = NULL);
+
+    uint32_t ReadPixel(GS::tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y) const;
+    void WritePixel(GS::tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y, uint32_t value);
+
+    // w x h pixels at (x, y), packed as in a transfer
+    void Write(GS::tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+        const void* data);
+    void Read(GS::tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+        void* data) const;
+    // the bytes of w x h pixels packed as in a transfer
+    static uint32_t GetPackedBytes(GS::tPSM psm, uint32_t w, uint32_t h);
+
+    // CDmaSink -- tags (with tte on) aren't gif data and are skipped
+    virtual void Receive(tDmaChannelId channel, const uint128_t* data, uint32_t numQwords, bool isTag);
+    void Feed(const uint128_t* qwords, uint32_t numQwords);
+
+    // memory, kNumWords words
+    const uint32_t* GetMem(void) const { return &Mem[0]; }
+    uint32_t* GetMem(void) { return &Mem[0]; }
+
+    // the transfer registers, as last written
+    uint64_t GetBitbltbuf(void) const { return ulBitbltbuf; }
+    uint64_t GetTrxpos(void) const { return ulTrxpos; }
+    uint64_t GetTrxreg(void) const { return ulTrxreg; }
+    // true between a host -> local TRXDIR and the last pixel of the transfer
+    bool IsInTransfer(void) const { return uiXferPixelsLeft > 0; }
+
+    uint32_t GetNumPixelsWritten(void) const { return uiNumPixelsWritten; }
+    uint32_t GetNumTransfers(void) const { return uiNumTransfers; }
+    void Print(void) const;
+
+    // once something goes wrong the rest of the stream is ignored
+    const char* GetError(void) const { return pError; }
+
+private:
+    static uint32_t GetBlockAddr(GS::tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y);
+    static uint32_t GetColumnAddr(GS::tPSM psm, uint32_t x, uint32_t y, uint32_t* shift);
+    static uint32_t GetBlockWidth(GS::tPSM psm);
+
+    void FeedQword(const uint32_t* words);
+    void SetReg(uint32_t addr, uint64_t value);
+    void StartTransfer(void);
+    void TransferWord(uint32_t word);
+    void CopyLocal(void);
+
+    std::vector<uint32_t> Mem;
+
+    uint64_t ulBitbltbuf, ulTrxpos, ulTrxreg;
+
+    // the giftag being read
+    uint32_t uiQwordsLeft, uiNumRegs, uiRegIndex, uiFlag;
+    uint64_t ulRegs;
+
+    // the host -> local transfer under way
+    uint32_t uiXferX, uiXferY, uiXferPixelsLeft;
+    uint64_t ulXferBits;
+    uint32_t uiXferNumBits;
+
+    uint32_t uiNumPixelsWritten, uiNumTransfers;
+    const char* pError;
+};
+
+#endif // ps2s_gsmemsim_h
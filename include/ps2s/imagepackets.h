@@ -23,6 +23,7 @@ class CTexture;
 
 class CImageUploadPkt : protected CVifSCDmaPacket {
     friend class CTexture;
+    friend class CPath3Scheduler;
 
 public:
     CImageUploadPkt(uint128_t* imagePtr, uint32_t w, uint32_t h, GS::tPSM psm, uint32_t gsBufWidth = 0, uint32_t gsWordAddress = 0);
@@ -62,11 +63,13 @@ public:
 
     void Reset() { CVifSCDmaPacket::Reset(); }
 
-    void Send(bool waitForEnd = false, bool flushCache = true)
+    CDmaFence Send(bool waitForEnd = false, bool flushCache = true)
     {
-        CSCDmaPacket::Send(waitForEnd, flushCache);
+        return CSCDmaPacket::Send(waitForEnd, flushCache);
     }
 
+    // the chain ends in a ret, so these call it when the packet's embed mode is
+    // kEmbedCall and copy it otherwise
     void Send(CSCDmaPacket& packet);
     void Send(CVifSCDmaPacket& packet);
 
@@ -75,9 +78,11 @@ public:
 
 protected:
 private:
+    void CopyInto(CSCDmaPacket& packet);
+
     // gs packet to setup the texture image transfer
     struct {
-        // DMA tag + GIF tag + 4 register settings (+ 15 rest ?)
+        // DMA tag + GIF tag + 4 register settings + 5 (cnt + giftag, ref) pairs + ret
         uint128_t FirstDmaTag;
         tGifTag ImageXferSettingsGifTag;
         GS::tBitbltbuf gsrBitBltBuf;
@@ -88,7 +93,7 @@ private:
         uint64_t TrxRegAddr;
         GS::tTrxdir gsrTrxDir;
         uint64_t TrxDirAddr;
-        uint128_t RestOfPacket[15];
+        uint128_t RestOfPacket[16];
     } __attribute__((packed,aligned(16)));
 
     uint32_t uiNumXferGSRegs;
@@ -104,6 +109,7 @@ private:
 
 class CClutUploadPkt : protected CImageUploadPkt {
     friend class CTexture;
+    friend class CPath3Scheduler;
 
 public:
     CClutUploadPkt(uint32_t* clutPtr, uint32_t gsMemWordAddr)
@@ -128,9 +134,9 @@ public:
         SetImage((uint128_t*)clutPtr, 16, 16, GS::kPsm32);
     }
     void Reset() { CVifSCDmaPacket::Reset(); }
-    void Send(bool waitForEnd = false, bool flushCache = true)
+    CDmaFence Send(bool waitForEnd = false, bool flushCache = true)
     {
-        CImageUploadPkt::Send(waitForEnd, flushCache);
+        return CImageUploadPkt::Send(waitForEnd, flushCache);
     }
 
     inline void Send(CSCDmaPacket& packet) { CImageUploadPkt::Send(packet); }
@@ -12,10 +12,16 @@
  */
 
 #include <stdlib.h>
+#include <vector>
 
+#ifdef _EE
 #include "dma.h"
+#endif
 
+#include "ps2s/dmabackend.h"
 #include "ps2s/dmac.h"
+#include "ps2s/dmafence.h"
+#include "ps2s/packetpool.h"
 #include "ps2s/types.h"
 #include "ps2s/vif.h"
 
@@ -50,6 +56,12 @@ static const bool kSingleBuff = false;
 static const bool kMasked     = true;
 static const bool kNotMasked  = false;
 
+// how prebuilt chains (image uploads, texture settings, sprites..) are put into
+// a packet:  copied in, or called (one tag, but the chain has to stay put until
+// the packet has been sent)
+typedef enum { kEmbedCopy,
+    kEmbedCall } tEmbedMode;
+
 } // namespace Packet
 
 /********************************************
@@ -72,34 +84,43 @@ public:
     inline dataType* Add(const dataType data);
     template <class dataType>
     inline dataType* Add(const dataType* data, uint32_t num);
+    // makes room for numBytes and returns it, for data that's written in place
+    inline uint8_t* Reserve(uint32_t numBytes);
 
     // to use these you MUST cast to CDmaPacket&!! (otherwise you'll get a compiler error..  I
     // could make inlines for all of CDmaPacket's descendants, but I will certainly forget to
     // update them at some point in the future, when I may not be lucky enough to have
     // the compiler catch it...)
+    // (chunked packets aren't one buffer, and can't be added)
     void operator+=(const CDmaPacket& otherPkt);
     inline uint128_t* Add(const CDmaPacket& otherPkt);
 
-    inline void Reset(void) { pNext = pBase; }
+    virtual void Reset(void) { pNext = pBase; }
     inline void SetDmaChannel(tDmaChannelId channel);
-    virtual void Send(bool waitForEnd = false, bool flushCache = true);
+    // returns the transfer's fence; the buffer can be reused once it has passed
+    virtual CDmaFence Send(bool waitForEnd = false, bool flushCache = true);
 
     // accessors
 
     uint128_t* GetBase(void) const { return (uint128_t*)pBase; }
+    tDmaChannelId GetDmaChannel(void) const { return dmaChannelId; }
     uint8_t* GetNextPtr(void) const { return pNext; }
-    uint32_t GetByteLength(void) const { return (uint32_t)pNext - (uint32_t)pBase; }
+    uint32_t GetByteLength(void) const { return (uintptr_t)pNext - (uintptr_t)pBase; }
+    // see CSCDmaPacket
+    virtual bool IsChunked(void) const { return false; }
 
     static void* AllocBuffer(int numQwords, unsigned int memMapping);
     // be VERY careful using this.. it swaps its internal dma buffer with the new,
     // returning the old..  be aware of where memory is being deallocated..
     void* SwapOutBuffer(void* newBuffer);
 
-    void HexDump(uint32_t numQwords = 0);
+    virtual void HexDump(uint32_t numQwords = 0);
     virtual void Print(void);
 
 protected:
     uint8_t *pBase, *pNext;
+    // the end of the buffer pNext is in
+    uint8_t* pBufferEnd;
     tDmaChannelId dmaChannelId;
     uint32_t uiBufferQwordSize;
 
@@ -122,7 +143,11 @@ class CSCDmaPacket : public CDmaPacket {
 public:
     CSCDmaPacket(uint32_t bufferQWSize, tDmaChannelId channel, bool tte, uint32_t memMapping = Core::MemMappings::Normal);
     CSCDmaPacket(uint128_t* buffer, uint32_t bufferQWSize, tDmaChannelId channel, bool tte, uint32_t memMapping = Core::MemMappings::Normal, bool isFull = false);
-    virtual ~CSCDmaPacket(void) {}
+    // chunked: instead of overflowing, the packet links a new chunk from the pool
+    // with a Next tag when it runs out of room.  Reset() and the destructor give
+    // the chunks back, so they wait for the last Send() to finish first.
+    CSCDmaPacket(CPacketChunkPool& pool, tDmaChannelId channel, bool tte);
+    virtual ~CSCDmaPacket(void);
 
     template <class dataType>
     inline void operator+=(const dataType data);
@@ -130,6 +155,8 @@ public:
     inline dataType* Add(const dataType data);
     template <class dataType>
     inline dataType* Add(const dataType* data, uint32_t num);
+    // the space is in one chunk
+    inline uint8_t* Reserve(uint32_t numBytes);
 
     inline void operator+=(const CDmaPacket& otherPkt);
     inline uint128_t* Add(const CDmaPacket& otherPkt);
@@ -148,20 +175,77 @@ public:
     CSCDmaPacket& Pad96(uint32_t padData);
     CSCDmaPacket& Pad128(uint32_t padData);
 
-    virtual void Send(bool waitForEnd = false, bool flushCache = true);
+    // in a chunked packet, makes sure that the next numBytes will land in the same
+    // chunk (does nothing otherwise)
+    inline void EnsureRoom(uint32_t numBytes);
+
+    // Prebuilt chains end in a Ret so that they can be called, or sent on their own
+    // (a Ret with an empty call stack ends the transfer).  This adds a Call to one if the embed
+    // mode is kEmbedCall and the dmac's call stack has room (chainCallDepth is how
+    // deep the chain itself calls); otherwise it returns false and the chain should be copied.
+    virtual bool CallIfPossible(const void* chain, uint32_t chainCallDepth = 0);
+
+    void SetEmbedMode(Packet::tEmbedMode mode) { EmbedMode = mode; }
+    Packet::tEmbedMode GetEmbedMode(void) const { return EmbedMode; }
+    // how many levels of the dmac's call stack this chain uses
+    uint32_t GetCallDepth(void) const { return uiCallDepth; }
+
+    virtual void Reset(void);
+    virtual CDmaFence Send(bool waitForEnd = false, bool flushCache = true);
 
+    // With tte on the upper half of each tag goes to the vif, so whatever is added
+    // right after a tag (the next one or two vifcodes) lands there; what's left
+    // of it is filled with nops when the tag is closed or the next one is added.
     bool GetTTE(void) const { return bTTE; }
     void SetTTE(bool onOff) { bTTE = onOff; }
 
     bool HasOpenTag() const { return pOpenTag != NULL; }
 
+    virtual bool IsChunked(void) const { return pChunkPool != NULL; }
+    // an unchunked packet is one chunk
+    uint32_t GetNumChunks(void) const { return (pChunkPool) ? Chunks.size() : 1; }
+    const uint128_t* GetChunk(uint32_t chunk) const { return (pChunkPool) ? Chunks[chunk].Qwords : GetBase(); }
+    inline uint32_t GetChunkByteLength(uint32_t chunk) const;
+    // all the chunks, with the tags linking them
+    inline uint32_t GetByteLength(void) const;
+
+    // chunk by chunk
+    virtual void HexDump(uint32_t numQwords = 0);
+
+    // in debug builds Send() runs the chain through a CDmaChainVerifier first
+    // (see chainverify.h) unless this is turned off
+    static void SetVerifyOnSend(bool verify) { bVerifyOnSend = verify; }
+
 protected:
     void SetDmaTag(tDmaTag* tag, uint32_t QWC, uint32_t PCE, uint32_t ID, uint32_t IRQ, const uint128_t* ADDR, uint32_t SPR);
 
+    // starts a new chunk; the packet needs to be qword aligned
+    virtual void NextChunk(void);
+    // links a new chunk and moves pNext to it, carrying any open tag across
+    void LinkNewChunk(void);
+
+    // nops out what's left of the upper half of the last tag
+    inline void FillTTE(void);
+
     bool bTTE;
     tDmaTag* pOpenTag;
+    // unused bytes in the upper half of the last tag
     uint32_t uiTTEBytesLeft;
 
+    Packet::tEmbedMode EmbedMode;
+    uint32_t uiCallDepth;
+
+    CPacketChunkPool* pChunkPool;
+    std::vector<tPacketChunk> Chunks;
+    // the bytes used in each chunk but the last
+    std::vector<uint32_t> ChunkLengths;
+    // the space past this is kept for the tag linking the next chunk
+    uint8_t* pChunkLimit;
+    // the last transfer of the chunks, which can't go back to the pool before it's done
+    CDmaFence LastSend;
+
+    static bool bVerifyOnSend;
+
 private:
     // these will be passed as u32's as the QWC field, which is only 16 bits wide
     // so it should be ok to use the upper half-word
@@ -169,6 +253,14 @@ private:
     static const uint32_t dontCountQWC = 1 << 17;
 
     inline void AddDmaTag(uint32_t QWC, uint32_t PCE, uint32_t ID, uint32_t IRQ, const uint128_t* ADDR, uint32_t SPR);
+    inline void AddCallDepth(uint32_t calleeDepth);
+
+    template <class dataType>
+    dataType* AddAcrossChunks(const dataType* data, uint32_t num);
+
+    friend class CDmaChainOptimizer;
+    friend class CDmaChainLinker;
+    friend class CImageUploadPkt;
 
     // see the note in CDmaPacket
     CSCDmaPacket(const CSCDmaPacket& pktToCopy);
@@ -183,6 +275,10 @@ class CVifSCDmaPacket : public CSCDmaPacket {
 public:
     CVifSCDmaPacket(uint32_t bufferQWSize, tDmaChannelId channel, bool tte, uint32_t memMapping = Core::MemMappings::Normal);
     CVifSCDmaPacket(uint128_t* buffer, uint32_t bufferQWSize, tDmaChannelId channel, bool tte, uint32_t memMapping = Core::MemMappings::Normal, bool isFull = false);
+    // chunked: an open DIRECT or UNPACK is closed at the end of a chunk and reopened
+    // in the next.  Data for other vifcodes is never split across chunks if the vifcode
+    // knows its size (Mpg() does), otherwise call EnsureRoom() first.
+    CVifSCDmaPacket(CPacketChunkPool& pool, tDmaChannelId channel, bool tte);
 
     virtual ~CVifSCDmaPacket(void) {}
 
@@ -218,9 +314,17 @@ public:
     inline CVifSCDmaPacket& Pad96(void);
     inline CVifSCDmaPacket& Pad128(void);
 
+    // the vif needs tte on to see the vifcodes in the called chain's tags
+    virtual bool CallIfPossible(const void* chain, uint32_t chainCallDepth = 0);
+
+protected:
+    virtual void NextChunk(void);
+
 private:
     static const uint32_t Unused = 0;
     Vifs::tVifCode* pOpenVifCode;
+    // quads of the open vifcode that went out in previous chunks
+    uint32_t uiOpenVifCodeCarried;
     uint32_t uiWL, uiCL;
 };
 
@@ -229,13 +333,13 @@ private:
  */
 
 #define mCheckFreeSpace(__type) \
-    mErrorIf(pNext + sizeof(__type) > (pBase + uiBufferQwordSize * 16), "Not enough space in packet!")
+    mErrorIf(pNext + sizeof(__type) > pBufferEnd, "Not enough space in packet!")
 #define mCheckFreeSpaceN(__type, __num) \
-    mErrorIf(pNext + (__num) * sizeof(__type) > (pBase + uiBufferQwordSize * 16), "Not enough space in packet!")
+    mErrorIf(pNext + (__num) * sizeof(__type) > pBufferEnd, "Not enough space in packet!")
 
 #define mCheckPktAlignment(__type)     \
     mWarnIf(sizeof(__type) == 16       \
-            && (uint32_t)pNext & (16 - 1), \
+            && (uintptr_t)pNext & (16 - 1), \
         "You're trying to add 16-byte data to this packet on a non-16-byte boundary.. Are you sure this is right?")
 
 #define mAddData(__type, __data)                \
@@ -272,6 +376,17 @@ CDmaPacket::Add(const dataType* data, uint32_t num)
     mCheckPktAlignment(dataType);
 
     dataType* dataStart = reinterpret_cast<dataType*>(pNext);
+
+    // whole qwords going between qword-aligned addresses (settings blocks,
+    // gif packets, other packets..) take the bulk copy
+    uint32_t numBytes = num * sizeof(dataType);
+    if ((sizeof(dataType) & (16 - 1)) == 0
+        && (((uintptr_t)pNext | (uintptr_t)data) & (16 - 1)) == 0) {
+        Utils::MemCpy128(reinterpret_cast<uint128_t*>(pNext), reinterpret_cast<const uint128_t*>(data), numBytes / 16);
+        pNext += numBytes;
+        return dataStart;
+    }
+
     dataType* nextStore = dataStart;
     for (uint32_t i = 0; i < num; i++)
         *nextStore++ = *data++;
@@ -280,9 +395,23 @@ CDmaPacket::Add(const dataType* data, uint32_t num)
     return dataStart;
 }
 
+inline uint8_t*
+CDmaPacket::Reserve(uint32_t numBytes)
+{
+    mCheckFreeSpaceN(uint8_t, numBytes);
+
+    uint8_t* dataStart = pNext;
+    pNext += numBytes;
+    return dataStart;
+}
+
 inline void
 CDmaPacket::operator+=(const CDmaPacket& otherPkt)
 {
+    if (otherPkt.IsChunked()) {
+        mError("Chunked packets can't be added to others; call them instead.");
+        return;
+    }
     uint32_t numBytes = otherPkt.GetByteLength();
     mErrorIf(numBytes & (16 - 1), "Can only add packets that are an even # of quads.");
 
@@ -319,7 +448,7 @@ class CDmaPacket::Helper {
 	public:
 		static inline void AddSize( CDmaPacket& packet, const dataType data ) {
 			mErrorIf( packet.pNext+byteSize > (packet.pBase + packet.uiBufferQwordSize*16), "Not enough space in packet!" );
-			mErrorIf( (uint32_t)packet.pNext & (byteSize - 1), "Free space in packet not properly aligned!" );
+			mErrorIf( (uintptr_t)packet.pNext & (byteSize - 1), "Free space in packet not properly aligned!" );
 
 			*(dataType*)packet.pNext = data; packet.pNext += byteSize;
 		}
@@ -330,7 +459,7 @@ class CDmaPacket::Helper < dataType, 16 > {
 	public:
 		static inline void AddSize( CDmaPacket& packet, const dataType data ) {
 			mErrorIf( packet.pNext+sizeof(data) > (packet.pBase + packet.uiBufferQwordSize*16), "Not enough space in packet!" );
-			mErrorIf( (uint32_t)packet.pNext & (sizeof(data) - 1), "Free space in packet not properly aligned!" );
+			mErrorIf( (uintptr_t)packet.pNext & (sizeof(data) - 1), "Free space in packet not properly aligned!" );
 
 			union { dataType realData; uint128_t qword; } uData = { data };
 			*(uint128_t*)packet.pNext = uData.qword; packet.pNext += 16;
@@ -349,22 +478,52 @@ class CDmaPacket::Helper < dataType, 16 > {
 
 // adds
 
-#define mTemporaryTTEHandler(__dataSize)
+// data added right after a tag uses up its upper half
+#define mUseTTESpace(__dataSize) \
+    uiTTEBytesLeft = (uiTTEBytesLeft > (__dataSize)) ? uiTTEBytesLeft - (__dataSize) : 0
 
 #define mCheckTTESpaceN(__dataType, __num)                                   \
     mErrorIf((!pOpenTag) && uiTTEBytesLeft < ((__num) * sizeof(__dataType)), \
         "Don't you think you should open a dma tag before adding data?")
 
 #define mCheckXferAddrAlign(_addr) \
-    mErrorIf((uint32_t)(_addr) & (16 - 1), "I suggest you only point to qword-aligned memory..")
+    mErrorIf((uintptr_t)(_addr) & (16 - 1), "I suggest you only point to qword-aligned memory..")
+
+inline uint32_t
+CSCDmaPacket::GetChunkByteLength(uint32_t chunk) const
+{
+    if (chunk + 1 == GetNumChunks())
+        return (uintptr_t)pNext - (uintptr_t)GetChunk(chunk);
+    else
+        return ChunkLengths[chunk];
+}
+
+inline uint32_t
+CSCDmaPacket::GetByteLength(void) const
+{
+    uint32_t numBytes = 0;
+    for (uint32_t i = 0; i < GetNumChunks(); i++)
+        numBytes += GetChunkByteLength(i);
+    return numBytes;
+}
+
+inline void
+CSCDmaPacket::EnsureRoom(uint32_t numBytes)
+{
+    if (pChunkPool && pNext + numBytes > pChunkLimit) {
+        NextChunk();
+        mErrorIf(pNext + numBytes > pChunkLimit, "That won't fit in a packet chunk!");
+    }
+}
 
 template <class dataType>
 inline dataType*
 CSCDmaPacket::Add(const dataType data)
 {
+    EnsureRoom(sizeof(dataType));
     mCheckTTESpaceN(dataType, 1);
     dataType* retValue = CDmaPacket::Add<dataType>(data);
-    mTemporaryTTEHandler(sizeof(dataType));
+    mUseTTESpace(sizeof(dataType));
     return retValue;
 }
 
@@ -379,23 +538,80 @@ template <class dataType>
 inline dataType*
 CSCDmaPacket::Add(const dataType* data, uint32_t num)
 {
+    if (pChunkPool && pNext + num * sizeof(dataType) > pChunkLimit)
+        return AddAcrossChunks(data, num);
+
     mCheckTTESpaceN(dataType, num);
     dataType* retValue = CDmaPacket::Add<dataType>(data, num);
-    mTemporaryTTEHandler(sizeof(dataType) * num);
+    mUseTTESpace(sizeof(dataType) * num);
     return retValue;
 }
 
-#undef mTemporaryTTEHandler
+inline uint8_t*
+CSCDmaPacket::Reserve(uint32_t numBytes)
+{
+    EnsureRoom(numBytes);
+    mCheckTTESpaceN(uint8_t, numBytes);
+    uint8_t* dataStart = CDmaPacket::Reserve(numBytes);
+    mUseTTESpace(numBytes);
+    return dataStart;
+}
+
+// fills what's left of the current chunk and continues in the next.  Returns
+// the start of the data, but remember that it's no longer contiguous.
+template <class dataType>
+dataType*
+CSCDmaPacket::AddAcrossChunks(const dataType* data, uint32_t num)
+{
+    dataType* dataStart = NULL;
+    while (num > 0) {
+        uint32_t numFit = ((uintptr_t)pChunkLimit - (uintptr_t)pNext) / sizeof(dataType);
+        if (numFit == 0) {
+            EnsureRoom(sizeof(dataType));
+            continue;
+        }
+        if (numFit > num)
+            numFit = num;
+
+        dataType* chunkStart = Add(data, numFit);
+        if (dataStart == NULL)
+            dataStart = chunkStart;
+        data += numFit;
+        num -= numFit;
+    }
+    return dataStart;
+}
+
+#undef mUseTTESpace
 #undef mCheckTTESpaceN
 
 inline void
 CSCDmaPacket::operator+=(const CDmaPacket& otherPkt)
 {
-    CDmaPacket::operator+=(otherPkt);
+    Add(otherPkt);
 }
 inline uint128_t*
 CSCDmaPacket::Add(const CDmaPacket& otherPkt)
 {
+    if (otherPkt.IsChunked()) {
+        mError("Chunked packets can't be added to others; call them instead.");
+        return NULL;
+    }
+    uint32_t numBytes = otherPkt.GetByteLength();
+    mErrorIf(numBytes & (16 - 1), "Can only add packets that are an even # of quads.");
+
+    // data for an open tag can go across chunks like any other
+    if (pOpenTag != NULL)
+        return Add(otherPkt.GetBase(), numBytes / 16);
+
+    // otherwise it's most likely a chain of its own, which has to start on a qword
+    // and can't be split (the link to the next chunk would land in the middle of it)
+    if (pChunkPool != NULL && numBytes > uiBufferQwordSize * 16 - 16) {
+        mError("A chain of %d bytes won't fit in one chunk; call it instead.", numBytes);
+        return NULL;
+    }
+    FillTTE();
+    EnsureRoom(numBytes);
     return CDmaPacket::Add(otherPkt);
 }
 
@@ -408,19 +624,29 @@ CSCDmaPacket::SetDmaTag(tDmaTag* tag, uint32_t QWC, uint32_t PCE, uint32_t ID, u
     tag->PCE  = PCE;
     tag->ID   = ID;
     tag->IRQ  = IRQ;
-    tag->ADDR = (uint64_t)((uint32_t)ADDR);
+    tag->ADDR = DMAC::MakeTagAddr(ADDR);
     tag->SPR  = SPR;
 }
 
+inline void
+CSCDmaPacket::FillTTE(void)
+{
+    while (uiTTEBytesLeft > 0) {
+        *pNext++ = 0;
+        uiTTEBytesLeft--;
+    }
+}
+
 inline CSCDmaPacket&
 CSCDmaPacket::CloseTag(void)
 {
     mErrorIf(!pOpenTag, "You called CloseTag(), but no dma tags are open!");
-    mErrorIf(((uint32_t)pNext & (16 - 1)) != 0, "Packet is not qword aligned");
+    FillTTE();
+    mErrorIf(((uintptr_t)pNext & (16 - 1)) != 0, "Packet is not qword aligned");
     // set the qwc field of any open tags.. (- 1 is so that we don't count the qword
     // containing the *pOpenTag)
     if (pOpenTag)
-        pOpenTag->QWC = (((uint32_t)pNext - (uint32_t)pOpenTag) / 16 - 1);
+        pOpenTag->QWC = (((uintptr_t)pNext - (uintptr_t)pOpenTag) / 16 - 1);
 
     pOpenTag = NULL;
     return *this;
@@ -429,8 +655,11 @@ CSCDmaPacket::CloseTag(void)
 inline void
 CSCDmaPacket::AddDmaTag(uint32_t QWC, uint32_t PCE, uint32_t ID, uint32_t IRQ, const uint128_t* ADDR, uint32_t SPR)
 {
-    mErrorIf(((uint32_t)pNext & 0xf) != 0, "Free space in packet is not aligned properly.");
+    // (the last tag was a ref that didn't use all of its upper half)
+    FillTTE();
+    mErrorIf(((uintptr_t)pNext & 0xf) != 0, "Free space in packet is not aligned properly.");
     mErrorIf(pOpenTag, "You need to close any open dma tags before opening another!");
+    EnsureRoom(16);
 
     if (QWC == countQWC) {
         SetDmaTag((tDmaTag*)pNext, 0, PCE, ID, IRQ, ADDR, SPR);
@@ -494,12 +723,22 @@ CSCDmaPacket::Refe(const void* refData, uint32_t dataQWLen, bool irq, bool sp, u
     return *this;
 }
 
+inline void
+CSCDmaPacket::AddCallDepth(uint32_t calleeDepth)
+{
+    mErrorIf(calleeDepth + 1 > DMAC::kMaxCallDepth, "The dmac can only nest calls two deep!");
+    if (calleeDepth + 1 > uiCallDepth)
+        uiCallDepth = calleeDepth + 1;
+}
+
 inline CSCDmaPacket&
 CSCDmaPacket::Call(const void* nextTag, bool irq, bool sp, uint32_t pce)
 {
     mCheckXferAddrAlign(nextTag);
     xlateAddr(nextTag);
     AddDmaTag(countQWC, pce, DMAC::kCall, irq, (uint128_t*)nextTag, sp);
+    // we don't know what's there, so assume it doesn't call anything itself
+    AddCallDepth(0);
     return *this;
 }
 
@@ -509,6 +748,7 @@ CSCDmaPacket::Call(const CSCDmaPacket& pkt, bool irq, bool sp, uint32_t pce)
     mCheckXferAddrAlign(pkt.pBase);
     AddDmaTag(countQWC, pce, DMAC::kCall, irq,
         Core::MakePtrNormal((uint128_t*)pkt.pBase), sp);
+    AddCallDepth(pkt.uiCallDepth);
     return *this;
 }
 
@@ -529,7 +769,7 @@ CSCDmaPacket::End(bool irq, uint32_t pce)
 inline CSCDmaPacket&
 CSCDmaPacket::Pad96(uint32_t padData)
 {
-    while ((((uint32_t)pNext + 4) & 0xf) != 0)
+    while ((((uintptr_t)pNext + 4) & 0xf) != 0)
         *this += padData;
     return *this;
 }
@@ -537,7 +777,7 @@ CSCDmaPacket::Pad96(uint32_t padData)
 inline CSCDmaPacket&
 CSCDmaPacket::Pad128(uint32_t padData)
 {
-    while (((uint32_t)pNext & 0xf) != 0)
+    while (((uintptr_t)pNext & 0xf) != 0)
         *this += padData;
     return *this;
 }
@@ -660,6 +900,7 @@ CVifSCDmaPacket::Mscalf(uint32_t addr, bool irq)
 inline CVifSCDmaPacket&
 CVifSCDmaPacket::Stmask(Vifs::tMask mask, bool irq)
 {
+    EnsureRoom(4 + sizeof(mask));
     *this += mMakeVifCode(Unused, Unused, Vifs::Opcodes::stmask, irq);
     *this += mask;
     return *this;
@@ -669,6 +910,7 @@ inline CVifSCDmaPacket&
 CVifSCDmaPacket::Strow(const void* rowArray, bool irq)
 {
     const uint32_t* wordArray = (const uint32_t*)rowArray;
+    EnsureRoom(4 * 5);
     *this += mMakeVifCode(Unused, Unused, Vifs::Opcodes::strow, irq);
     *this += wordArray[0];
     *this += wordArray[1];
@@ -681,6 +923,7 @@ inline CVifSCDmaPacket&
 CVifSCDmaPacket::Stcol(const void* colArray, bool irq)
 {
     const uint32_t* wordArray = (const uint32_t*)colArray;
+    EnsureRoom(4 * 5);
     *this += mMakeVifCode(Unused, Unused, Vifs::Opcodes::stcol, irq);
     *this += wordArray[0];
     *this += wordArray[1];
@@ -692,6 +935,11 @@ CVifSCDmaPacket::Stcol(const void* colArray, bool irq)
 inline CVifSCDmaPacket&
 CVifSCDmaPacket::Mpg(uint32_t num, uint32_t addr, bool irq)
 {
+    // keep the microcode in the same chunk as the vifcode (num == 0 means 256 instructions)
+    EnsureRoom(4 + 4 + ((num == 0) ? 256 : num) * 8);
+    // the microcode has to start on a dword boundary, so the vifcode goes in an odd word
+    if (((uintptr_t)pNext & 0x7) == 0)
+        Nop();
     *this += mMakeVifCode(addr, num, Vifs::Opcodes::mpg, irq);
     return *this;
 }
@@ -700,7 +948,9 @@ inline CVifSCDmaPacket&
 CVifSCDmaPacket::OpenUnpack(uint32_t mode, uint32_t vuAddr, bool dblBuffered, bool masked, bool usigned, bool irq)
 {
     mErrorIf(pOpenVifCode != NULL, "There is still another vifcode open.");
-    pOpenVifCode = (Vifs::tVifCode*)pNext;
+    EnsureRoom(4);
+    pOpenVifCode         = (Vifs::tVifCode*)pNext;
+    uiOpenVifCodeCarried = 0;
     *this += mMakeVifCode(vuAddr | ((uint32_t)usigned << 14) | ((uint32_t)dblBuffered << 15),
         0,
         mode | ((uint32_t)masked << 4) | 0x60, irq);
@@ -711,7 +961,10 @@ inline CVifSCDmaPacket&
 CVifSCDmaPacket::CloseUnpack(uint32_t unpackNUM)
 {
     // make sure we're u32 aligned and a vifcode is open and it's an unpack
-    mAssert(((uint32_t)pNext & 0x3) == 0 && pOpenVifCode && ((pOpenVifCode->cmd & 0x60) == 0x60));
+    mAssert(((uintptr_t)pNext & 0x3) == 0 && pOpenVifCode && ((pOpenVifCode->cmd & 0x60) == 0x60));
+    // the quads that went out with previous chunks have already been accounted for
+    mAssert(unpackNUM >= uiOpenVifCodeCarried);
+    unpackNUM -= uiOpenVifCodeCarried;
     mAssert(unpackNUM <= 256);
     pOpenVifCode->num = (unpackNUM == 256) ? 0 : unpackNUM;
     pOpenVifCode      = NULL;
@@ -730,7 +983,14 @@ inline CVifSCDmaPacket&
 CVifSCDmaPacket::OpenDirect(bool irq)
 {
     mAssert(pOpenVifCode == NULL);
-    pOpenVifCode = (Vifs::tVifCode*)pNext;
+    // the data has to start on a qword boundary, so the vifcode goes at the end of
+    // one (with tte on, right after a tag that's in the tag)
+    uint32_t numPadBytes = (12 - ((uintptr_t)pNext & 0xf)) & 0xf;
+    EnsureRoom(numPadBytes + 4);
+    while ((((uintptr_t)pNext + 4) & 0xf) != 0)
+        Nop();
+    pOpenVifCode         = (Vifs::tVifCode*)pNext;
+    uiOpenVifCodeCarried = 0;
     *this += mMakeVifCode(0, Unused, Vifs::Opcodes::direct, irq);
     return *this;
 }
@@ -738,8 +998,9 @@ CVifSCDmaPacket::OpenDirect(bool irq)
 inline CVifSCDmaPacket&
 CVifSCDmaPacket::CloseDirect(uint32_t numQuads)
 {
-    mAssert(pOpenVifCode != NULL && (((uint32_t)pNext - ((uint32_t)pOpenVifCode + 4)) & 0xf) == 0);
-    pOpenVifCode->immediate = numQuads;
+    mAssert(pOpenVifCode != NULL && (((uintptr_t)pNext - ((uintptr_t)pOpenVifCode + 4)) & 0xf) == 0);
+    mAssert(numQuads >= uiOpenVifCodeCarried);
+    pOpenVifCode->immediate = numQuads - uiOpenVifCodeCarried;
     pOpenVifCode            = NULL;
     return *this;
 }
@@ -747,7 +1008,7 @@ CVifSCDmaPacket::CloseDirect(uint32_t numQuads)
 inline CVifSCDmaPacket&
 CVifSCDmaPacket::CloseDirect(void)
 {
-    return CloseDirect(((uint32_t)pNext - ((uint32_t)pOpenVifCode + 4)) / 16);
+    return CloseDirect(((uintptr_t)pNext - ((uintptr_t)pOpenVifCode + 4)) / 16 + uiOpenVifCodeCarried);
 }
 
 inline CVifSCDmaPacket&
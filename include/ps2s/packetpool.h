@@ -0,0 +1,65 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_packetpool_h
+#define ps2s_packetpool_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/core.h"
+#include "ps2s/types.h"
+
+/********************************************
+ * class PacketChunkPool
+ */
+
+// a chunk's buffer.  The chunk lists hold these instead of uint128_t pointers,
+// which lose uint128_t's alignment attribute as template arguments (and gcc
+// warns about it everywhere this is included).
+typedef struct {
+    uint128_t* Qwords;
+} tPacketChunk;
+
+// A pool of equally sized dma buffers for chunked packets (see the chunked
+// constructors of CSCDmaPacket and CVifSCDmaPacket).  A chunked packet takes
+// a chunk from here whenever it runs out of room and gives them all back
+// (but the first) when it's reset, after waiting for its last send to finish
+// so that no other packet writes a chunk the dmac is still reading.  Chunks are
+// never freed until the pool is destroyed, so the pool only grows to the peak
+// number of chunks in use.
+
+class CPacketChunkPool {
+public:
+    CPacketChunkPool(uint32_t chunkQWSize, uint32_t numPrealloc = 0, uint32_t memMapping = Core::MemMappings::Normal);
+    ~CPacketChunkPool(void);
+
+    uint128_t* Get(void);
+    void Release(uint128_t* chunk);
+
+    uint32_t GetChunkQWSize(void) const { return uiChunkQWSize; }
+    uint32_t GetMemMapping(void) const { return uiMemMapping; }
+
+    uint32_t GetNumChunks(void) const { return AllChunks.size(); }
+    uint32_t GetNumFree(void) const { return FreeChunks.size(); }
+    uint32_t GetNumInUse(void) const { return AllChunks.size() - FreeChunks.size(); }
+    // the peak number of chunks in use at once
+    uint32_t GetMaxInUse(void) const { return uiMaxInUse; }
+
+private:
+    std::vector<tPacketChunk> AllChunks, FreeChunks;
+    uint32_t uiChunkQWSize, uiMemMapping;
+    uint32_t uiMaxInUse;
+
+    // no copying
+    CPacketChunkPool(const CPacketChunkPool& rhs);
+    CPacketChunkPool& operator=(const CPacketChunkPool& rhs);
+};
+
+#endif // ps2s_packetpool_h
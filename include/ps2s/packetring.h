@@ -0,0 +1,69 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_packetring_h
+#define ps2s_packetring_h
+
+/********************************************
+ * includes
+ */
+
+#include "ps2s/core.h"
+#include "ps2s/dmac.h"
+#include "ps2s/dmafence.h"
+#include "ps2s/packet.h"
+#include "ps2s/types.h"
+
+/********************************************
+ * class PacketRing
+ */
+
+// A ring of per-frame source chain packets for one channel, so that the next
+// frame can be built while the last one is still being transferred.  A frame's
+// buffer is only handed out again once its transfer's fence has passed.
+//
+// The frames are vif packets so that the same ring can be used for vif1 and
+// gif chains (just use them as CSCDmaPackets for the gif).
+
+class CPacketRing {
+public:
+    CPacketRing(uint32_t numFrames, uint32_t frameQWSize, tDmaChannelId channel, bool tte,
+        uint32_t memMapping = Core::MemMappings::Normal);
+    ~CPacketRing(void);
+
+    // moves on to the next frame's packet and resets it.  This only stalls if
+    // that packet is still being transferred.
+    CVifSCDmaPacket& BeginFrame(void);
+    // sends the current frame without waiting for it to finish
+    CDmaFence Kick(bool flushCache = true);
+
+    CVifSCDmaPacket& GetCurFrame(void) { return *Frames[uiCurFrame]; }
+    // the fence of the last kick of the given frame
+    const CDmaFence& GetFrameFence(uint32_t frame) const { return FrameFences[frame]; }
+    uint32_t GetNumFrames(void) const { return uiNumFrames; }
+    tDmaChannelId GetDmaChannel(void) const { return dmaChannelId; }
+
+    // time spent waiting on busy buffers (in cpu cycles, ee only)
+    uint32_t GetStallCycles(void) const { return uiStallCycles; }
+    uint32_t GetNumStalls(void) const { return uiNumStalls; }
+    void ResetStallStats(void) { uiStallCycles = uiNumStalls = 0; }
+
+private:
+    void WaitForFence(const CDmaFence& fence);
+
+    CVifSCDmaPacket** Frames;
+    CDmaFence* FrameFences;
+    uint32_t uiNumFrames, uiCurFrame;
+    tDmaChannelId dmaChannelId;
+
+    uint32_t uiStallCycles, uiNumStalls;
+
+    // no copying
+    CPacketRing(const CPacketRing& rhs);
+    CPacketRing& operator=(const CPacketRing& rhs);
+};
+
+#endif // ps2s_packetring_h
@@ -0,0 +1,93 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_path3scheduler_h
+#define ps2s_path3scheduler_h
+
+/********************************************
+ * includes
+ */
+
+#include "ps2s/types.h"
+
+class CSCDmaPacket;
+class CVifSCDmaPacket;
+class CImageUploadPkt;
+class CClutUploadPkt;
+
+/********************************************
+ * class Path3Scheduler
+ */
+
+// Lets texture uploads on the gif channel (path3) go while vu1 is busy with
+// geometry, instead of before or after it.  A frame is a vif1 packet with the
+// geometry and a gif packet with the uploads, sent together, vif1 first:
+//
+//  - BeginFrame() masks path3 (MSKPATH3) at the start of the vif1 packet, so
+//    the gif channel waits
+//  - VuBusy(), called after each kick, unmasks it while the vu works, and
+//    CloseWindow() masks it again before the vif sends the gs something itself
+//  - WaitForUploads() is for geometry that needs what's been uploaded so far;
+//    it unmasks path3 and waits for it to finish (FLUSHA)
+//  - EndFrame() unmasks path3 for whatever is left
+//
+// Path3 is only stopped at the end of a gif packet, so the uploads are split
+// into image packets of at most sliceQwords, which is also about how long a
+// xgkick can be held up by one.
+//
+// FLUSHA waits for the whole gif packet, uploads added after the wait included,
+// so queue what the frame needs before its first WaitForUploads().
+//
+// How much overlapped is an estimate: each window is taken to move as many bytes
+// as path3 can in the vu cycles given to VuBusy(), and whatever is still queued
+// at WaitForUploads() or EndFrame() is counted as not overlapped.
+
+class CPath3Scheduler {
+public:
+    typedef struct {
+        uint32_t NumUploads;
+        uint32_t NumUploadBytes;     // image data
+        uint32_t NumOverlappedBytes; // estimated to have gone while the vu was busy
+        uint32_t NumWindows;         // times path3 was unmasked for the vu
+        uint32_t NumWaits;           // FLUSHAs
+    } tFrameStats;
+
+    // about what path3 moves in a vu cycle (a qword per bus cycle, at half the vu clock)
+    static const uint32_t kBytesPerVuCycle = 8;
+
+    CPath3Scheduler(uint32_t sliceQwords = 512);
+
+    void BeginFrame(CVifSCDmaPacket& vifPacket, CSCDmaPacket& gifPacket);
+    const tFrameStats& EndFrame(void);
+
+    // queues the upload on path3 (copying its settings; the image itself is referenced)
+    void AddUpload(const CImageUploadPkt& upload);
+    void AddUpload(const CClutUploadPkt& upload);
+
+    // the vu was just kicked and will be busy for about vuCycles
+    void VuBusy(uint32_t vuCycles);
+    void CloseWindow(void);
+    void WaitForUploads(void);
+
+    const tFrameStats& GetLastFrame(void) const { return LastFrame; }
+    uint32_t GetSliceQwords(void) const { return uiSliceQwords; }
+
+private:
+    void SetMask(bool masked);
+
+    CVifSCDmaPacket* pVifPacket;
+    CSCDmaPacket* pGifPacket;
+    uint32_t uiSliceQwords;
+    bool bMasked;
+    // a FLUSHA has emptied the gif packet
+    bool bWaited;
+
+    // upload bytes not yet thought to have gone
+    uint32_t uiNumPendingBytes;
+    tFrameStats Frame, LastFrame;
+};
+
+#endif // ps2s_path3scheduler_h
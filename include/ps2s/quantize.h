@@ -0,0 +1,88 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_quantize_h
+#define ps2s_quantize_h
+
+/********************************************
+ * includes
+ */
+
+#include "ps2s/types.h"
+
+class CVifSCDmaPacket;
+
+/********************************************
+ * Quantize
+ */
+
+// Batch conversion of float vertex data to the 16-bit, 8-bit and 5:5:5:1
+// formats the compact unpack modes take, so less goes through the vif.
+//
+// A quantizer maps each component to fixed point with a scale and bias:
+//
+//     packed = round((x - Bias) * Scale), clamped to the format
+//
+// and the vu gets x back as packed / Scale + Bias, which can usually be folded
+// into a matrix the vertices are multiplied by anyway (see FoldIntoMatrix()).
+//
+// Streams are converted four floats at a time with sse2 on a host that has it.
+// On the ee that's done with vu0 macro mode and mmi packing if the library is
+// built with QUANTIZE_VU0 (it hasn't been run on hardware yet, so the scalar
+// code is the default).  Every path rounds the same way (halves go up), so they
+// only differ by float rounding.
+//
+// The vu0 path uses macro-mode registers $vf1-$vf5, so anything kept in them (by
+// inline asm using vu0 across calls) is lost in Convert() and AddToUnpack().
+
+namespace Quantize {
+
+typedef enum {
+    kS16,
+    kU16,
+    kS8,
+    kU8
+} tFormat;
+
+typedef struct {
+    float Scale[4];
+    float Bias[4];
+} tQuantizer;
+
+// the same scale and bias for every component (fixed point is bias 0, scale 2^n)
+void SetQuantizer(tQuantizer& quantizer, float scale, float bias = 0.0f);
+// uses the whole range of the format for values from minValues to maxValues
+void FitQuantizer(tQuantizer& quantizer, const float* minValues, const float* maxValues,
+    uint32_t numComponents, tFormat format);
+
+// what the vu multiplies and adds to get the floats back
+void GetDecode(const tQuantizer& quantizer, float* decodeScale, float* decodeBias);
+// changes the (column-major, 4x4) matrix so that it takes the packed values
+// (as floats) instead of the originals: M * (packed / Scale + Bias)
+void FoldIntoMatrix(const tQuantizer& quantizer, float* matrix);
+
+uint32_t GetNumBytes(tFormat format);
+bool IsUnsigned(tFormat format);
+// the unpack mode for numComponents components in the format
+uint32_t GetUnpackMode(tFormat format, uint32_t numComponents);
+
+// converts numVertices elements of numComponents floats; the elements are
+// srcStride floats apart (0 means packed)
+void Convert(void* dest, tFormat format, const float* src, uint32_t numVertices, uint32_t numComponents,
+    const tQuantizer& quantizer, uint32_t srcStride = 0);
+// colors of 4 floats from 0 to colorMax; alpha is set from colorMax / 2 up
+void ConvertRgba5551(uint16_t* dest, const float* src, uint32_t numVertices, float colorMax = 255.0f,
+    uint32_t srcStride = 0);
+
+// the same, but converted straight into the open unpack of a packet (padded to a
+// word), which has to fit in the current chunk
+void AddToUnpack(CVifSCDmaPacket& packet, tFormat format, const float* src, uint32_t numVertices,
+    uint32_t numComponents, const tQuantizer& quantizer, uint32_t srcStride = 0);
+void AddRgba5551ToUnpack(CVifSCDmaPacket& packet, const float* src, uint32_t numVertices,
+    float colorMax = 255.0f, uint32_t srcStride = 0);
+}
+
+#endif // ps2s_quantize_h
@@ -0,0 +1,131 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_softdmac_h
+#define ps2s_softdmac_h
+
+/********************************************
+ * includes
+ */
+
+#include "ps2s/dmabackend.h"
+#include "ps2s/dmac.h"
+#include "ps2s/types.h"
+
+// This file (and softdmac.cpp) deliberately doesn't depend on the sdk or
+// on anything ee-specific so that it will build and run on a host machine.
+// The same goes for the sinks and tools built on it: vifsim.h, gsmemsim.h,
+// chainverify.h and dmacapture.h.
+
+/********************************************
+ * class DmaSink
+ */
+
+class CDmaSink {
+public:
+    virtual ~CDmaSink(void) {}
+
+    // called with each run of qwords that arrives at the peripheral end of the channel.
+    // When tte is on each source chain tag is passed on its own, with isTag set.
+    virtual void Receive(tDmaChannelId channel, const uint128_t* data, uint32_t numQwords, bool isTag) = 0;
+};
+
+/********************************************
+ * class DmaCountingSink
+ */
+
+// throws everything away, but counts it first (and touches it, so that timing
+// a walk through this sink includes reading the data)
+
+class CDmaCountingSink : public CDmaSink {
+public:
+    CDmaCountingSink(void) { Reset(); }
+
+    virtual void Receive(tDmaChannelId channel, const uint128_t* data, uint32_t numQwords, bool isTag);
+
+    void Reset(void)
+    {
+        uiNumQwords = uiNumTagQwords = 0;
+        uiChecksum                   = 0;
+    }
+
+    uint32_t GetNumQwords(void) const { return uiNumQwords; }
+    uint32_t GetNumTagQwords(void) const { return uiNumTagQwords; }
+    uint32_t GetChecksum(void) const { return uiChecksum; }
+
+private:
+    uint32_t uiNumQwords, uiNumTagQwords;
+    uint32_t uiChecksum;
+};
+
+/********************************************
+ * class SoftDmac
+ */
+
+class CSoftDmac : public CDmaBackend {
+public:
+    CSoftDmac(void);
+    virtual ~CSoftDmac(void) {}
+
+    // what a single source chain tag tells the dmac to do
+    typedef struct {
+        uint32_t DataAddr;
+        uint32_t DataQWC;
+        bool DataFromSpr;
+        uint32_t NextTagAddr;
+        bool Push; // call: push the address after the data
+        bool Pop;  // ret: next tag comes off the address stack (or stop if it's empty)
+        bool Last; // refe/end: stop after the data
+    } tTagStep;
+
+    static void DecodeTag(const tDmaTag& tag, uint32_t tagAddr, tTagStep& step);
+
+    // CDmaBackend -- transfers happen immediately, so the channels are never busy
+
+    virtual void SendNormal(tDmaChannelId channel, const void* data, uint32_t numQwords);
+    virtual void SendChain(tDmaChannelId channel, const void* firstTag, bool tte);
+    virtual void Wait(tDmaChannelId channel) {}
+    virtual bool IsBusy(tDmaChannelId channel) { return false; }
+    virtual void FlushCache(void) {}
+
+    // walks the chain starting with firstTag, feeding the channel's sink.  Returns false
+    // if the chain is malformed, in which case GetError() says why.
+    bool WalkChain(tDmaChannelId channel, const void* firstTag, bool tte);
+
+    void SetSink(tDmaChannelId channel, CDmaSink* sink);
+    CDmaSink* GetSink(tDmaChannelId channel) const { return Sinks[channel]; }
+
+    // tags with SPR set read from here; on the ee this should be the real
+    // scratchpad (Core::MemMappings::SP)
+    void SetScratchpad(void* scratchpad) { pScratchpad = (uint8_t*)scratchpad; }
+    // a runaway chain (a loop of Next tags, for example) is an error after this many tags
+    void SetMaxTags(uint32_t maxTags) { uiMaxTags = maxTags; }
+
+    const char* GetError(void) const { return pError; }
+
+    uint32_t GetNumTags(void) const { return uiNumTags; }
+    uint32_t GetNumQwords(void) const { return uiNumQwords; }
+    uint32_t GetNumTransfers(void) const { return uiNumTransfers; }
+    void ResetStats(void) { uiNumTags = uiNumQwords = uiNumTransfers = 0; }
+
+private:
+    static const uint32_t kNumChannels    = 10;
+    static const uint32_t kScratchpadSize = 16 * 1024;
+
+    const uint128_t* GetDataPtr(uint32_t addr, bool fromSpr) const;
+    inline void Transfer(tDmaChannelId channel, const uint128_t* data, uint32_t numQwords, bool isTag);
+
+    CDmaSink* Sinks[kNumChannels];
+    uint8_t* pScratchpad;
+    uint32_t uiMaxTags;
+    const char* pError;
+
+    uint32_t uiNumTags, uiNumQwords, uiNumTransfers;
+
+    uint128_t LocalScratchpad[kScratchpadSize / 16];
+};
+
+#endif // ps2s_softdmac_h
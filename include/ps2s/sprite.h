@@ -37,6 +37,7 @@ public:
     {
         GifPacket.Send(waitForEnd, flushCache);
     }
+    // with kEmbedCall packets the sprite is called, so leave it alone until the packet's gone
     void Draw(CSCDmaPacket& packet);
     void Draw(CVifSCDmaPacket& packet);
 
@@ -88,7 +89,8 @@ public:
 protected:
 private:
     struct {
-        // GIF tag + 5 qwords data
+        // DMA tag (so the sprite can be called) + GIF tag + 5 qwords data
+        tSourceChainTag DrawDmaTag;
         tGifTag DrawGifTag;
         uint32_t Color[4];
         tTexCoords TexCoords1;
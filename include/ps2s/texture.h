@@ -25,6 +25,8 @@ class CClutUploadPkt;
 
 namespace GS {
 
+class CMemArea;
+
 /********************************************
     * typedefs
     */
@@ -110,8 +112,15 @@ public:
     }
     inline void SetUseTexAlpha(bool useTexAlpha);
 
+    // move callbacks for the image and clut mem areas, to keep the addresses
+    // up to date when the mem manager compacts gs memory:
+    //     imageArea.SetMoveCallback(CTexEnv::ImageAreaMoved, &texEnv);
+    static void ImageAreaMoved(GS::CMemArea& area, void* texEnv);
+    static void ClutAreaMoved(GS::CMemArea& area, void* texEnv);
+
     // other
 
+    // the settings are called rather than copied if the packet's embed mode is kEmbedCall
     void SendSettings(bool waitForEnd = false, bool flushCache = true);
     void SendSettings(CSCDmaPacket& packet);
     void SendSettings(CVifSCDmaPacket& packet);
@@ -225,9 +234,9 @@ public:
     }
     unsigned int GetGsAddr() const { return GsAddr; }
 
-    void Send(bool waitForEnd = false, bool flushCache = true)
+    CDmaFence Send(bool waitForEnd = false, bool flushCache = true)
     {
-        UploadPkt->Send(waitForEnd, flushCache);
+        return UploadPkt->Send(waitForEnd, flushCache);
     }
     void Send(CSCDmaPacket& packet) { UploadPkt->Send(packet); }
     void Send(CVifSCDmaPacket& packet) { UploadPkt->Send(packet); }
@@ -7,6 +7,7 @@
 #ifndef ps2s_utils_h
 #define ps2s_utils_h
 
+#include "ps2s/core.h"
 #include "ps2s/debug.h"
 #include "ps2s/types.h"
 #include <stdio.h>
@@ -18,6 +19,15 @@
 namespace Utils {
 inline void MemCpy128(uint128_t* dest, const uint128_t* src, uint32_t numQwords);
 
+// the out-of-line bulk copies MemCpy128 uses for anything bigger than a few
+// qwords.  They copy a cache line (4 qwords) per iteration and prefetch ahead
+// of the source.  The uncached-accelerated version doesn't touch the
+// destination lines since they'd just pollute the cache.
+void MemCpy128Cached(uint128_t* dest, const uint128_t* src, uint32_t numQwords);
+void MemCpy128UncachedAccl(uint128_t* dest, const uint128_t* src, uint32_t numQwords);
+
+static const uint32_t kMemCpy128BulkMin = 8;
+
 inline void QwordHexDump(uint32_t* mem, uint32_t numQwords);
 inline void QwordDecDump(uint32_t* mem, uint32_t numQwords);
 inline void QwordFloatDump(float* mem, uint32_t numQwords);
@@ -30,9 +40,17 @@ inline void QwordFloatDump(float* mem, uint32_t numQwords);
 inline void
 Utils::MemCpy128(uint128_t* dest, const uint128_t* src, uint32_t numQwords)
 {
-    mAssert(((uint32_t)dest & 0xf) == 0 && ((uint32_t)src & 0xf) == 0);
-    while (numQwords-- > 0)
-        *(dest++) = *(src++);
+    mAssert(((uintptr_t)dest & 0xf) == 0 && ((uintptr_t)src & 0xf) == 0);
+    if (numQwords < kMemCpy128BulkMin) {
+        while (numQwords-- > 0)
+            *(dest++) = *(src++);
+    }
+#ifdef _EE
+    else if (((uintptr_t)dest & 0xf0000000) == Core::MemMappings::UncachedAccl)
+        MemCpy128UncachedAccl(dest, src, numQwords);
+#endif
+    else
+        MemCpy128Cached(dest, src, numQwords);
 }
 
 inline void
@@ -40,7 +58,8 @@ Utils::QwordHexDump(uint32_t* mem, uint32_t numQwords)
 {
     uint32_t i;
     for (i = 0; i < numQwords; i++, mem += 4)
-        printf("%08lx: 0x%08lx 0x%08lx 0x%08lx 0x%08lx\n", (uint32_t)mem, mem[0], mem[1], mem[2], mem[3]);
+        printf("%08lx: 0x%08lx 0x%08lx 0x%08lx 0x%08lx\n", (unsigned long)(uintptr_t)mem,
+            (unsigned long)mem[0], (unsigned long)mem[1], (unsigned long)mem[2], (unsigned long)mem[3]);
 }
 
 inline void
@@ -48,7 +67,8 @@ Utils::QwordDecDump(uint32_t* mem, uint32_t numQwords)
 {
     uint32_t i;
     for (i = 0; i < numQwords; i++, mem += 4)
-        printf("%08lx: %ld %ld %ld %ld\n", (uint32_t)mem, mem[0], mem[1], mem[2], mem[3]);
+        printf("%08lx: %ld %ld %ld %ld\n", (unsigned long)(uintptr_t)mem,
+            (long)(int32_t)mem[0], (long)(int32_t)mem[1], (long)(int32_t)mem[2], (long)(int32_t)mem[3]);
 }
 
 inline void
@@ -56,7 +76,7 @@ Utils::QwordFloatDump(float* mem, uint32_t numQwords)
 {
     uint32_t i;
     for (i = 0; i < numQwords; i++, mem += 4)
-        printf("%08lx: %f %f %f %f\n", (uint32_t)mem, mem[0], mem[1], mem[2], mem[3]);
+        printf("%08lx: %f %f %f %f\n", (unsigned long)(uintptr_t)mem, mem[0], mem[1], mem[2], mem[3]);
 }
 
 #endif // ps2s_utils_h
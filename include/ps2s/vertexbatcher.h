@@ -0,0 +1,78 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_vertexbatcher_h
+#define ps2s_vertexbatcher_h
+
+/********************************************
+ * includes
+ */
+
+#include "ps2s/types.h"
+
+class CVifSCDmaPacket;
+class CUnpackPlan;
+class CVertexUploader;
+
+/********************************************
+ * class VertexBatcher
+ */
+
+// Splits a vertex stream into batches that fit vu1's double buffer and adds
+// everything it takes to run them to a packet: BASE and OFFSET once, then for
+// each batch an ITOP with its number of vertices, an optional header, the
+// vertices (unpacked relative to TOPS) and the kick.  While the vu works on one
+// half of the buffer the vif fills the other.
+//
+// The buffers are at base and base + bufferQwords, and each starts with the
+// header.  Batches are as big as the buffer allows (rounded down to a multiple
+// of batchMultiple, e.g. 3 for triangle lists), and the last overlap vertices of
+// a batch are sent again at the start of the next (2 for triangle strips).
+//
+// The microprogram finds its batch with xtop and its vertex count with xitop,
+// and ends each batch with an e bit.  It's started with MSCAL at programAddr for
+// every batch, or, with SetContinue(), for the first batch of each Emit() and
+// then with MSCNT.
+
+class CVertexBatcher {
+public:
+    CVertexBatcher(const CUnpackPlan& plan, uint32_t base, uint32_t bufferQwords);
+    CVertexBatcher(CVertexUploader& uploader, uint32_t base, uint32_t bufferQwords);
+
+    // copied into the start of every batch (the caller keeps the data)
+    void SetHeader(const void* header, uint32_t numQwords);
+    void SetBatchMultiple(uint32_t batchMultiple);
+    void SetOverlap(uint32_t numVertices);
+    void SetProgram(uint32_t programAddr) { uiProgramAddr = programAddr; }
+    // MSCNT after the first batch, for a program that loops back to its start
+    void SetContinue(bool mscnt) { bContinue = mscnt; }
+
+    // vertices per batch (before overlap)
+    uint32_t GetMaxBatchVertices(void) const;
+    uint32_t GetNumBatches(uint32_t numVertices) const;
+
+    // sends vertices [firstVertex, firstVertex + numVertices).  Unless setBuffers
+    // is false (the last Emit() used the same buffers, and the double buffering
+    // can carry on), it starts with FLUSHE so that BASE and OFFSET don't change
+    // under a batch the vu is still working on.  The packet needs an open tag.
+    void Emit(CVifSCDmaPacket& packet, uint32_t numVertices, uint32_t firstVertex = 0, bool setBuffers = true);
+
+private:
+    void Init(uint32_t vertexQwords, uint32_t base, uint32_t bufferQwords);
+
+    const CUnpackPlan* pPlan;
+    CVertexUploader* pUploader;
+
+    uint32_t uiVertexQwords;
+    uint32_t uiBase, uiBufferQwords;
+    const void* pHeader;
+    uint32_t uiHeaderQwords;
+    uint32_t uiBatchMultiple, uiOverlap;
+    uint32_t uiProgramAddr;
+    bool bContinue;
+};
+
+#endif // ps2s_vertexbatcher_h
@@ -0,0 +1,209 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_vertexformat_h
+#define ps2s_vertexformat_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/types.h"
+
+class CVifSCDmaPacket;
+
+/********************************************
+ * class VertexLayout
+ */
+
+// Describes how vertices sit in vu memory: each vertex takes GetVertexQwords()
+// quads, and each attribute one of them.  An attribute's source type is how its
+// data is stored on the ee side (and so how it travels through the vif); a
+// constant attribute has no data at all, and an attribute can have its last
+// components written from the row register instead of its data.
+
+class CVertexLayout {
+public:
+    typedef enum {
+        kFloat32,
+        kInt32,
+        kUInt32,
+        kInt16,
+        kUInt16,
+        kInt8,
+        kUInt8,
+        kRgba5551 // 4 components in 16 bits (unpacks to 8 bits per field)
+    } tSourceType;
+
+    typedef struct {
+        tSourceType SourceType;
+        uint32_t NumComponents; // 1 to 4
+        uint32_t VuOffset;      // in quads from the start of the vertex
+        bool IsConstant;
+        uint32_t NumRowComponents; // trailing components that aren't sent
+        uint32_t Constant[4];      // as they are in vu memory (for the row register)
+    } tAttribute;
+
+    CVertexLayout(uint32_t vertexQwords);
+
+    // both return the attribute's index
+    uint32_t AddAttribute(tSourceType type, uint32_t numComponents, uint32_t vuOffset);
+    uint32_t AddConstant(const void* value, uint32_t vuOffset);
+    // the last numComponents components get these values (4 words, as in vu
+    // memory; only the ones for the row components are used) instead of the data
+    void SetRowComponents(uint32_t attribute, uint32_t numComponents, const void* values);
+
+    uint32_t GetVertexQwords(void) const { return uiVertexQwords; }
+    uint32_t GetNumAttributes(void) const { return Attributes.size(); }
+    const tAttribute& GetAttribute(uint32_t attribute) const { return Attributes[attribute]; }
+
+private:
+    std::vector<tAttribute> Attributes;
+    uint32_t uiVertexQwords;
+};
+
+/********************************************
+ * class UnpackPlan
+ */
+
+// The unpacks that get a layout's vertices into vu memory, worked out once so
+// that renderers don't have to pick modes and cycle settings by hand.
+//
+//  - each attribute is unpacked in the narrowest mode its source type allows
+//    (v3_8 for 3 bytes, v4_5 for 5551 colors, ..), so only that much goes
+//    through the vif
+//  - attributes at neighbouring vu offsets with the same mode share an unpack,
+//    interleaved, with STCYCL skipping over the rest of the vertex
+//  - constant attributes cost no data when they fill the end of a vertex after
+//    a single shared unpack (a filling write from the row register); otherwise
+//    they get a masked s_8 unpack of one byte per vertex
+//  - attributes with row components get their own masked unpack, sending only
+//    the rest
+//
+// Emit() gathers the data from the attributes' sources, so they don't need to
+// be interleaved or aligned on the ee side.  The unpacks assume STMOD is 0, and
+// the plan's STROW/STMASK settings are left behind in the vif.
+
+class CUnpackPlan {
+public:
+    CUnpackPlan(const CVertexLayout& layout);
+
+    // byteStride 0 means the attribute's data is packed (the size of one element)
+    void SetSource(uint32_t attribute, const void* data, uint32_t byteStride = 0);
+
+    // unpacks vertices [firstVertex, firstVertex + numVertices) to vuAddr onwards,
+    // relative to TOPS if dblBuffered.  The packet needs an open tag.
+    void Emit(CVifSCDmaPacket& packet, uint32_t vuAddr, uint32_t firstVertex, uint32_t numVertices,
+        bool dblBuffered = true) const;
+
+    // what Emit() adds to the packet
+    uint32_t GetNumBytes(uint32_t numVertices) const;
+    // vif data per vertex
+    uint32_t GetNumBytesPerVertex(void) const;
+    uint32_t GetVertexQwords(void) const { return uiVertexQwords; }
+
+    void Print(void) const;
+
+private:
+    typedef struct {
+        uint32_t Mode;
+        bool Unsigned, Masked;
+        uint32_t VuOffset;
+        uint32_t WL, CL;
+        uint32_t FirstAttribute, NumAttributes; // into StepAttributes
+        uint32_t VertexBytes;                   // data per vertex
+        bool SetRow;
+        uint32_t Row[4], Mask;
+    } tStep;
+
+    typedef struct {
+        const uint8_t* Data;
+        uint32_t ByteStride;
+    } tSource;
+
+    void Compile(const CVertexLayout& layout);
+    void EmitStep(CVifSCDmaPacket& packet, const tStep& step, uint32_t vuAddr, uint32_t firstVertex,
+        uint32_t numVertices, bool dblBuffered) const;
+
+    std::vector<CVertexLayout::tAttribute> Attributes;
+    std::vector<tSource> Sources;
+    std::vector<tStep> Steps;
+    std::vector<uint32_t> StepAttributes;
+    uint32_t uiVertexQwords;
+};
+
+/********************************************
+ * class VertexUploader
+ */
+
+// Sends batches of vertices with a layout, leaving out what doesn't change within
+// a batch.  Each batch is scanned first:
+//
+//  - an attribute that's the same for every vertex (a constant color, a fixed
+//    normal) becomes a constant for the batch
+//  - trailing components that are the same (the w = 1.0 of a position) come
+//    from the row register through STMASK, and only the others are sent
+//
+// but only where that takes less than sending them, counting the STROW/STMASK
+// it costs.  The unpacks for a batch are worked out with a CUnpackPlan, which is
+// kept while the batches keep the same constants.
+
+class CVertexUploader {
+public:
+    typedef struct {
+        uint32_t NumBytes;              // what the batch added to the packet
+        uint32_t NumBytesSaved;         // against sending every attribute
+        uint32_t NumConstantAttributes; // that became constants
+        uint32_t NumRowComponents;      // from the row register (of the others)
+    } tBatchStats;
+
+    CVertexUploader(const CVertexLayout& layout);
+    ~CVertexUploader();
+
+    // byteStride 0 means the attribute's data is packed (the size of one element)
+    void SetSource(uint32_t attribute, const void* data, uint32_t byteStride = 0);
+
+    // like CUnpackPlan::Emit()
+    const tBatchStats& Upload(CVifSCDmaPacket& packet, uint32_t vuAddr, uint32_t firstVertex,
+        uint32_t numVertices, bool dblBuffered = true);
+
+    uint32_t GetVertexQwords(void) const { return Layout.GetVertexQwords(); }
+    const tBatchStats& GetLastBatch(void) const { return LastBatch; }
+    uint32_t GetTotalBytesSaved(void) const { return uiTotalBytesSaved; }
+    void ResetTotalBytesSaved(void) { uiTotalBytesSaved = 0; }
+
+private:
+    typedef struct {
+        const uint8_t* Data;
+        uint32_t ByteStride;
+    } tSource;
+
+    // not copyable (owns the batch plan)
+    CVertexUploader(const CVertexUploader&);
+    CVertexUploader& operator=(const CVertexUploader&);
+
+    uint32_t FindConstantComponents(uint32_t attribute, uint32_t firstVertex, uint32_t numVertices,
+        uint32_t* values) const;
+    void CompileBatchPlan(void);
+
+    CVertexLayout Layout;
+    CUnpackPlan FullPlan;
+    std::vector<tSource> Sources;
+
+    // per attribute: how many trailing components are constant (all of them for a
+    // constant), and their values (4 words each), for this batch and for the
+    // batch plan
+    std::vector<uint32_t> RowComponents, RowValues;
+    std::vector<uint32_t> PlanRowComponents, PlanRowValues;
+    CUnpackPlan* pBatchPlan;
+
+    tBatchStats LastBatch;
+    uint32_t uiTotalBytesSaved;
+};
+
+#endif // ps2s_vertexformat_h
@@ -89,6 +89,71 @@ typedef struct {
     unsigned int m15 : 2;
 } tMask;
 
+/********************************************
+    * vifcode sizes
+    */
+
+static const uint32_t kUnknownSize = 0xffffffff;
+
+// the number of words of data that follow a vifcode, given the current STCYCL
+// settings (kUnknownSize if the vif wouldn't know what to do with it)
+inline uint32_t
+GetNumDataWords(uint32_t vifcode, uint32_t wl, uint32_t cl)
+{
+    uint32_t cmd = (vifcode >> 24) & 0x7f;
+    uint32_t num = (vifcode >> 16) & 0xff;
+    uint32_t imm = vifcode & 0xffff;
+
+    if ((cmd & 0x60) == 0x60) {
+        // unpack
+        uint32_t vn         = (cmd >> 2) & 0x3;
+        uint32_t vl         = cmd & 0x3;
+        uint32_t vecBits    = (vl == 3) ? 16 : (vn + 1) * (32 >> vl);
+        uint32_t numWritten = (num) ? num : 256;
+
+        // with filling writes only cl of every wl quads come from the packet
+        if (wl == 0)
+            wl = 256;
+        if (cl == 0)
+            cl = 256;
+        uint32_t numVecs = numWritten;
+        if (wl > cl)
+            numVecs = (numWritten / wl) * cl + ((numWritten % wl < cl) ? numWritten % wl : cl);
+
+        return (numVecs * vecBits + 31) / 32;
+    }
+
+    switch (cmd) {
+    case Opcodes::nop:
+    case Opcodes::stcycl:
+    case Opcodes::offset:
+    case Opcodes::base:
+    case Opcodes::itop:
+    case Opcodes::stmod:
+    case Opcodes::mskpath3:
+    case Opcodes::mark:
+    case Opcodes::flushe:
+    case Opcodes::flush:
+    case Opcodes::flusha:
+    case Opcodes::mscal:
+    case Opcodes::mscalf:
+    case Opcodes::mscnt:
+        return 0;
+    case Opcodes::stmask:
+        return 1;
+    case Opcodes::strow:
+    case Opcodes::stcol:
+        return 4;
+    case Opcodes::mpg:
+        return ((num) ? num : 256) * 2;
+    case Opcodes::direct:
+    case Opcodes::directhl:
+        return ((imm) ? imm : 65536) * 4;
+    default:
+        return kUnknownSize;
+    }
+}
+
 } // namespace Vifs
 
 #endif // ps2s_vif_h
@@ -0,0 +1,141 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_vifsim_h
+#define ps2s_vifsim_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/softdmac.h"
+#include "ps2s/types.h"
+
+/********************************************
+ * class VifSim
+ */
+
+// A model of vif1 that runs the vifcode stream arriving on its channel and
+// expands unpacks into an image of vu1 data memory, so that what a packet
+// really leaves in vu memory can be checked off-console.  Set it as a vif
+// channel's sink on a CSoftDmac, or Feed() it words directly.
+//
+// It handles STCYCL (skipping and filling writes), STMOD, STMASK, STROW/STCOL,
+// OFFSET/BASE/ITOP and the double buffering they drive, every unpack format
+// (with FLG, USN and masking), MPG into an image of micro memory, and
+// DIRECT/DIRECTHL, whose gif data can be passed on to another sink.  The vu
+// isn't run: MSCAL, MSCALF and MSCNT swap the double buffer and call the micro
+// callback, which can look at data memory before the next batch lands.
+//
+// The cycle counts are estimates in bus cycles, not a timing model:  a cycle
+// for each vifcode, plus one per qword of data read from the channel, except
+// that an unpack takes at least a cycle per quad written to vu memory.
+//
+// What the hardware does with the fields a v2 or v3 unpack doesn't supply,
+// and with the data fields of quads written by a filling write, isn't
+// documented.  Here they are written as 0 and with the row register.
+
+class CVifSim : public CDmaSink {
+public:
+    static const uint32_t kDataMemQwords  = 1024; // 16k
+    static const uint32_t kMicroMemDwords = 2048; // 16k
+    // passed to the micro callback by MSCNT
+    static const uint32_t kContinue = 0xffffffff;
+
+    typedef struct {
+        uint32_t Count;
+        uint32_t NumDataWords; // following the vifcodes
+        uint32_t Cycles;
+    } tCommandStats;
+
+    // called by MSCAL, MSCALF (with the program's address) and MSCNT (with kContinue)
+    typedef void (*tMicroCallback)(CVifSim& sim, uint32_t startAddr, void* arg);
+
+    CVifSim(void);
+    virtual ~CVifSim(void) {}
+
+    // clears the registers, memories and stats
+    void Reset(void);
+    void ResetStats(void);
+
+    // CDmaSink -- with tte on only the upper half of each tag reaches the vif
+    virtual void Receive(tDmaChannelId channel, const uint128_t* data, uint32_t numQwords, bool isTag);
+    // the words of a vifcode stream, starting on a qword boundary
+    void Feed(const uint32_t* words, uint32_t numWords);
+
+    void SetGifSink(CDmaSink* sink) { pGifSink = sink; }
+    void SetMicroCallback(tMicroCallback callback, void* arg)
+    {
+        pMicroCallback = callback;
+        pMicroCallbackArg = arg;
+    }
+
+    // vu1 memory: data memory is kDataMemQwords quads of 4 words
+    const uint32_t* GetDataMem(void) const { return DataMem; }
+    const uint32_t* GetQword(uint32_t addr) const { return &DataMem[(addr % kDataMemQwords) * 4]; }
+    const uint64_t* GetMicroMem(void) const { return MicroMem; }
+
+    // registers
+    uint32_t GetWL(void) const { return uiWL; }
+    uint32_t GetCL(void) const { return uiCL; }
+    uint32_t GetMode(void) const { return uiMode; }
+    uint32_t GetMask(void) const { return uiMask; }
+    uint32_t GetRow(uint32_t field) const { return Row[field & 3]; }
+    uint32_t GetCol(uint32_t field) const { return Col[field & 3]; }
+    uint32_t GetBase(void) const { return uiBase; }
+    uint32_t GetOffset(void) const { return uiOffset; }
+    uint32_t GetTops(void) const { return uiTops; }
+    uint32_t GetTop(void) const { return uiTop; }
+    uint32_t GetItops(void) const { return uiItops; }
+    uint32_t GetItop(void) const { return uiItop; }
+    bool GetDBF(void) const { return bDBF; }
+    uint32_t GetMark(void) const { return uiMark; }
+
+    // stats, indexed by the vifcode's cmd without the interrupt bit (and, for
+    // unpacks, without the mask bit)
+    const tCommandStats& GetCommandStats(uint32_t cmd) const { return CommandStats[cmd & 0x7f]; }
+    uint32_t GetNumCycles(void) const { return uiNumCycles; }
+    uint32_t GetNumQuadsWritten(void) const { return uiNumQuadsWritten; }
+    uint32_t GetNumMicroCalls(void) const { return uiNumMicroCalls; }
+    void Print(void) const;
+
+    // true between a vifcode and the end of its data
+    bool IsInCommand(void) const { return uiWordsLeft > 0; }
+    // once something goes wrong the rest of the stream is ignored
+    const char* GetError(void) const { return pError; }
+
+private:
+    void FeedWord(uint32_t word);
+    void StartCommand(uint32_t vifcode);
+    void Execute(void);
+    uint32_t Unpack(void);
+    void StartMicro(uint32_t startAddr);
+
+    uint32_t DataMem[kDataMemQwords * 4];
+    uint64_t MicroMem[kMicroMemDwords];
+
+    uint32_t uiWL, uiCL, uiMode, uiMask;
+    uint32_t Row[4], Col[4];
+    uint32_t uiBase, uiOffset, uiTops, uiTop, uiItops, uiItop;
+    bool bDBF;
+    uint32_t uiMark;
+
+    // the command being read
+    uint32_t uiVifCode, uiWordsLeft, uiWordPos;
+    std::vector<uint32_t> CommandData;
+
+    CDmaSink* pGifSink;
+    tMicroCallback pMicroCallback;
+    void* pMicroCallbackArg;
+
+    tCommandStats CommandStats[128];
+    uint32_t uiNumCycles, uiNumQuadsWritten, uiNumMicroCalls;
+    const char* pError;
+};
+
+#endif // ps2s_vifsim_h
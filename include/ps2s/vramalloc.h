@@ -0,0 +1,128 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_vramalloc_h
+#define ps2s_vramalloc_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/types.h"
+
+/********************************************
+ * class VramAllocator
+ */
+
+// Hands out gs memory in blocks (64 words) from a range of pages:
+//
+//  - a page or more is whole pages, from free lists segregated by size (1,
+//    2-3, 4-7.. pages).  Freed ranges are merged with the free ranges on
+//    either side.
+//  - less than a page (small textures, cluts) is rounded up to a power of two
+//    blocks and placed on a multiple of that within a page, buddy-style, in
+//    pages kept for such allocations.  A page goes back to the free lists when
+//    its last allocation is freed.
+//
+// Frame and depth buffers need whole pages (FBP and ZBP are in pages), which a
+// page or more always is.
+//
+// Pages whose upper 8 bits aren't used (24-bit frame and depth buffers) can be
+// made plane hosts, and then 8h, 4hl and 4hh textures can be given those bits of
+// them, a page at a time.  A page stops being a host when it's freed, which it
+// can't be while its planes are in use.
+
+namespace GS {
+
+class CVramAllocator {
+public:
+    static const int kNumPages      = 512;
+    static const int kBlocksPerPage = 32;
+    static const int kWordsPerBlock = 64;
+
+    // bits 24-27, 28-31 and both
+    static const int kPlanes4hl = 1;
+    static const int kPlanes4hh = 2;
+    static const int kPlanes8h  = 3;
+
+    CVramAllocator(int firstPage = 0, int numPages = kNumPages);
+
+    // returns the first block, or -1 if there's no room
+    int Alloc(int numBlocks);
+    // a page or more, in the lowest free pages that fit before limitBlock (-1 if
+    // none do)
+    int AllocLow(int numBlocks, int limitBlock);
+    // numBlocks as allocated
+    void Free(int firstBlock, int numBlocks);
+    // frees everything
+    void Reset();
+
+    // what an allocation of numBlocks really takes
+    static int GetAllocBlocks(int numBlocks);
+
+    // bit planes (allocated pages)
+    void AddPlaneHosts(int firstPage, int numPages);
+    bool IsPlaneHost(int page) const { return PlaneHosts[page] != 0; }
+    // returns the first of numPages host pages with the planes free, or -1
+    int AllocPlanes(int numPages, int planes);
+    void FreePlanes(int firstPage, int numPages, int planes);
+    int GetPlanesUsed(int firstPage, int numPages) const;
+
+    int GetFirstPage() const { return FirstPage; }
+    int GetNumPages() const { return NumPages; }
+
+    int GetNumFreePages() const { return NumFreePages; }
+    // free blocks in the pages kept for allocations under a page
+    int GetNumFreeSubPageBlocks() const;
+    int GetLargestFreePages() const;
+    // 0 when the free pages are all in one range, nearer 1 the more they're split up
+    float GetFragmentation() const;
+    int GetNumPlaneHosts() const;
+    // host pages with the planes free
+    int GetNumFreePlanes(int planes) const;
+
+    void Print() const;
+
+private:
+    typedef enum { kUsed,
+        kFree,
+        kSubPage } tPageState;
+
+    static const int kNumClasses = 10; // ranges of 2^n to 2^(n+1) - 1 pages
+
+    static int GetClass(int numPages);
+
+    int AllocPages(int numPages);
+    void FreePages(int firstPage, int numPages);
+    void AddFreeRange(int firstPage, int numPages);
+    void RemoveFreeRange(int firstPage);
+
+    int AllocSubPage(int numBlocks);
+    void FreeSubPage(int firstBlock, int numBlocks);
+
+    int FirstPage, NumPages;
+    int NumFreePages;
+
+    uint8_t PageStates[kNumPages];
+    // the length of a free range, at its first and last page
+    int16_t FreeLengths[kNumPages];
+    // the free lists, linked through the first page of each range
+    int16_t NextFree[kNumPages], PrevFree[kNumPages];
+    int16_t FreeLists[kNumClasses];
+
+    // used blocks of the sub-page pages
+    uint32_t BlockMasks[kNumPages];
+    std::vector<int> SubPages;
+
+    uint8_t PlaneHosts[kNumPages];
+    uint8_t PlanesUsed[kNumPages];
+};
+
+} // namespace GS
+
+#endif // ps2s_vramalloc_h
@@ -0,0 +1,86 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_vucodecache_h
+#define ps2s_vucodecache_h
+
+/********************************************
+ * includes
+ */
+
+#include <vector>
+
+#include "ps2s/types.h"
+
+class CVifSCDmaPacket;
+
+/********************************************
+ * class VuCodeCache
+ */
+
+// Keeps track of which microprograms are in vu1 micro memory, so that renderers
+// sharing it only MPG their code when it isn't there already.  A program is
+// its code in main memory (a dword per instruction); Load() finds it a place,
+// evicting the least recently used programs if there's no room, and adds the
+// MPG to the packet on a miss.
+//
+// The cache follows the packets as they're built, so it's only right if they
+// reach vif1 in the same order and nothing else writes micro memory; call
+// Invalidate() when something else does.  The programs have to be relocatable
+// unless they're loaded at a fixed address (branches are relative, but jr and
+// jalr targets aren't).
+
+class CVuCodeCache {
+public:
+    static const uint32_t kMicroMemDwords = 2048; // vu1: 16k
+    static const uint32_t kAnywhere       = 0xffffffff;
+
+    // the part of micro memory the cache manages, in dwords
+    CVuCodeCache(uint32_t firstDword = 0, uint32_t numDwords = kMicroMemDwords);
+
+    // makes sure the program is resident and returns its address in dwords
+    uint32_t Load(CVifSCDmaPacket& packet, const void* code, uint32_t numDwords, uint32_t fixedAddr = kAnywhere);
+    // loads the program and starts it entryOffset dwords in (MSCAL)
+    uint32_t Call(CVifSCDmaPacket& packet, const void* code, uint32_t numDwords, uint32_t entryOffset = 0);
+
+    bool IsResident(const void* code) const { return FindProgram(code) >= 0; }
+    // address of a resident program
+    uint32_t GetAddress(const void* code) const;
+
+    // forget everything (micro memory was written behind the cache's back)
+    void Invalidate(void) { Programs.clear(); }
+    // forget one program (its code changed)
+    void Invalidate(const void* code);
+
+    uint32_t GetNumHits(void) const { return uiNumHits; }
+    uint32_t GetNumMisses(void) const { return uiNumMisses; }
+    uint32_t GetNumEvictions(void) const { return uiNumEvictions; }
+    uint32_t GetNumDwordsUploaded(void) const { return uiNumDwordsUploaded; }
+    void ResetStats(void);
+    void Print(void) const;
+
+private:
+    typedef struct {
+        const void* Code;
+        uint32_t Addr, NumDwords;
+        uint32_t LastUse;
+    } tProgram;
+
+    int FindProgram(const void* code) const;
+    bool FindSpace(uint32_t numDwords, uint32_t& addr) const;
+    void Evict(uint32_t program);
+    void EvictRange(uint32_t addr, uint32_t numDwords);
+    void Upload(CVifSCDmaPacket& packet, const void* code, uint32_t addr, uint32_t numDwords);
+
+    // sorted by address
+    std::vector<tProgram> Programs;
+    uint32_t uiFirstDword, uiNumDwords;
+    uint32_t uiUseCount;
+
+    uint32_t uiNumHits, uiNumMisses, uiNumEvictions, uiNumDwordsUploaded;
+};
+
+#endif // ps2s_vucodecache_h
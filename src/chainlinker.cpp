@@ -0,0 +1,201 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+
+#include "ps2s/chainlinker.h"
+#include "ps2s/core.h"
+#include "ps2s/debug.h"
+#include "ps2s/dmac.h"
+#include "ps2s/packet.h"
+
+/********************************************
+ * DmaChainLinker
+ */
+
+CDmaChainLinker::CDmaChainLinker(void)
+    : pError(NULL)
+{
+}
+
+CDmaChainLinker::tLabel
+CDmaChainLinker::NewLabel(const char* name)
+{
+    tLabelDef label = { name, NULL, 0, 0 };
+    Labels.push_back(label);
+    return Labels.size() - 1;
+}
+
+void CDmaChainLinker::Define(tLabel label, CSCDmaPacket& packet)
+{
+    mErrorIf(label >= Labels.size(), "That isn't one of this linker's labels.");
+    mErrorIf(IsDefined(label), "Label %s is already defined.", (Labels[label].Name) ? Labels[label].Name : "");
+    mErrorIf(packet.HasOpenTag(), "The label goes on the next tag, so close the open one first.");
+
+    // make sure the next tag goes where the label says it will
+    packet.FillTTE();
+    mErrorIf(((uintptr_t)packet.pNext & 0xf) != 0, "Free space in packet is not aligned properly.");
+    packet.EnsureRoom(16);
+
+    tLabelDef& def = Labels[label];
+    def.Packet     = &packet;
+    def.Chunk      = packet.GetNumChunks() - 1;
+    def.Offset     = packet.pNext - (const uint8_t*)packet.GetChunk(def.Chunk);
+}
+
+void CDmaChainLinker::AddFixup(CSCDmaPacket& packet, tLabel label, bool isCall)
+{
+    tFixup fixup;
+    fixup.Packet = &packet;
+    fixup.Chunk  = packet.GetNumChunks() - 1;
+    fixup.Offset = (const uint8_t*)packet.pOpenTag - (const uint8_t*)packet.GetChunk(fixup.Chunk);
+    fixup.Label  = label;
+    fixup.IsCall = isCall;
+    fixup.IsResolved = false;
+    Fixups.push_back(fixup);
+}
+
+void CDmaChainLinker::ResolveFixup(tFixup& fixup)
+{
+    const CSCDmaPacket& packet = *fixup.Packet;
+    mErrorIf(packet.pOpenTag == (const tDmaTag*)((const uint8_t*)packet.GetChunk(fixup.Chunk) + fixup.Offset),
+        "Close the tags added with Next() and Call() before linking.");
+
+    // If the tag's data ran into a new chunk, the tag became the Next to that chunk
+    // and the copy of it at the start of the chunk is the one to fill in.  Nothing
+    // else writes the address before the first Link(), so a link to the start of
+    // the following chunk means just that.
+    while (fixup.Chunk + 1 < packet.GetNumChunks()) {
+        const tDmaTag* tag = (const tDmaTag*)((const uint8_t*)packet.GetChunk(fixup.Chunk) + fixup.Offset);
+        if (tag->ID != DMAC::kNext
+            || tag->ADDR != DMAC::MakeTagAddr(Core::MakePtrNormal(packet.GetChunk(fixup.Chunk + 1))))
+            break;
+        fixup.Chunk++;
+        fixup.Offset = 0;
+    }
+    fixup.IsResolved = true;
+}
+
+void CDmaChainLinker::Next(CSCDmaPacket& packet, tLabel label, bool irq, uint32_t pce)
+{
+    mErrorIf(label >= Labels.size(), "That isn't one of this linker's labels.");
+    // (the address is filled in by Link())
+    packet.Next((const tDmaTag*)NULL, irq, false, pce);
+    AddFixup(packet, label, false);
+}
+
+void CDmaChainLinker::Call(CSCDmaPacket& packet, tLabel label, bool irq, uint32_t pce)
+{
+    mErrorIf(label >= Labels.size(), "That isn't one of this linker's labels.");
+    packet.Call((const void*)NULL, irq, false, pce);
+    AddFixup(packet, label, true);
+}
+
+void CDmaChainLinker::Relocate(const CSCDmaPacket& packet, const void* copy)
+{
+    mErrorIf(packet.IsChunked(), "Only unchunked packets can be relocated.");
+    mErrorIf((uintptr_t)copy & 0xf, "The copy has to be qword aligned.");
+
+    for (uint32_t i = 0; i < Relocations.size(); i++) {
+        if (Relocations[i].Packet == &packet) {
+            if (copy)
+                Relocations[i].Copy = copy;
+            else
+                Relocations.erase(Relocations.begin() + i);
+            return;
+        }
+    }
+    if (copy) {
+        tRelocation relocation = { &packet, copy };
+        Relocations.push_back(relocation);
+    }
+}
+
+uint8_t*
+CDmaChainLinker::GetPtr(const CSCDmaPacket* packet, uint32_t chunk, uint32_t offset) const
+{
+    for (uint32_t i = 0; i < Relocations.size(); i++)
+        if (Relocations[i].Packet == packet)
+            return (uint8_t*)Relocations[i].Copy + offset;
+    return (uint8_t*)packet->GetChunk(chunk) + offset;
+}
+
+const void*
+CDmaChainLinker::GetAddress(tLabel label) const
+{
+    mErrorIf(label >= Labels.size() || !IsDefined(label), "That label isn't defined.");
+    const tLabelDef& def = Labels[label];
+    return Core::MakePtrNormal(GetPtr(def.Packet, def.Chunk, def.Offset));
+}
+
+bool CDmaChainLinker::Link(void)
+{
+    pError = NULL;
+
+    for (uint32_t i = 0; i < Fixups.size(); i++) {
+        const tLabelDef& def = Labels[Fixups[i].Label];
+        if (!IsDefined(Fixups[i].Label)) {
+            if (def.Name)
+                snprintf(ErrorBuf, sizeof(ErrorBuf), "Label %s isn't defined.", def.Name);
+            else
+                snprintf(ErrorBuf, sizeof(ErrorBuf), "Label %d isn't defined.", Fixups[i].Label);
+            pError = ErrorBuf;
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < Fixups.size(); i++)
+        if (!Fixups[i].IsResolved)
+            ResolveFixup(Fixups[i]);
+
+    for (uint32_t i = 0; i < Fixups.size(); i++) {
+        const tFixup& fixup  = Fixups[i];
+        const tLabelDef& def = Labels[fixup.Label];
+
+        tDmaTag* tag = (tDmaTag*)GetPtr(fixup.Packet, fixup.Chunk, fixup.Offset);
+        tag->ADDR    = DMAC::MakeTagAddr(GetAddress(fixup.Label));
+
+        // the caller now knows what it calls (as deep as the callee's packet calls
+        // so far, anyway)
+        if (fixup.IsCall && def.Packet != fixup.Packet)
+            fixup.Packet->AddCallDepth(def.Packet->GetCallDepth());
+    }
+
+    return true;
+}
+
+void CDmaChainLinker::Reset(void)
+{
+    for (uint32_t i = 0; i < Labels.size(); i++)
+        Labels[i].Packet = NULL;
+    Fixups.clear();
+    Relocations.clear();
+    pError = NULL;
+}
+
+void CDmaChainLinker::Print(void) const
+{
+    uint32_t numDefined = 0;
+    for (uint32_t i = 0; i < Labels.size(); i++)
+        if (IsDefined(i))
+            numDefined++;
+
+    printf("dma chain linker: %d labels (%d defined), %d fixups, %d relocated packets\n",
+        (uint32_t)Labels.size(), numDefined, (uint32_t)Fixups.size(), (uint32_t)Relocations.size());
+    for (uint32_t i = 0; i < Labels.size(); i++) {
+        const char* name = (Labels[i].Name) ? Labels[i].Name : "";
+        if (IsDefined(i))
+            printf("  %3d %-16s 0x%08x\n", i, name, DMAC::MakeTagAddr(GetAddress(i)));
+        else
+            printf("  %3d %-16s undefined\n", i, name);
+    }
+    if (pError)
+        printf("  error: %s\n", pError);
+}
@@ -0,0 +1,455 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+
+#include "ps2s/chainopt.h"
+#include "ps2s/debug.h"
+#include "ps2s/packet.h"
+#include "ps2s/softdmac.h"
+#include "ps2s/vif.h"
+
+/********************************************
+ * DmaChainOptimizer
+ */
+
+CDmaChainOptimizer::CDmaChainOptimizer(void)
+    : pError(NULL)
+    , uiMaxInlineRefQwords(2)
+    , uiMaxTags(1 << 20)
+{
+    Reset();
+}
+
+void CDmaChainOptimizer::Reset(void)
+{
+    Items.clear();
+    OutData.clear();
+
+    Stats.NumTagsBefore = Stats.NumQwordsBefore = 0;
+    Stats.NumTagsAfter = Stats.NumQwordsAfter = 0;
+    Stats.NumMergedTags = Stats.NumInlinedRefs = 0;
+    Stats.NumDroppedNopQwords = Stats.NumMergedDirects = 0;
+
+    pError         = NULL;
+    uiTerminator   = DMAC::kEnd;
+    bStreamLost    = false;
+    uiVifWordsLeft = 0;
+    uiWL = uiCL = 1;
+    iLastDirect    = -1;
+}
+
+bool CDmaChainOptimizer::Optimize(const CSCDmaPacket& source, CSCDmaPacket& dest)
+{
+    mErrorIf(source.HasOpenTag(), "The source chain still has an open tag.");
+    mErrorIf(dest.HasOpenTag() || dest.GetByteLength() != 0, "The optimized chain should go in an empty packet.");
+    mErrorIf(dest.GetTTE() != source.GetTTE(), "The source and dest packets need the same tte setting.");
+    // chunk links would put nops in the middle of vifcode data
+    mErrorIf(dest.IsChunked() && source.GetTTE(), "Can't optimize into a chunked packet with tte on.");
+
+    Reset();
+
+    bTTE        = source.GetTTE();
+    bVifChannel = (source.GetDmaChannel() == DMAC::Channels::vif0 || source.GetDmaChannel() == DMAC::Channels::vif1);
+
+    if (!Walk(source.GetBase(), true, Stats.NumTagsBefore, Stats.NumQwordsBefore))
+        return false;
+
+    Emit(dest, uiTerminator);
+    // the calls are the same ones, so they go as deep
+    if (source.uiCallDepth > dest.uiCallDepth)
+        dest.uiCallDepth = source.uiCallDepth;
+
+    Walk(dest.GetBase(), false, Stats.NumTagsAfter, Stats.NumQwordsAfter);
+
+    return true;
+}
+
+bool CDmaChainOptimizer::Walk(const void* firstTag, bool build, uint32_t& numTags, uint32_t& numQwords)
+{
+    // small refs are only worth copying if they can be merged with something
+    bool canInline = !bTTE || bVifChannel;
+
+    uint32_t tagAddr = DMAC::MakeTagAddr(firstTag);
+    CSoftDmac::tTagStep step;
+
+    numTags = numQwords = 0;
+
+    while (true) {
+        if (tagAddr & 0xf) {
+            pError = "tag address is not qword aligned";
+            return false;
+        }
+        if (++numTags > uiMaxTags) {
+            pError = "too many tags; the chain probably loops";
+            return false;
+        }
+
+        const tDmaTag& tag = *(const tDmaTag*)DMAC::GetTagPtr(tagAddr);
+        CSoftDmac::DecodeTag(tag, tagAddr, step);
+        numQwords += 1 + step.DataQWC;
+
+        if (step.DataQWC > 0 && (step.DataAddr & 0xf)) {
+            pError = "data address is not qword aligned";
+            return false;
+        }
+        const uint128_t* data = (const uint128_t*)DMAC::GetTagPtr(step.DataAddr);
+
+        if (build) {
+            switch (tag.ID) {
+            case DMAC::kCnt:
+            case DMAC::kNext:
+            case DMAC::kRet:
+            case DMAC::kEnd:
+                AddInline(tag, data, step.DataQWC);
+                break;
+            case DMAC::kRef:
+            case DMAC::kRefe:
+                if (canInline && !tag.SPR && tag.QWC <= uiMaxInlineRefQwords) {
+                    AddInline(tag, data, step.DataQWC);
+                    Stats.NumInlinedRefs++;
+                } else
+                    AddRef(tag);
+                break;
+            case DMAC::kRefs:
+                AddRef(tag);
+                break;
+            case DMAC::kCall:
+                AddCall(tag, data);
+                break;
+            }
+        }
+
+        if (step.Push) {
+            // carry on after the call's data; what it calls isn't touched
+            tagAddr = step.DataAddr + step.DataQWC * 16;
+            continue;
+        }
+        if (step.Pop) {
+            // (which ends the chain at this level)
+            uiTerminator = DMAC::kRet;
+            break;
+        }
+        if (step.Last) {
+            uiTerminator = DMAC::kEnd;
+            break;
+        }
+
+        tagAddr = step.NextTagAddr;
+    }
+
+    return true;
+}
+
+void CDmaChainOptimizer::StartItem(const tDmaTag& tag, uint32_t id, bool sealed)
+{
+    bool isRef = (id == DMAC::kRef || id == DMAC::kRefs || id == DMAC::kRefe);
+
+    // leave the data on either side of an interrupt where it was
+    if (tag.IRQ || tag.PCE || (!Items.empty() && (Items.back().IRQ || Items.back().PCE)))
+        iLastDirect = -1;
+
+    tItem item;
+    item.ID        = id;
+    item.IRQ       = tag.IRQ;
+    item.SPR       = isRef && tag.SPR;
+    item.PCE       = tag.PCE;
+    item.Addr      = tag.ADDR;
+    item.RefQWC    = tag.QWC;
+    item.TagQword  = OutData.size();
+    item.NumQwords = 0;
+    item.Sealed    = sealed;
+    Items.push_back(item);
+
+    uint128_t tagQword = 0;
+    if (bTTE) {
+        ((uint32_t*)&tagQword)[2] = tag.opt1;
+        ((uint32_t*)&tagQword)[3] = tag.opt2;
+    }
+    OutData.push_back(tagQword);
+
+    if (bTTE && bVifChannel) {
+        FeedWord(tag.opt1, item.TagQword * 4 + 2);
+        FeedWord(tag.opt2, item.TagQword * 4 + 3);
+    }
+}
+
+void CDmaChainOptimizer::AddInline(const tDmaTag& tag, const uint128_t* data, uint32_t numQwords)
+{
+    // an interrupt (or pce) belongs to a particular tag, so those stay put
+    bool barrier  = tag.IRQ || tag.PCE;
+    bool canMerge = !Items.empty() && !Items.back().Sealed && !barrier && (!bTTE || AtVifCodeBoundary());
+
+    if (canMerge) {
+        Stats.NumMergedTags++;
+        // the vifcodes in the tag become data, after two nops to keep them where they were
+        if (bTTE && (tag.opt1 || tag.opt2)) {
+            uint128_t vifCodes = 0;
+            ((uint32_t*)&vifCodes)[2] = tag.opt1;
+            ((uint32_t*)&vifCodes)[3] = tag.opt2;
+            AppendQword(vifCodes);
+        }
+    } else
+        StartItem(tag, DMAC::kCnt, barrier);
+
+    AppendData(data, numQwords);
+}
+
+void CDmaChainOptimizer::AddRef(const tDmaTag& tag)
+{
+    StartItem(tag, tag.ID, true);
+
+    if (bVifChannel) {
+        if (tag.SPR)
+            bStreamLost = true;
+        else
+            FeedExternal((const uint128_t*)DMAC::GetTagPtr(tag.ADDR), tag.QWC);
+    }
+}
+
+void CDmaChainOptimizer::AddCall(const tDmaTag& tag, const uint128_t* data)
+{
+    StartItem(tag, DMAC::kCall, true);
+    AppendData(data, tag.QWC);
+    FollowCall(tag.ADDR);
+}
+
+void CDmaChainOptimizer::AppendData(const uint128_t* data, uint32_t numQwords)
+{
+    while (numQwords > 0) {
+        // copy whatever can't be touched in one go
+        uint32_t numToCopy = 0;
+        if (!bVifChannel || bStreamLost)
+            numToCopy = numQwords;
+        else if (uiVifWordsLeft >= 4) {
+            numToCopy = uiVifWordsLeft / 4;
+            if (numToCopy > numQwords)
+                numToCopy = numQwords;
+            uiVifWordsLeft -= numToCopy * 4;
+        }
+
+        if (numToCopy > 0) {
+            OutData.insert(OutData.end(), data, data + numToCopy);
+            Items.back().NumQwords += numToCopy;
+            data += numToCopy;
+            numQwords -= numToCopy;
+        } else {
+            AppendQword(*data++);
+            numQwords--;
+        }
+    }
+}
+
+void CDmaChainOptimizer::AppendQword(const uint128_t& qword)
+{
+    const uint32_t* words = (const uint32_t*)&qword;
+
+    if (AtVifCodeBoundary()) {
+        // four nops
+        if ((words[0] | words[1] | words[2] | words[3]) == 0) {
+            Stats.NumDroppedNopQwords++;
+            return;
+        }
+
+        // nop nop nop direct, right after another direct's data: make the first one longer
+        uint32_t cmd = words[3] >> 24;
+        if ((words[0] | words[1] | words[2]) == 0 && iLastDirect >= 0
+            && (cmd == Vifs::Opcodes::direct || cmd == Vifs::Opcodes::directhl)) {
+            uint32_t& lastDirect = GetOutWords()[iLastDirect];
+            uint32_t numQuads    = words[3] & 0xffff;
+            uint32_t numLast     = lastDirect & 0xffff;
+            numQuads             = ((numQuads) ? numQuads : 65536) + ((numLast) ? numLast : 65536);
+
+            if ((lastDirect >> 24) == cmd && numQuads < 65536) {
+                lastDirect     = (lastDirect & 0xffff0000) | numQuads;
+                uiVifWordsLeft = Vifs::GetNumDataWords(words[3], uiWL, uiCL);
+                Stats.NumMergedDirects++;
+                return;
+            }
+        }
+    }
+
+    OutData.push_back(qword);
+    Items.back().NumQwords++;
+
+    if (bVifChannel) {
+        uint32_t firstWord = (OutData.size() - 1) * 4;
+        const uint32_t* outWords = GetOutWords() + firstWord;
+        for (uint32_t i = 0; i < 4; i++)
+            FeedWord(outWords[i], firstWord + i);
+    }
+}
+
+void CDmaChainOptimizer::FeedWord(uint32_t word, int outWord)
+{
+    if (bStreamLost)
+        return;
+
+    if (uiVifWordsLeft > 0) {
+        uiVifWordsLeft--;
+        return;
+    }
+
+    uint32_t cmd   = word >> 24;
+    uiVifWordsLeft = Vifs::GetNumDataWords(word, uiWL, uiCL);
+    if (uiVifWordsLeft == Vifs::kUnknownSize) {
+        bStreamLost    = true;
+        uiVifWordsLeft = 0;
+        iLastDirect    = -1;
+        return;
+    }
+
+    if ((cmd & 0x7f) == Vifs::Opcodes::stcycl) {
+        uiCL = word & 0xff;
+        uiWL = (word >> 8) & 0xff;
+    }
+
+    // a direct can only be extended if nothing at all goes to the vif between the
+    // end of its data and the next one (cmd includes the interrupt bit)
+    iLastDirect = (cmd == Vifs::Opcodes::direct || cmd == Vifs::Opcodes::directhl) ? outWord : -1;
+}
+
+void CDmaChainOptimizer::FeedExternal(const uint128_t* data, uint32_t numQwords)
+{
+    while (numQwords > 0 && !bStreamLost) {
+        if (uiVifWordsLeft >= 4) {
+            uint32_t numToSkip = uiVifWordsLeft / 4;
+            if (numToSkip > numQwords)
+                numToSkip = numQwords;
+            uiVifWordsLeft -= numToSkip * 4;
+            data += numToSkip;
+            numQwords -= numToSkip;
+        } else {
+            const uint32_t* words = (const uint32_t*)data++;
+            for (uint32_t i = 0; i < 4; i++)
+                FeedWord(words[i], -1);
+            numQwords--;
+        }
+    }
+}
+
+// follows the vif stream through a called chain
+void CDmaChainOptimizer::FollowCall(uint32_t chainAddr)
+{
+    if (!bVifChannel)
+        return;
+
+    uint32_t addrStack[DMAC::kMaxCallDepth];
+    uint32_t stackDepth = 0;
+    uint32_t tagAddr    = chainAddr;
+    uint32_t numTags    = 0;
+    CSoftDmac::tTagStep step;
+
+    while (!bStreamLost) {
+        if ((tagAddr & 0xf) || ++numTags > uiMaxTags) {
+            bStreamLost = true;
+            break;
+        }
+
+        const tDmaTag& tag = *(const tDmaTag*)DMAC::GetTagPtr(tagAddr);
+        CSoftDmac::DecodeTag(tag, tagAddr, step);
+
+        if (bTTE) {
+            FeedWord(tag.opt1, -1);
+            FeedWord(tag.opt2, -1);
+        }
+        if (step.DataFromSpr && step.DataQWC > 0) {
+            bStreamLost = true;
+            break;
+        }
+        FeedExternal((const uint128_t*)DMAC::GetTagPtr(step.DataAddr), step.DataQWC);
+
+        if (step.Push) {
+            if (stackDepth == DMAC::kMaxCallDepth) {
+                bStreamLost = true;
+                break;
+            }
+            addrStack[stackDepth++] = step.DataAddr + step.DataQWC * 16;
+        } else if (step.Pop) {
+            if (stackDepth == 0)
+                break;
+            step.NextTagAddr = addrStack[--stackDepth];
+        }
+
+        if (step.Last) {
+            // the called chain ends the whole transfer, so nothing after it matters
+            bStreamLost = true;
+            break;
+        }
+
+        tagAddr = step.NextTagAddr;
+    }
+}
+
+void CDmaChainOptimizer::Emit(CSCDmaPacket& dest, uint32_t terminator)
+{
+    // the chain has to end the same way the source did (a prebuilt chain ending
+    // in a ret still needs to be callable)
+    tItem& last = Items.back();
+    if (last.ID == DMAC::kCnt)
+        last.ID = terminator;
+    else if (last.ID == DMAC::kRef && terminator == DMAC::kEnd)
+        last.ID = DMAC::kRefe;
+    else if (last.ID != DMAC::kRefe) {
+        tDmaTag empty;
+        *(uint64_t*)&empty = 0;
+        empty.opt1 = empty.opt2 = 0;
+        StartItem(empty, terminator, true);
+    }
+
+    for (uint32_t i = 0; i < Items.size(); i++) {
+        const tItem& item = Items[i];
+        const void* addr  = DMAC::GetTagPtr(item.Addr);
+
+        switch (item.ID) {
+        case DMAC::kCnt:
+            dest.Cnt(item.IRQ, item.PCE);
+            break;
+        case DMAC::kRet:
+            dest.Ret(item.IRQ, item.PCE);
+            break;
+        case DMAC::kEnd:
+            dest.End(item.IRQ, item.PCE);
+            break;
+        case DMAC::kCall:
+            dest.Call(addr, item.IRQ, false, item.PCE);
+            break;
+        case DMAC::kRef:
+            dest.Ref(addr, item.RefQWC, item.IRQ, item.SPR, item.PCE);
+            break;
+        case DMAC::kRefs:
+            dest.Refs(addr, item.RefQWC, item.IRQ, item.SPR, item.PCE);
+            break;
+        case DMAC::kRefe:
+            dest.Refe(addr, item.RefQWC, item.IRQ, item.SPR, item.PCE);
+            break;
+        }
+
+        if (bTTE) {
+            const uint32_t* tagWords = (const uint32_t*)&OutData[item.TagQword];
+            dest += tagWords[2];
+            dest += tagWords[3];
+        }
+
+        if (dest.HasOpenTag()) {
+            if (item.NumQwords > 0)
+                dest.Add(&OutData[item.TagQword + 1], item.NumQwords);
+            dest.CloseTag();
+        }
+    }
+}
+
+void CDmaChainOptimizer::Print(void) const
+{
+    printf("dma chain optimized: %d tags -> %d, %d qwords -> %d\n",
+        Stats.NumTagsBefore, Stats.NumTagsAfter, Stats.NumQwordsBefore, Stats.NumQwordsAfter);
+    printf("  %d tags merged, %d refs inlined, %d nop qwords dropped, %d directs merged\n",
+        Stats.NumMergedTags, Stats.NumInlinedRefs, Stats.NumDroppedNopQwords, Stats.NumMergedDirects);
+}
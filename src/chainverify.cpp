@@ -0,0 +1,443 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <set>
+
+#include "ps2s/chainverify.h"
+#include "ps2s/debug.h"
+#include "ps2s/packet.h"
+#include "ps2s/softdmac.h"
+#include "ps2s/vif.h"
+
+/********************************************
+ * DmaChainVerifier
+ */
+
+// the dmac doesn't care about the memory mapping of an address, so neither do we
+static inline uint32_t
+NormalAddr(uint32_t addr)
+{
+#ifdef _EE
+    return addr & 0x0fffffff;
+#else
+    return addr;
+#endif
+}
+
+static const char* const IssueNames[CDmaChainVerifier::kNumIssueTypes] = {
+    "tag address not qword aligned",
+    "ref address not qword aligned",
+    "chain doesn't terminate",
+    "call with a full address stack",
+    "unreachable tag",
+    "qwc doesn't match the data",
+    "bad vifcode",
+    "chain ends inside a vifcode's data",
+    "DIRECT size doesn't match its gif tags",
+    "gif data doesn't end on a gif packet boundary"
+};
+
+CDmaChainVerifier::CDmaChainVerifier(void)
+    : uiMaxTags(1 << 20)
+{
+#ifdef _EE
+    pScratchpad = (const uint8_t*)0x70000000;
+#else
+    pScratchpad = NULL;
+#endif
+
+    Reset();
+}
+
+void CDmaChainVerifier::Reset(void)
+{
+    Visited.clear();
+    RefData.clear();
+    Issues.clear();
+
+    uiCurTagAddr = 0;
+    uiNumTags    = 0;
+    for (uint32_t i = 0; i < kNumDests; i++)
+        NumBytes[i] = 0;
+
+    bStreamLost    = false;
+    uiVifWordsLeft = 0;
+    VifDataDest    = kDestVif;
+    bInDirect      = false;
+    uiWL = uiCL = 1;
+
+    uiGifTagWord   = 0;
+    uiGifWordsLeft = 0;
+}
+
+void CDmaChainVerifier::AddRegion(const void* start, uint32_t numBytes)
+{
+    tRegion region;
+    region.Start = NormalAddr(DMAC::MakeTagAddr(start));
+    region.End   = region.Start + numBytes;
+    Regions.push_back(region);
+}
+
+const char*
+CDmaChainVerifier::GetIssueName(tIssueType type)
+{
+    mAssert(type < kNumIssueTypes);
+    return IssueNames[type];
+}
+
+void CDmaChainVerifier::AddIssue(tIssueType type, uint32_t value)
+{
+    tIssue issue;
+    issue.Type    = type;
+    issue.TagAddr = uiCurTagAddr;
+    issue.Value   = value;
+    Issues.push_back(issue);
+}
+
+int CDmaChainVerifier::FindRegion(uint32_t addr) const
+{
+    for (uint32_t i = 0; i < Regions.size(); i++)
+        if (Regions[i].Start <= addr && addr < Regions[i].End)
+            return i;
+    return -1;
+}
+
+const uint8_t*
+CDmaChainVerifier::GetDataPtr(uint32_t addr, bool fromSpr) const
+{
+    if (fromSpr)
+        return (pScratchpad) ? pScratchpad + (addr & (16 * 1024 - 16)) : NULL;
+    else
+        return (const uint8_t*)DMAC::GetTagPtr(addr & ~0xf);
+}
+
+bool CDmaChainVerifier::Verify(const CSCDmaPacket& packet)
+{
+    ClearRegions();
+    for (uint32_t i = 0; i < packet.GetNumChunks(); i++)
+        AddRegion(packet.GetChunk(i), packet.GetChunkByteLength(i));
+
+    return Verify(packet.GetDmaChannel(), packet.GetBase(), packet.GetTTE());
+}
+
+// the complete state of the dmac between tags; seeing one twice means the chain loops
+typedef struct tWalkState_t {
+    uint32_t TagAddr, StackDepth, Stack[DMAC::kMaxCallDepth];
+
+    bool operator<(const tWalkState_t& rhs) const
+    {
+        return memcmp(this, &rhs, sizeof(*this)) < 0;
+    }
+} tWalkState;
+
+bool CDmaChainVerifier::Verify(tDmaChannelId channel, const void* firstTag, bool tte)
+{
+    Reset();
+    dmaChannelId = channel;
+
+    std::set<tWalkState> seen;
+    tWalkState state;
+    memset(&state, 0, sizeof(state));
+    state.TagAddr = DMAC::MakeTagAddr(firstTag);
+
+    CSoftDmac::tTagStep step;
+
+    while (true) {
+        uint32_t tagAddr = state.TagAddr;
+        uiCurTagAddr     = tagAddr;
+
+        if (tagAddr & 0xf) {
+            AddIssue(kTagMisaligned, tagAddr);
+            break;
+        }
+        if (++uiNumTags > uiMaxTags || !seen.insert(state).second) {
+            AddIssue(kUnterminated, tagAddr);
+            break;
+        }
+
+        int region = FindRegion(NormalAddr(tagAddr));
+        if (region < 0) {
+            // walking off the end of a region means the last tag didn't stop the chain
+            bool pastEnd = false;
+            for (uint32_t i = 0; i < Regions.size(); i++)
+                pastEnd |= (Regions[i].End == NormalAddr(tagAddr));
+            if (pastEnd) {
+                AddIssue(kUnterminated, tagAddr);
+                break;
+            }
+        } else
+            Visited.push_back(NormalAddr(tagAddr));
+
+        const tDmaTag* tag = (const tDmaTag*)DMAC::GetTagPtr(tagAddr);
+        CSoftDmac::DecodeTag(*tag, tagAddr, step);
+
+        bool isRef = (tag->ID == DMAC::kRef || tag->ID == DMAC::kRefs || tag->ID == DMAC::kRefe);
+        if (isRef && (step.DataAddr & 0xf))
+            AddIssue(kRefMisaligned, step.DataAddr);
+        if (isRef && !step.DataFromSpr && step.DataQWC > 0) {
+            tRegion data;
+            data.Start = NormalAddr(step.DataAddr) & ~0xf;
+            data.End   = data.Start + step.DataQWC * 16;
+            RefData.push_back(data);
+        }
+        if (!isRef && region >= 0 && NormalAddr(step.DataAddr) + step.DataQWC * 16 > Regions[region].End) {
+            AddIssue(kQWCMismatch, tag->QWC);
+            break;
+        }
+
+        if (tte)
+            Feed((const uint8_t*)tag + 8, 2, 2);
+        Feed(GetDataPtr(step.DataAddr, step.DataFromSpr), step.DataQWC * 4, 0);
+
+        if (step.Push) {
+            if (state.StackDepth == DMAC::kMaxCallDepth) {
+                AddIssue(kStackOverflow, step.NextTagAddr);
+                break;
+            }
+            state.Stack[state.StackDepth++] = step.DataAddr + step.DataQWC * 16;
+        } else if (step.Pop) {
+            // a ret with nothing on the stack ends the transfer
+            if (state.StackDepth == 0)
+                break;
+            step.NextTagAddr                = state.Stack[--state.StackDepth];
+            state.Stack[state.StackDepth] = 0;
+        }
+
+        if (step.Last)
+            break;
+
+        state.TagAddr = step.NextTagAddr;
+    }
+
+    FinishStreams();
+    // if the walk was cut short everything after would show up as unreachable
+    if (Issues.empty())
+        ScanRegions();
+
+    return Issues.empty();
+}
+
+// the end of the ref'd data that addr is in, or addr if it isn't in any
+uint32_t
+CDmaChainVerifier::SkipRefData(uint32_t addr) const
+{
+    // (RefData is sorted and merged)
+    tRegion key;
+    key.Start = addr;
+    std::vector<tRegion>::const_iterator next = std::upper_bound(RefData.begin(), RefData.end(), key, StartsBefore);
+    if (next != RefData.begin() && addr < (next - 1)->End)
+        return (next - 1)->End;
+    return addr;
+}
+
+void CDmaChainVerifier::ScanRegions(void)
+{
+    std::sort(Visited.begin(), Visited.end());
+
+    // merge the ref'd data into separate ranges
+    std::sort(RefData.begin(), RefData.end(), StartsBefore);
+    uint32_t numMerged = 0;
+    for (uint32_t i = 0; i < RefData.size(); i++) {
+        if (numMerged > 0 && RefData[i].Start <= RefData[numMerged - 1].End)
+            RefData[numMerged - 1].End = std::max(RefData[numMerged - 1].End, RefData[i].End);
+        else
+            RefData[numMerged++] = RefData[i];
+    }
+    RefData.resize(numMerged);
+
+    for (uint32_t i = 0; i < Regions.size(); i++) {
+        // walk the region tag by tag as laid out in memory, stepping over the data
+        // that refs point at (a packet can keep its own data to ref)
+        std::vector<uint32_t> tags;
+        uint32_t addr = Regions[i].Start;
+        while (addr < Regions[i].End) {
+            uint32_t dataEnd = SkipRefData(addr);
+            if (dataEnd != addr) {
+                addr = dataEnd;
+                continue;
+            }
+            uiCurTagAddr = addr;
+            tags.push_back(addr);
+
+            if (!std::binary_search(Visited.begin(), Visited.end(), addr))
+                AddIssue(kUnreachable, addr);
+
+            const tDmaTag* tag = (const tDmaTag*)DMAC::GetTagPtr(addr);
+            bool isRef         = (tag->ID == DMAC::kRef || tag->ID == DMAC::kRefs || tag->ID == DMAC::kRefe);
+            uint32_t size      = 16 + ((isRef) ? 0 : tag->QWC * 16);
+            if (addr + size > Regions[i].End) {
+                AddIssue(kQWCMismatch, tag->QWC);
+                break;
+            }
+            addr += size;
+        }
+
+        // any tag the chain went to that isn't one of these is really someone's data
+        for (uint32_t v = 0; v < Visited.size(); v++) {
+            uint32_t visited = Visited[v];
+            if (Regions[i].Start <= visited && visited < Regions[i].End
+                && !std::binary_search(tags.begin(), tags.end(), visited)) {
+                uiCurTagAddr = visited;
+                AddIssue(kQWCMismatch, visited);
+            }
+        }
+    }
+}
+
+// stream checking
+
+void CDmaChainVerifier::Feed(const uint8_t* data, uint32_t numWords, uint32_t firstWordPos)
+{
+    // without the data we can't follow the vifcodes or gif tags any more
+    if (data == NULL && (dmaChannelId == DMAC::Channels::vif0
+                            || dmaChannelId == DMAC::Channels::vif1
+                            || dmaChannelId == DMAC::Channels::gif))
+        bStreamLost = true;
+
+    const uint32_t* words = (const uint32_t*)data;
+    for (uint32_t i = 0; i < numWords; i++) {
+        if (bStreamLost) {
+            NumBytes[kDestOther] += 4;
+            continue;
+        }
+
+        if (dmaChannelId == DMAC::Channels::vif0 || dmaChannelId == DMAC::Channels::vif1)
+            FeedVifWord(words[i], (firstWordPos + i) & 3);
+        else if (dmaChannelId == DMAC::Channels::gif)
+            FeedGifWord(words[i]);
+        else
+            NumBytes[kDestOther] += 4;
+    }
+}
+
+void CDmaChainVerifier::FeedVifWord(uint32_t word, uint32_t wordPos)
+{
+    if (uiVifWordsLeft > 0) {
+        uiVifWordsLeft--;
+        if (bInDirect)
+            FeedGifWord(word);
+        else
+            NumBytes[VifDataDest] += 4;
+        return;
+    }
+
+    // a vifcode
+    NumBytes[kDestVif] += 4;
+    VifDataDest = kDestVif;
+
+    uint32_t cmd = (word >> 24) & 0x7f;
+    uint32_t imm = word & 0xffff;
+
+    // a gif packet can be split across DIRECTs (with nops in between), but nothing else
+    if (cmd != Vifs::Opcodes::nop && cmd != Vifs::Opcodes::direct && cmd != Vifs::Opcodes::directhl)
+        CheckGifBoundary(kDirectMismatch);
+    bInDirect = false;
+
+    uiVifWordsLeft = Vifs::GetNumDataWords(word, uiWL, uiCL);
+    if (uiVifWordsLeft == Vifs::kUnknownSize) {
+        // no way to know how much data follows, so stop here
+        AddIssue(kBadVifCode, word);
+        uiVifWordsLeft = 0;
+        bStreamLost    = true;
+        return;
+    }
+
+    if ((cmd & 0x60) == 0x60) {
+        VifDataDest = kDestVuData;
+        return;
+    }
+
+    switch (cmd) {
+    case Vifs::Opcodes::stcycl:
+        uiCL = imm & 0xff;
+        uiWL = (imm >> 8) & 0xff;
+        break;
+    case Vifs::Opcodes::mpg:
+        // microcode has to start on a dword boundary
+        if ((wordPos & 1) == 0)
+            AddIssue(kBadVifCode, word);
+        VifDataDest = kDestVuCode;
+        break;
+    case Vifs::Opcodes::direct:
+    case Vifs::Opcodes::directhl:
+        // gif data has to start on a qword boundary
+        if (wordPos != 3)
+            AddIssue(kBadVifCode, word);
+        bInDirect = true;
+        break;
+    }
+}
+
+void CDmaChainVerifier::FeedGifWord(uint32_t word)
+{
+    NumBytes[kDestGs] += 4;
+
+    if (uiGifWordsLeft > 0) {
+        uiGifWordsLeft--;
+        return;
+    }
+
+    GifTagWords[uiGifTagWord++] = word;
+    if (uiGifTagWord < 4)
+        return;
+    uiGifTagWord = 0;
+
+    uint32_t nloop = GifTagWords[0] & 0x7fff;
+    uint32_t flg   = (GifTagWords[1] >> 26) & 0x3;
+    uint32_t nreg  = (GifTagWords[1] >> 28) & 0xf;
+    if (nreg == 0)
+        nreg = 16;
+
+    uint32_t numQwords;
+    if (flg == 0) // packed
+        numQwords = nloop * nreg;
+    else if (flg == 1) // reglist (two regs per qword)
+        numQwords = (nloop * nreg + 1) / 2;
+    else // image
+        numQwords = nloop;
+
+    uiGifWordsLeft = numQwords * 4;
+}
+
+void CDmaChainVerifier::CheckGifBoundary(tIssueType type)
+{
+    if (uiGifTagWord != 0 || uiGifWordsLeft != 0) {
+        AddIssue(type, uiGifWordsLeft / 4);
+        uiGifTagWord   = 0;
+        uiGifWordsLeft = 0;
+    }
+}
+
+void CDmaChainVerifier::FinishStreams(void)
+{
+    if (bStreamLost)
+        return;
+
+    if (dmaChannelId == DMAC::Channels::vif0 || dmaChannelId == DMAC::Channels::vif1) {
+        if (uiVifWordsLeft > 0)
+            AddIssue(kVifTruncated, uiVifWordsLeft);
+        CheckGifBoundary(kDirectMismatch);
+    } else if (dmaChannelId == DMAC::Channels::gif)
+        CheckGifBoundary(kGifMismatch);
+}
+
+void CDmaChainVerifier::Print(void) const
+{
+    printf("dma chain: %d tags, %d gs qwords, %d vu data qwords, %d vu code qwords, %d vif qwords, %d other qwords\n",
+        uiNumTags, GetNumQwords(kDestGs), GetNumQwords(kDestVuData), GetNumQwords(kDestVuCode),
+        GetNumQwords(kDestVif), GetNumQwords(kDestOther));
+
+    for (uint32_t i = 0; i < Issues.size(); i++)
+        printf("  tag 0x%08x: %s (0x%x)\n", Issues[i].TagAddr, GetIssueName(Issues[i].Type), Issues[i].Value);
+}
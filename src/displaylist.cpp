@@ -0,0 +1,129 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <string.h>
+
+#include "ps2s/debug.h"
+#include "ps2s/displaylist.h"
+#include "ps2s/gs.h"
+#include "ps2s/packet.h"
+
+/********************************************
+ * VifDisplayList
+ */
+
+// limited by the NLOOP field
+static const uint32_t kMaxGsRegs = (1 << 15) - 1;
+
+CVifDisplayList::CVifDisplayList(CVifSCDmaPacket& packet)
+    : Packet(packet)
+    , uiNumBytesPatched(0)
+{
+}
+
+CVifDisplayList::tSlot
+CVifDisplayList::AddSlot(const char* name, void* data, uint32_t numElems, uint32_t elemBytes, uint32_t stride)
+{
+    tSlotDef slot = { name, (uint8_t*)data, numElems, elemBytes, stride };
+    Slots.push_back(slot);
+    return Slots.size() - 1;
+}
+
+CVifDisplayList::tSlot
+CVifDisplayList::Strow(const void* row, const char* name)
+{
+    // (Strow() keeps the vifcode and its data in one chunk)
+    Packet.Strow(row);
+    return AddSlot(name, Packet.GetNextPtr() - 16, 1, 16, 16);
+}
+
+CVifDisplayList::tSlot
+CVifDisplayList::Unpack(uint32_t mode, uint32_t vuAddr, const void* data, uint32_t numBytes,
+    const char* name, bool dblBuffered)
+{
+    mErrorIf(numBytes == 0 || (numBytes & 3), "Unpack data is a whole number of words.");
+
+    // a slot has to be in one piece, so don't let the unpack be split across chunks
+    Packet.EnsureRoom(4 + numBytes);
+    Packet.OpenUnpack(mode, vuAddr, dblBuffered);
+    uint32_t* slotData = Packet.Add((const uint32_t*)data, numBytes / 4);
+    Packet.CloseUnpack();
+
+    return AddSlot(name, slotData, 1, numBytes, numBytes);
+}
+
+CVifDisplayList::tSlot
+CVifDisplayList::GsRegs(const uint32_t* regAddrs, const uint64_t* values, uint32_t numRegs, const char* name)
+{
+    mErrorIf(numRegs == 0 || numRegs > kMaxGsRegs, "A slot has 1 to %d registers.", kMaxGsRegs);
+
+    tGifTag gifTag = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    gifTag.NLOOP   = numRegs;
+    gifTag.EOP     = 1;
+    gifTag.FLG     = 0; // packed
+    gifTag.NREG    = 1;
+    gifTag.REGS0   = 0xe; // a+d
+
+    // padding and the DIRECT, the giftag, the registers
+    Packet.EnsureRoom(16 + 16 + numRegs * 16);
+    Packet.OpenDirect();
+    Packet += gifTag;
+    uint8_t* slotData = Packet.GetNextPtr();
+    for (uint32_t i = 0; i < numRegs; i++) {
+        Packet += values[i];
+        Packet += (uint64_t)regAddrs[i];
+    }
+    Packet.CloseDirect();
+
+    return AddSlot(name, slotData, numRegs, 8, 16);
+}
+
+CVifDisplayList::tSlot
+CVifDisplayList::FindSlot(const char* name) const
+{
+    for (uint32_t i = 0; i < Slots.size(); i++)
+        if (Slots[i].Name && strcmp(Slots[i].Name, name) == 0)
+            return i;
+    return kNoSlot;
+}
+
+void CVifDisplayList::Patch(tSlot slot, const void* data)
+{
+    mErrorIf(slot >= Slots.size(), "There's no slot %d.", slot);
+    LastSend.Wait();
+
+    const tSlotDef& def  = Slots[slot];
+    const uint8_t* bytes = (const uint8_t*)data;
+    if (def.Stride == def.ElemBytes)
+        memcpy(def.Data, bytes, def.NumElems * def.ElemBytes);
+    else {
+        for (uint32_t i = 0; i < def.NumElems; i++)
+            memcpy(def.Data + i * def.Stride, bytes + i * def.ElemBytes, def.ElemBytes);
+    }
+    uiNumBytesPatched += def.NumElems * def.ElemBytes;
+}
+
+void CVifDisplayList::PatchGsReg(tSlot slot, uint32_t reg, uint64_t value)
+{
+    mErrorIf(slot >= Slots.size(), "There's no slot %d.", slot);
+    const tSlotDef& def = Slots[slot];
+    mErrorIf(def.Stride == def.ElemBytes || reg >= def.NumElems, "Slot %d doesn't have register %d.", slot, reg);
+    LastSend.Wait();
+
+    *(uint64_t*)(def.Data + reg * def.Stride) = value;
+    uiNumBytesPatched += 8;
+}
+
+void* CVifDisplayList::GetSlotPtr(tSlot slot)
+{
+    mErrorIf(slot >= Slots.size(), "There's no slot %d.", slot);
+    LastSend.Wait();
+    return Slots[slot].Data;
+}
@@ -0,0 +1,64 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include "dma.h"
+#include "kernel.h"
+
+#include "ps2s/debug.h"
+#include "ps2s/dmabackend.h"
+
+/********************************************
+ * EEDmaBackend
+ */
+
+// D_CHCR of each channel, in DMAC::Channels order
+static volatile uint32_t* const ChannelChcrs[] = {
+    (volatile uint32_t*)0x10008000, // vif0
+    (volatile uint32_t*)0x10009000, // vif1
+    (volatile uint32_t*)0x1000a000, // gif
+    (volatile uint32_t*)0x1000b000, // fromIpu
+    (volatile uint32_t*)0x1000b400, // toIpu
+    (volatile uint32_t*)0x1000c000, // sif0
+    (volatile uint32_t*)0x1000c400, // sif1
+    (volatile uint32_t*)0x1000c800, // sif2
+    (volatile uint32_t*)0x1000d000, // fromSpr
+    (volatile uint32_t*)0x1000d400  // toSpr
+};
+
+// clear any memory mappings (this won't work for sp)
+#define mMakeDmaPtr(__ptr) ((void*)((uint32_t)(__ptr)&0x0fffffff))
+
+void CEEDmaBackend::SendNormal(tDmaChannelId channel, const void* data, uint32_t numQwords)
+{
+    dma_channel_send_normal(channel, mMakeDmaPtr(data), numQwords, 0, 0);
+}
+
+void CEEDmaBackend::SendChain(tDmaChannelId channel, const void* firstTag, bool tte)
+{
+    dma_channel_send_chain(channel, mMakeDmaPtr(firstTag), 0, tte ? DMA_FLAG_TRANSFERTAG : 0, 0);
+}
+
+#undef mMakeDmaPtr
+
+void CEEDmaBackend::Wait(tDmaChannelId channel)
+{
+    dma_channel_wait(channel, 1000000);
+}
+
+bool CEEDmaBackend::IsBusy(tDmaChannelId channel)
+{
+    // CHCR.STR
+    return (*ChannelChcrs[channel] & 0x100) != 0;
+}
+
+void CEEDmaBackend::FlushCache(void)
+{
+    ::FlushCache(0);
+}
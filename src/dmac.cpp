@@ -0,0 +1,46 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdlib.h>
+
+#include "ps2s/dmabackend.h"
+#include "ps2s/dmac.h"
+#ifndef _EE
+#include "ps2s/softdmac.h"
+#endif
+
+/********************************************
+ * DMAC
+ */
+
+#ifndef _EE
+uintptr_t DMAC::AddrBase = 0;
+#endif
+
+/********************************************
+ * DmaBackend
+ */
+
+// off-console the default is a soft dmac with no sinks, which walks the chains
+// (and catches bad ones) but drops the data
+#ifdef _EE
+static CEEDmaBackend EEDmaBackend;
+static CDmaBackend* const DefaultBackend = &EEDmaBackend;
+#else
+static CSoftDmac SoftDmacBackend;
+static CDmaBackend* const DefaultBackend = &SoftDmacBackend;
+#endif
+
+CDmaBackend* CDmaBackend::pCurrent = DefaultBackend;
+
+void CDmaBackend::Set(CDmaBackend* backend)
+{
+    pCurrent = (backend) ? backend : DefaultBackend;
+}
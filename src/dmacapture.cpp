@@ -0,0 +1,528 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "ps2s/debug.h"
+#include "ps2s/dmacapture.h"
+#include "ps2s/softdmac.h"
+
+using namespace DmaCapture;
+
+static const uint32_t kScratchpadSize = 16 * 1024;
+
+// the dmac doesn't care about the memory mapping of an address, so neither do we
+static inline uint32_t
+NormalAddr(uint32_t addr)
+{
+#ifdef _EE
+    return addr & 0x0fffffff;
+#else
+    return addr;
+#endif
+}
+
+// the tags whose address field has to be relocated
+static inline bool
+HasAddr(const tDmaTag& tag)
+{
+    switch (tag.ID) {
+    case DMAC::kNext:
+    case DMAC::kCall:
+        return true;
+    case DMAC::kRef:
+    case DMAC::kRefs:
+    case DMAC::kRefe:
+        // nothing was captured for an empty ref
+        return tag.QWC > 0;
+    default:
+        return false;
+    }
+}
+
+static inline bool
+IsSprRef(const tDmaTag& tag)
+{
+    return tag.SPR && (tag.ID == DMAC::kRef || tag.ID == DMAC::kRefs || tag.ID == DMAC::kRefe);
+}
+
+// finds the segment of a record's (sorted) segments holding addr
+static const tSegment*
+FindSegment(const tSegment* segments, uint32_t numSegments, uint32_t addr, bool spr)
+{
+    uint32_t first = 0, last = numSegments;
+    while (first < last) {
+        uint32_t mid        = (first + last) / 2;
+        const tSegment& seg = segments[mid];
+        bool segSpr         = seg.Flags & kSegmentSpr;
+        bool before         = (segSpr != spr) ? spr : seg.OrigAddr + seg.NumBytes <= addr;
+        bool after          = (segSpr != spr) ? segSpr : addr < seg.OrigAddr;
+        if (before)
+            first = mid + 1;
+        else if (after)
+            last = mid;
+        else
+            return &seg;
+    }
+    return NULL;
+}
+
+/********************************************
+ * DmaCapture
+ */
+
+CDmaCapture::CDmaCapture(CDmaBackend* target)
+    : pTarget(target)
+    , uiMaxTags(1 << 20)
+    , pError(NULL)
+{
+#ifdef _EE
+    pScratchpad = (const uint8_t*)0x70000000;
+#else
+    pScratchpad = NULL;
+#endif
+}
+
+void CDmaCapture::SendNormal(tDmaChannelId channel, const void* data, uint32_t numQwords)
+{
+    AddNormal(channel, data, numQwords);
+    if (pTarget)
+        pTarget->SendNormal(channel, data, numQwords);
+}
+
+void CDmaCapture::SendChain(tDmaChannelId channel, const void* firstTag, bool tte)
+{
+    // a chain that can't be captured still gets sent; it's the target's problem
+    AddChain(channel, firstTag, tte);
+    if (pTarget)
+        pTarget->SendChain(channel, firstTag, tte);
+}
+
+void CDmaCapture::Wait(tDmaChannelId channel)
+{
+    if (pTarget)
+        pTarget->Wait(channel);
+}
+
+bool CDmaCapture::IsBusy(tDmaChannelId channel)
+{
+    return (pTarget) ? pTarget->IsBusy(channel) : false;
+}
+
+void CDmaCapture::FlushCache(void)
+{
+    if (pTarget)
+        pTarget->FlushCache();
+}
+
+void CDmaCapture::Clear(void)
+{
+    Records.clear();
+    Segments.clear();
+    Fixups.clear();
+    Payload.clear();
+    pError = NULL;
+}
+
+const uint8_t*
+CDmaCapture::GetMemPtr(uint32_t addr, bool spr) const
+{
+    if (spr)
+        return pScratchpad + addr;
+    else
+        return (const uint8_t*)DMAC::GetTagPtr(addr);
+}
+
+void CDmaCapture::AddSegments(std::vector<tRange>& ranges, tRecord& record)
+{
+    std::sort(ranges.begin(), ranges.end());
+
+    record.FirstSegment = Segments.size();
+
+    for (uint32_t i = 0; i < ranges.size();) {
+        // merge everything that overlaps or touches, so that the memory after a
+        // tag (cnt data, the tag after a call's data..) stays where the dmac expects it
+        tRange merged = ranges[i++];
+        while (i < ranges.size() && ranges[i].Spr == merged.Spr && ranges[i].Start <= merged.End) {
+            merged.End = std::max(merged.End, ranges[i].End);
+            i++;
+        }
+
+        tSegment seg;
+        seg.OrigAddr      = merged.Start;
+        seg.NumBytes      = merged.End - merged.Start;
+        seg.PayloadOffset = Payload.size();
+        seg.Flags         = (merged.Spr) ? kSegmentSpr : 0;
+        Segments.push_back(seg);
+
+        const uint8_t* mem = GetMemPtr(merged.Start, merged.Spr);
+        Payload.insert(Payload.end(), mem, mem + seg.NumBytes);
+    }
+
+    record.NumSegments = Segments.size() - record.FirstSegment;
+}
+
+uint32_t
+CDmaCapture::FindPayloadOffset(const tRecord& record, uint32_t addr, bool spr) const
+{
+    const tSegment* seg = FindSegment(&Segments[record.FirstSegment], record.NumSegments, addr, spr);
+    mAssert(seg != NULL);
+    return seg->PayloadOffset + (addr - seg->OrigAddr);
+}
+
+void CDmaCapture::AddNormal(tDmaChannelId channel, const void* data, uint32_t numQwords)
+{
+    tRecord record;
+    memset(&record, 0, sizeof(record));
+    record.Type       = kRecordNormal;
+    record.Channel    = channel;
+    record.NumQwords  = numQwords;
+    record.FirstFixup = Fixups.size();
+
+    std::vector<tRange> ranges;
+    if (numQwords > 0) {
+        tRange range;
+        range.Start = NormalAddr(DMAC::MakeTagAddr(data));
+        range.End   = range.Start + numQwords * 16;
+        range.Spr   = false;
+        ranges.push_back(range);
+    }
+    AddSegments(ranges, record);
+    record.Start = (numQwords > 0) ? Segments[record.FirstSegment].PayloadOffset : 0;
+
+    Records.push_back(record);
+}
+
+bool CDmaCapture::AddChain(tDmaChannelId channel, const void* firstTag, bool tte)
+{
+    std::vector<tRange> ranges;
+    std::vector<uint32_t> fixupTags;
+
+    uint32_t addrStack[DMAC::kMaxCallDepth];
+    uint32_t stackDepth   = 0;
+    uint32_t firstTagAddr = NormalAddr(DMAC::MakeTagAddr(firstTag));
+    uint32_t tagAddr      = firstTagAddr;
+    uint32_t numTags      = 0;
+    CSoftDmac::tTagStep step;
+
+    pError = NULL;
+
+    // walk the chain the way CSoftDmac does, noting everything it reads
+    while (true) {
+        if (tagAddr & 0xf) {
+            pError = "tag address is not qword aligned";
+            return false;
+        }
+        if (++numTags > uiMaxTags) {
+            pError = "too many tags; the chain probably loops";
+            return false;
+        }
+
+        const tDmaTag* tag = (const tDmaTag*)GetMemPtr(tagAddr, false);
+        CSoftDmac::DecodeTag(*tag, tagAddr, step);
+
+        tRange range;
+        range.Start = tagAddr;
+        range.End   = tagAddr + 16;
+        range.Spr   = false;
+        ranges.push_back(range);
+
+        if (HasAddr(*tag))
+            fixupTags.push_back(tagAddr);
+
+        if (step.DataQWC > 0) {
+            range.Spr   = step.DataFromSpr;
+            range.Start = (range.Spr) ? step.DataAddr & (kScratchpadSize - 16) : NormalAddr(step.DataAddr);
+            range.End   = range.Start + step.DataQWC * 16;
+            if (step.DataAddr & 0xf) {
+                pError = "data address is not qword aligned";
+                return false;
+            }
+            if (range.Spr && (range.End > kScratchpadSize || pScratchpad == NULL)) {
+                pError = "can't capture that scratchpad ref";
+                return false;
+            }
+            ranges.push_back(range);
+        }
+
+        if (step.Push) {
+            if (stackDepth == DMAC::kMaxCallDepth) {
+                pError = "call with a full address stack";
+                return false;
+            }
+            addrStack[stackDepth++] = step.DataAddr + step.DataQWC * 16;
+        } else if (step.Pop) {
+            if (stackDepth == 0)
+                break;
+            step.NextTagAddr = addrStack[--stackDepth];
+        }
+
+        if (step.Last)
+            break;
+
+        tagAddr = NormalAddr(step.NextTagAddr);
+    }
+
+    tRecord record;
+    memset(&record, 0, sizeof(record));
+    record.Type    = kRecordChain;
+    record.Channel = channel;
+    record.TTE     = tte;
+
+    AddSegments(ranges, record);
+    record.Start = FindPayloadOffset(record, firstTagAddr, false);
+
+    // a tag that's visited more than once (a sub-chain called twice) only needs fixing once
+    std::sort(fixupTags.begin(), fixupTags.end());
+    fixupTags.erase(std::unique(fixupTags.begin(), fixupTags.end()), fixupTags.end());
+
+    record.FirstFixup = Fixups.size();
+    for (uint32_t i = 0; i < fixupTags.size(); i++)
+        Fixups.push_back(FindPayloadOffset(record, fixupTags[i], false));
+    record.NumFixups = fixupTags.size();
+
+    Records.push_back(record);
+    return true;
+}
+
+bool CDmaCapture::Write(const char* fileName)
+{
+    tHeader header;
+    memset(&header, 0, sizeof(header));
+    header.Magic          = kMagic;
+    header.Version        = kVersion;
+    header.NumRecords     = Records.size();
+    header.RecordsOffset  = sizeof(header);
+    header.NumSegments    = Segments.size();
+    header.SegmentsOffset = header.RecordsOffset + Records.size() * sizeof(tRecord);
+    header.NumFixups      = Fixups.size();
+    header.FixupsOffset   = header.SegmentsOffset + Segments.size() * sizeof(tSegment);
+    header.PayloadOffset  = (header.FixupsOffset + Fixups.size() * sizeof(uint32_t) + 15) & ~15;
+    header.PayloadSize    = Payload.size();
+    header.FileSize       = header.PayloadOffset + header.PayloadSize;
+
+    FILE* file = fopen(fileName, "wb");
+    if (file == NULL) {
+        pError = "couldn't open the capture file";
+        return false;
+    }
+
+    static const uint8_t zeros[16] = { 0 };
+    uint32_t padding               = header.PayloadOffset - (header.FixupsOffset + Fixups.size() * sizeof(uint32_t));
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (!Records.empty())
+        ok = ok && fwrite(&Records[0], sizeof(tRecord), Records.size(), file) == Records.size();
+    if (!Segments.empty())
+        ok = ok && fwrite(&Segments[0], sizeof(tSegment), Segments.size(), file) == Segments.size();
+    if (!Fixups.empty())
+        ok = ok && fwrite(&Fixups[0], sizeof(uint32_t), Fixups.size(), file) == Fixups.size();
+    if (padding > 0)
+        ok = ok && fwrite(zeros, 1, padding, file) == padding;
+    if (!Payload.empty())
+        ok = ok && fwrite(&Payload[0], 1, Payload.size(), file) == Payload.size();
+
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+        pError = "couldn't write the capture file";
+
+    return ok;
+}
+
+/********************************************
+ * DmaReplay
+ */
+
+CDmaReplay::CDmaReplay(void)
+    : pImage(NULL)
+    , uiImageSize(0)
+    , bOwnsImage(false)
+    , pHeader(NULL)
+    , pPayload(NULL)
+    , pError(NULL)
+{
+}
+
+void CDmaReplay::Release(void)
+{
+    if (bOwnsImage)
+        free(pImage);
+    pImage      = NULL;
+    uiImageSize = 0;
+    bOwnsImage  = false;
+    pHeader     = NULL;
+    pPayload    = NULL;
+}
+
+const tRecord&
+CDmaReplay::GetRecord(uint32_t record) const
+{
+    mAssert(pHeader != NULL && record < pHeader->NumRecords);
+    return ((const tRecord*)(pImage + pHeader->RecordsOffset))[record];
+}
+
+const tSegment&
+CDmaReplay::GetSegmentInfo(uint32_t record, uint32_t segment) const
+{
+    const tRecord& rec = GetRecord(record);
+    mAssert(segment < rec.NumSegments);
+    return ((const tSegment*)(pImage + pHeader->SegmentsOffset))[rec.FirstSegment + segment];
+}
+
+bool CDmaReplay::Load(const char* fileName)
+{
+    Release();
+
+    FILE* file = fopen(fileName, "rb");
+    if (file == NULL) {
+        pError = "couldn't open the capture file";
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t* image = (size > 0) ? (uint8_t*)memalign(16, size) : NULL;
+    bool ok        = image && fread(image, 1, size, file) == (size_t)size;
+    fclose(file);
+
+    if (!ok) {
+        free(image);
+        pError = "couldn't read the capture file";
+        return false;
+    }
+
+    if (!Attach(image, size)) {
+        free(image);
+        return false;
+    }
+    bOwnsImage = true;
+    return true;
+}
+
+bool CDmaReplay::Attach(void* image, uint32_t numBytes)
+{
+    Release();
+    pError = NULL;
+
+    const tHeader* header = (const tHeader*)image;
+
+    // don't trust anything in the file
+    if ((uintptr_t)image & 0xf)
+        pError = "capture image isn't qword aligned";
+    else if (numBytes < sizeof(tHeader) || header->Magic != kMagic)
+        pError = "not a dma capture";
+    else if (header->Version != kVersion)
+        pError = "unsupported capture version";
+    else if (header->FileSize > numBytes
+        || header->RecordsOffset + (uint64_t)header->NumRecords * sizeof(tRecord) > header->FileSize
+        || header->SegmentsOffset + (uint64_t)header->NumSegments * sizeof(tSegment) > header->FileSize
+        || header->FixupsOffset + (uint64_t)header->NumFixups * sizeof(uint32_t) > header->FileSize
+        || (header->PayloadOffset & 0xf)
+        || header->PayloadOffset + (uint64_t)header->PayloadSize > header->FileSize)
+        pError = "capture is truncated or corrupt";
+
+    if (pError)
+        return false;
+
+    pImage      = (uint8_t*)image;
+    uiImageSize = numBytes;
+    pHeader     = (tHeader*)image;
+    pPayload    = pImage + pHeader->PayloadOffset;
+
+    if (!FixUp()) {
+        pImage   = NULL;
+        pHeader  = NULL;
+        pPayload = NULL;
+        return false;
+    }
+    return true;
+}
+
+// relocates every tag that points somewhere to the copy of that memory in the payload
+bool CDmaReplay::FixUp(void)
+{
+    if (pHeader->Flags & kFixedUp)
+        return true;
+
+    const tRecord* records   = (const tRecord*)(pImage + pHeader->RecordsOffset);
+    const tSegment* segments = (const tSegment*)(pImage + pHeader->SegmentsOffset);
+    const uint32_t* fixups   = (const uint32_t*)(pImage + pHeader->FixupsOffset);
+
+    for (uint32_t i = 0; i < pHeader->NumSegments; i++) {
+        if ((uint64_t)segments[i].PayloadOffset + segments[i].NumBytes > pHeader->PayloadSize) {
+            pError = "capture is truncated or corrupt";
+            return false;
+        }
+    }
+
+    for (uint32_t r = 0; r < pHeader->NumRecords; r++) {
+        const tRecord& record = records[r];
+        if ((uint64_t)record.FirstSegment + record.NumSegments > pHeader->NumSegments
+            || (uint64_t)record.FirstFixup + record.NumFixups > pHeader->NumFixups
+            || (record.Start & 0xf) || record.Start + (uint64_t)record.NumQwords * 16 > pHeader->PayloadSize) {
+            pError = "capture is truncated or corrupt";
+            return false;
+        }
+
+        for (uint32_t f = 0; f < record.NumFixups; f++) {
+            uint32_t offset = fixups[record.FirstFixup + f];
+            if ((offset & 0xf) || offset + 16 > pHeader->PayloadSize) {
+                pError = "capture is truncated or corrupt";
+                return false;
+            }
+
+            tDmaTag* tag  = (tDmaTag*)(pPayload + offset);
+            bool spr      = IsSprRef(*tag);
+            uint32_t addr = (spr) ? tag->ADDR & (kScratchpadSize - 16) : NormalAddr(tag->ADDR);
+
+            const tSegment* seg = FindSegment(&segments[record.FirstSegment], record.NumSegments, addr, spr);
+            if (seg == NULL) {
+                pError = "a tag points outside the capture";
+                return false;
+            }
+
+            tag->ADDR = DMAC::MakeTagAddr(pPayload + seg->PayloadOffset + (addr - seg->OrigAddr));
+            tag->SPR  = 0;
+        }
+    }
+
+    pHeader->Flags |= kFixedUp;
+    return true;
+}
+
+void CDmaReplay::ReplayRecord(uint32_t record, CDmaBackend& backend)
+{
+    const tRecord& rec    = GetRecord(record);
+    tDmaChannelId channel = (tDmaChannelId)rec.Channel;
+
+    backend.Wait(channel);
+    if (rec.Type == kRecordChain)
+        backend.SendChain(channel, pPayload + rec.Start, rec.TTE);
+    else
+        backend.SendNormal(channel, pPayload + rec.Start, rec.NumQwords);
+}
+
+void CDmaReplay::Replay(CDmaBackend& backend)
+{
+    mErrorIf(pHeader == NULL, "Nothing to replay.");
+
+    // the relocated tags were written through the cache
+    backend.FlushCache();
+
+    for (uint32_t i = 0; i < pHeader->NumRecords; i++)
+        ReplayRecord(i, backend);
+}
@@ -0,0 +1,253 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#ifdef _EE
+#include "kernel.h"
+#endif
+
+#include "ps2s/core.h"
+#include "ps2s/debug.h"
+#include "ps2s/dmabackend.h"
+#include "ps2s/dmafence.h"
+#include "ps2s/dmastats.h"
+
+/********************************************
+ * DmaFence
+ */
+
+typedef struct {
+    uint32_t Sequence;
+    CDmaFence::tCallback Callback;
+    void* Arg;
+} tPendingCallback;
+
+// the number of the last send handed out on each channel, of the last one whose
+// transfer has really been started, and of the last one known to have finished.
+// Numbers start at 1 so that a default fence (0) has passed.  Only started sends
+// can be marked done:  between BeginSend() and EndSend() the channel is idle but
+// the new transfer hasn't run yet.
+static volatile uint32_t NumSent[CDmaFence::kNumChannels];
+static volatile uint32_t NumStarted[CDmaFence::kNumChannels];
+static volatile uint32_t NumDone[CDmaFence::kNumChannels];
+
+static tPendingCallback Callbacks[CDmaFence::kNumChannels][CDmaFence::kMaxCallbacks];
+static volatile uint32_t NumCallbacks[CDmaFence::kNumChannels];
+
+#ifdef _EE
+static int HandlerIds[CDmaFence::kNumChannels] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+#endif
+
+// keeps the channel interrupt out while the tables are touched.  These can
+// nest (or be used where interrupts are already off), so only turn them back on
+// if they were on.
+class CNoInterrupts {
+public:
+    CNoInterrupts(void)
+    {
+#ifdef _EE
+        bWereEnabled = (DIntr() != 0);
+#else
+        bWereEnabled = false;
+#endif
+    }
+    ~CNoInterrupts(void)
+    {
+#ifdef _EE
+        if (bWereEnabled)
+            EIntr();
+#endif
+    }
+
+private:
+    bool bWereEnabled;
+};
+
+static inline bool
+HasPassed(uint32_t doneSequence, uint32_t sequence)
+{
+    // (the numbers wrap)
+    return (int32_t)(doneSequence - sequence) >= 0;
+}
+
+static inline uint32_t
+GetCycles(void)
+{
+#ifdef _EE
+    return Core::GetCount();
+#else
+    return 0;
+#endif
+}
+
+bool CDmaFence::IsDone(void) const
+{
+    if (HasPassed(NumDone[dmaChannelId], uiSequence))
+        return true;
+
+    if (CDmaBackend::Get().IsBusy(dmaChannelId))
+        return false;
+
+    CNoInterrupts noInts;
+    MarkDone(dmaChannelId);
+    return HasPassed(NumDone[dmaChannelId], uiSequence);
+}
+
+bool CDmaFence::Wait(uint32_t maxCycles) const
+{
+    if (IsDone())
+        return true;
+
+#ifdef _EE
+    if (maxCycles != kForever) {
+        uint32_t start = GetCycles();
+        while (!IsDone()) {
+            if (GetCycles() - start >= maxCycles) {
+                DmaStats::AddWaitCycles(dmaChannelId, GetCycles() - start);
+                return false;
+            }
+        }
+        DmaStats::AddWaitCycles(dmaChannelId, GetCycles() - start);
+        return true;
+    }
+#endif
+
+    DmaStats::Wait(CDmaBackend::Get(), dmaChannelId);
+
+    CNoInterrupts noInts;
+    MarkDone(dmaChannelId);
+    return HasPassed(NumDone[dmaChannelId], uiSequence);
+}
+
+void CDmaFence::OnDone(tCallback callback, void* arg) const
+{
+    mAssert(callback != NULL);
+
+    if (IsDone()) {
+        callback(arg);
+        return;
+    }
+
+    {
+        CNoInterrupts noInts;
+        if (!HasPassed(NumDone[dmaChannelId], uiSequence)) {
+            uint32_t numPending = NumCallbacks[dmaChannelId];
+            if (numPending < kMaxCallbacks) {
+                tPendingCallback& pending = Callbacks[dmaChannelId][numPending];
+                pending.Sequence          = uiSequence;
+                pending.Callback          = callback;
+                pending.Arg               = arg;
+                NumCallbacks[dmaChannelId] = numPending + 1;
+                return;
+            }
+        }
+    }
+
+    // the interrupt got there first, or there's no room left to leave it pending
+    if (!IsDone()) {
+        mWarn("Too many fence callbacks pending on channel %d; waiting for the fence.", dmaChannelId);
+        Wait();
+    }
+    callback(arg);
+}
+
+CDmaFence
+CDmaFence::BeginSend(tDmaChannelId channel)
+{
+    mAssert((uint32_t)channel < kNumChannels);
+
+    CNoInterrupts noInts;
+    // the caller has waited for the channel, so everything before this has finished
+    MarkDone(channel);
+    uint32_t sequence = NumSent[channel] + 1;
+    if (sequence == 0)
+        sequence = 1;
+    NumSent[channel] = sequence;
+    return CDmaFence(channel, sequence);
+}
+
+void CDmaFence::EndSend(const CDmaFence& fence)
+{
+    tDmaChannelId channel = fence.dmaChannelId;
+    mAssert((uint32_t)channel < kNumChannels);
+    mAssert(fence.uiSequence == NumSent[channel]);
+
+    CNoInterrupts noInts;
+    NumStarted[channel] = fence.uiSequence;
+    // a short transfer can be over (and its interrupt gone by) before we get here
+    if (!CDmaBackend::Get().IsBusy(channel))
+        MarkDone(channel);
+}
+
+void CDmaFence::Update(tDmaChannelId channel)
+{
+    mAssert((uint32_t)channel < kNumChannels);
+
+    if (!HasPassed(NumDone[channel], NumStarted[channel]) && !CDmaBackend::Get().IsBusy(channel)) {
+        CNoInterrupts noInts;
+        MarkDone(channel);
+    }
+}
+
+void CDmaFence::Update(void)
+{
+    for (uint32_t c = 0; c < kNumChannels; c++)
+        Update((tDmaChannelId)c);
+}
+
+void CDmaFence::MarkDone(tDmaChannelId channel)
+{
+    NumDone[channel] = NumStarted[channel];
+    if (NumCallbacks[channel] > 0)
+        RunCallbacks(channel);
+}
+
+void CDmaFence::RunCallbacks(tDmaChannelId channel)
+{
+    // keep the order they were added in for the ones still waiting
+    tPendingCallback* pending = Callbacks[channel];
+    uint32_t numPending = NumCallbacks[channel], numKept = 0;
+    for (uint32_t i = 0; i < numPending; i++) {
+        if (HasPassed(NumDone[channel], pending[i].Sequence))
+            pending[i].Callback(pending[i].Arg);
+        else
+            pending[numKept++] = pending[i];
+    }
+    NumCallbacks[channel] = numKept;
+}
+
+int CDmaFence::InterruptHandler(int channel)
+{
+    // The interrupt can be late: if the handler was held off until the next send
+    // had started, that one isn't finished, so check the channel really is idle.
+    if (!CDmaBackend::Get().IsBusy((tDmaChannelId)channel))
+        MarkDone((tDmaChannelId)channel);
+    return 0;
+}
+
+void CDmaFence::EnableInterrupt(tDmaChannelId channel, bool enable)
+{
+    mAssert((uint32_t)channel < kNumChannels);
+
+#ifdef _EE
+    if (enable && HandlerIds[channel] < 0) {
+        HandlerIds[channel] = AddDmacHandler(channel, InterruptHandler, 0);
+        mErrorIf(HandlerIds[channel] < 0, "Couldn't add a dmac handler for channel %d.", channel);
+        EnableDmac(channel);
+    } else if (!enable && HandlerIds[channel] >= 0) {
+        DisableDmac(channel);
+        RemoveDmacHandler(channel, HandlerIds[channel]);
+        HandlerIds[channel] = -1;
+    }
+#else
+    // the soft dmac finishes every transfer before SendChain() returns, so
+    // polling catches everything an interrupt would
+    (void)enable;
+#endif
+}
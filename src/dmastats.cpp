@@ -0,0 +1,227 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ps2s/core.h"
+#include "ps2s/debug.h"
+#include "ps2s/dmabackend.h"
+#include "ps2s/dmastats.h"
+#include "ps2s/softdmac.h"
+
+/********************************************
+ * DmaStats
+ */
+
+namespace DmaStats {
+
+static bool bEnabled = false;
+
+static tChannelStats Current[kNumChannels];
+static tChannelStats History[kMaxWindow][kNumChannels];
+// the next slot of History to fill, and how many are filled
+static uint32_t uiHistoryHead = 0, uiNumHistory = 0;
+static uint32_t uiWindow = 30;
+
+static const uint32_t kMaxTags = 1 << 20;
+
+static const char* const ChannelNames[kNumChannels] = {
+    "vif0", "vif1", "gif", "fromIpu", "toIpu", "sif0", "sif1", "sif2", "fromSpr", "toSpr"
+};
+
+static inline uint32_t
+GetCycles(void)
+{
+#ifdef _EE
+    return Core::GetCount();
+#else
+    return 0;
+#endif
+}
+
+static inline tChannelStats&
+GetChannel(tDmaChannelId channel)
+{
+    mAssert((uint32_t)channel < kNumChannels);
+    return Current[channel];
+}
+
+void Enable(bool enable)
+{
+    bEnabled = enable;
+}
+
+bool IsEnabled(void)
+{
+    return bEnabled;
+}
+
+void SetWindow(uint32_t numFrames)
+{
+    mErrorIf(numFrames == 0 || numFrames > kMaxWindow, "The stats window can be 1 to %d frames.", kMaxWindow);
+    uiWindow = numFrames;
+}
+
+void EndFrame(void)
+{
+    memcpy(History[uiHistoryHead], Current, sizeof(Current));
+    uiHistoryHead = (uiHistoryHead + 1) % kMaxWindow;
+    if (uiNumHistory < kMaxWindow)
+        uiNumHistory++;
+
+    memset(Current, 0, sizeof(Current));
+}
+
+void Reset(void)
+{
+    memset(Current, 0, sizeof(Current));
+    memset(History, 0, sizeof(History));
+    uiHistoryHead = uiNumHistory = 0;
+}
+
+const tChannelStats&
+GetCurrent(tDmaChannelId channel)
+{
+    return GetChannel(channel);
+}
+
+const tChannelStats&
+GetLastFrame(tDmaChannelId channel)
+{
+    mAssert((uint32_t)channel < kNumChannels);
+    // (all zeros until a frame has finished)
+    return History[(uiHistoryHead + kMaxWindow - 1) % kMaxWindow][channel];
+}
+
+uint32_t
+GetNumFramesAveraged(void)
+{
+    return (uiNumHistory < uiWindow) ? uiNumHistory : uiWindow;
+}
+
+void GetAverage(tDmaChannelId channel, tChannelStats& average)
+{
+    mAssert((uint32_t)channel < kNumChannels);
+
+    // sum in 64 bits so that a window of busy frames can't overflow
+    const uint32_t kNumFields = sizeof(tChannelStats) / sizeof(uint32_t);
+    uint64_t sums[kNumFields];
+    memset(sums, 0, sizeof(sums));
+
+    uint32_t numFrames = GetNumFramesAveraged();
+    for (uint32_t i = 0; i < numFrames; i++) {
+        const tChannelStats& frame = History[(uiHistoryHead + kMaxWindow - 1 - i) % kMaxWindow][channel];
+        const uint32_t* fields     = (const uint32_t*)&frame;
+        for (uint32_t f = 0; f < kNumFields; f++)
+            sums[f] += fields[f];
+    }
+
+    uint32_t* avgFields = (uint32_t*)&average;
+    for (uint32_t f = 0; f < kNumFields; f++)
+        avgFields[f] = (numFrames) ? sums[f] / numFrames : 0;
+}
+
+void Print(void)
+{
+    static const char* const tagNames[8] = { "refe", "cnt", "next", "ref", "refs", "call", "ret", "end" };
+
+    printf("dma stats, averaged over %d frames:\n", GetNumFramesAveraged());
+    for (uint32_t c = 0; c < kNumChannels; c++) {
+        tChannelStats avg;
+        GetAverage((tDmaChannelId)c, avg);
+        if (avg.NumSends == 0 && GetNumQwords(avg) == 0)
+            continue;
+
+        printf("  %-7s %d sends, %d qwords (%d inline, %d ref, %d tag bytes), %d wait cycles\n",
+            ChannelNames[c], avg.NumSends, GetNumQwords(avg),
+            avg.InlineBytes, avg.RefBytes, avg.TagBytes, avg.WaitCycles);
+        if (avg.NumTags == 0)
+            continue;
+        printf("          %d tags:", avg.NumTags);
+        for (uint32_t id = 0; id < 8; id++)
+            if (avg.NumTagsById[id] > 0)
+                printf(" %s %d", tagNames[id], avg.NumTagsById[id]);
+        printf("\n");
+    }
+}
+
+void RecordNormal(tDmaChannelId channel, uint32_t numQwords)
+{
+    if (!bEnabled)
+        return;
+
+    tChannelStats& stats = GetChannel(channel);
+    stats.NumSends++;
+    stats.InlineBytes += numQwords * 16;
+}
+
+void RecordChain(tDmaChannelId channel, const void* firstTag, bool tte)
+{
+    if (!bEnabled)
+        return;
+
+    tChannelStats& stats = GetChannel(channel);
+    stats.NumSends++;
+
+    // follow the chain the way the dmac will (see CSoftDmac::WalkChain); a bad one just
+    // stops the count -- catching those is the verifier's job
+    uint32_t addrStack[DMAC::kMaxCallDepth];
+    uint32_t stackDepth = 0;
+    uint32_t tagAddr    = DMAC::MakeTagAddr(firstTag);
+    CSoftDmac::tTagStep step;
+
+    for (uint32_t numTags = 0; numTags < kMaxTags && (tagAddr & 0xf) == 0; numTags++) {
+        const tDmaTag* tag = (const tDmaTag*)DMAC::GetTagPtr(tagAddr);
+        CSoftDmac::DecodeTag(*tag, tagAddr, step);
+
+        stats.NumTags++;
+        stats.NumTagsById[tag->ID]++;
+        if (tte)
+            stats.TagBytes += 16;
+        if (tag->ID == DMAC::kRef || tag->ID == DMAC::kRefs || tag->ID == DMAC::kRefe)
+            stats.RefBytes += step.DataQWC * 16;
+        else
+            stats.InlineBytes += step.DataQWC * 16;
+
+        if (step.Push) {
+            if (stackDepth == DMAC::kMaxCallDepth)
+                break;
+            addrStack[stackDepth++] = step.DataAddr + step.DataQWC * 16;
+        } else if (step.Pop) {
+            if (stackDepth == 0)
+                break;
+            step.NextTagAddr = addrStack[--stackDepth];
+        }
+
+        if (step.Last)
+            break;
+
+        tagAddr = step.NextTagAddr;
+    }
+}
+
+void Wait(CDmaBackend& backend, tDmaChannelId channel)
+{
+    if (bEnabled && backend.IsBusy(channel)) {
+        uint32_t start = GetCycles();
+        backend.Wait(channel);
+        AddWaitCycles(channel, GetCycles() - start);
+    } else
+        backend.Wait(channel);
+}
+
+void AddWaitCycles(tDmaChannelId channel, uint32_t numCycles)
+{
+    if (bEnabled)
+        GetChannel(channel).WaitCycles += numCycles;
+}
+
+} // namespace DmaStats
@@ -183,19 +183,10 @@ void CDrawEnv::SendSettings(CSCDmaPacket& packet)
 
 void CDrawEnv::SendSettings(CVifSCDmaPacket& packet)
 {
-    // the data needs to be qword-aligned, so pad with appropriate # of vifnops to
-    // put the direct vifcode at the end of a qword
     bool opened_tag = false;
-    if (packet.HasOpenTag()) {
-        // assume that the packet is aligned to 128 bits
-        packet.Nop().Nop().Nop();
-    } else {
+    if (!packet.HasOpenTag()) {
         opened_tag = true;
         packet.Cnt();
-        packet.Nop();
-        if (!packet.GetTTE()) {
-            packet.Nop().Nop();
-        }
     }
 
     packet.OpenDirect();
@@ -14,6 +14,8 @@ namespace GS {
  */
 
 typedef struct {
+    // a ret so that the flush can be called from other chains
+    tSourceChainTag dmaTag;
     tGifTag gt;
     uint64_t texFlush;
     uint64_t texFlushAddr;
@@ -26,6 +28,15 @@ static tFlushPkt FlushPkt;
 
 void Init(void)
 {
+    FlushPkt.dmaTag.QWC  = 2;
+    FlushPkt.dmaTag.PCE  = 0;
+    FlushPkt.dmaTag.ID   = DMAC::kRet;
+    FlushPkt.dmaTag.IRQ  = 0;
+    FlushPkt.dmaTag.ADDR = 0;
+    FlushPkt.dmaTag.SPR  = 0;
+    FlushPkt.dmaTag.opt1 = 0; // vif nop
+    FlushPkt.dmaTag.opt2 = (Vifs::Opcodes::direct << 24) | 2;
+
     FlushPkt.gt.NLOOP = 1;
     FlushPkt.gt.EOP   = 1;
     FlushPkt.gt.PRE   = 0;
@@ -59,8 +70,11 @@ void Flush(void)
 
 void Flush(CSCDmaPacket& packet)
 {
+    if (packet.CallIfPossible(&FlushPkt.dmaTag))
+        return;
+
     packet.Cnt();
-    packet.Add((uint128_t*)&FlushPkt, 2);
+    packet.Add((uint128_t*)&FlushPkt.gt, 2);
     packet.CloseTag();
 }
 
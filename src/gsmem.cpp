@@ -4,11 +4,14 @@
 	  General Public License Version 2.1. See the file "COPYING" in the
 	  main directory of this archive for more details.                             */
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "ps2s/debug.h"
 #include "ps2s/gsmem.h"
 #include "ps2s/math.h"
+#include "ps2s/packet.h"
 
 /********************************************
  * CMemSlot
@@ -41,6 +44,16 @@ void CMemSlot::Unbind()
     List->MakeSlotLRU(this);
 }
 
+void CMemSlot::MoveTo(int firstBlock)
+{
+    mErrorIf(!Dynamic, "Only the allocator's slots can be moved.");
+    mErrorIf((firstBlock ^ FirstBlock) % CVramAllocator::kBlocksPerPage,
+        "A slot has to stay at the same place in a page.");
+
+    FirstBlock = firstBlock;
+    FirstPage  = firstBlock / CVramAllocator::kBlocksPerPage;
+}
+
 // for Print just below
 
 #define mCase(_psm) \
@@ -75,8 +88,11 @@ GetPSMString(GS::tPSM psm)
 
 void CMemSlot::Print()
 {
-    printf("[%3d, %3d]\t PixFormat: %s\t LastFrameUsed: %d\t",
-        FirstPage, FirstPage + PageLength - 1,
+    if (Dynamic)
+        printf("[%3d.%02d, +%2d blocks]", FirstPage, FirstBlock % CVramAllocator::kBlocksPerPage, NumBlocks);
+    else
+        printf("[%3d, %3d]", FirstPage, FirstPage + PageLength - 1);
+    printf("\t PixFormat: %s\t LastFrameUsed: %d\t",
         GetPSMString(PixFormat).c_str(),
         LastFrameUsed);
     if (BoundMemArea) {
@@ -98,45 +114,23 @@ CMemSlotList::~CMemSlotList()
 
 void CMemSlotList::PrintSlots()
 {
-    int count;
-    tSlotIter curSlot = Slots.begin();
-    for (count = 0; curSlot != Slots.end(); curSlot++, count++)
-        (*curSlot)->Print();
+    int count         = 0;
+    CMemSlot* curSlot = Head;
+    for (; curSlot != NULL; curSlot = curSlot->Next, count++)
+        curSlot->Print();
     if (count > 0)
         printf("\n");
 }
 
-void CMemSlotList::RemoveSlot(CMemSlot* slot)
-{
-    tSlotIter curSlot = Slots.begin();
-    for (; curSlot != Slots.end(); curSlot++)
-        if (*curSlot == slot) {
-            break;
-        }
-
-    mErrorIf((*curSlot != slot), "This list does not contain the specified slot!");
-
-    Slots.erase(curSlot);
-}
-
-void CMemSlotList::MakeSlotLRU(CMemSlot* slot)
-{
-    RemoveSlot(slot);
-    Slots.push_back(slot);
-}
-
-void CMemSlotList::MakeSlotMRU(CMemSlot* slot)
-{
-    RemoveSlot(slot);
-    Slots.push_front(slot);
-}
-
 void CMemSlotList::RemoveAllSlots()
 {
-    tSlotIter curSlot = Slots.begin();
-    for (; curSlot != Slots.end(); curSlot++)
-        delete *curSlot;
-    Slots.clear();
+    CMemSlot* curSlot = Head;
+    while (curSlot != NULL) {
+        CMemSlot* nextSlot = curSlot->Next;
+        delete curSlot;
+        curSlot = nextSlot;
+    }
+    Head = Tail = NULL;
 }
 
 /********************************************
@@ -146,6 +140,7 @@ void CMemSlotList::RemoveAllSlots()
 CMemManager::~CMemManager()
 {
     RemoveAllSlots();
+    delete Allocator;
 }
 
 void CMemManager::RemoveAllSlots()
@@ -156,11 +151,25 @@ void CMemManager::RemoveAllSlots()
     SlotLists.clear();
 
     LockedSlots.RemoveAllSlots();
+    DynamicSlots.RemoveAllSlots();
+    PlaneSlots.RemoveAllSlots();
+    if (Allocator)
+        Allocator->Reset();
+}
+
+void CMemManager::UseAllocator(int firstPage, int numPages)
+{
+    mErrorIf(!SlotLists.empty(), "The allocator can't be used with slots.");
+    RemoveAllSlots();
+    delete Allocator;
+    Allocator = new CVramAllocator(firstPage, numPages);
 }
 
 CMemSlot*
 CMemManager::AddSlot(int firstPage, int pageLength, GS::tPSM pixFormat)
 {
+    mErrorIf(Allocator != NULL, "Slots can't be added when using the allocator.");
+
     // is there already a list of slots of this type?
     CMemSlot* newSlot = new CMemSlot(firstPage, pageLength, pixFormat);
     mErrorIf(newSlot == NULL, "Failed to create slot");
@@ -181,6 +190,11 @@ CMemManager::AddSlot(int firstPage, int pageLength, GS::tPSM pixFormat)
 
 void CMemManager::Alloc(CMemArea& memArea)
 {
+    if (Allocator) {
+        AllocDynamic(memArea);
+        return;
+    }
+
     using namespace GS;
     switch (memArea.GetPixFormat()) {
     case kPsm4:
@@ -356,6 +370,275 @@ void CMemManager::Alloc32(CMemArea& memArea)
 
 void CMemManager::Free(CMemArea& memArea)
 {
+    CMemSlot* slot = memArea.Slot;
+    if (slot == NULL)
+        return;
+
+    if (slot->IsDynamic())
+        FreeDynamic(*slot);
+    else
+        slot->Unbind();
+}
+
+// the allocator's planes for a high format
+static int
+GetPlanes(GS::tPSM psm)
+{
+    switch (psm) {
+    case GS::kPsm4hl:
+        return CVramAllocator::kPlanes4hl;
+    case GS::kPsm4hh:
+        return CVramAllocator::kPlanes4hh;
+    default:
+        return CVramAllocator::kPlanes8h;
+    }
+}
+
+void CMemManager::AllocDynamic(CMemArea& memArea)
+{
+    Free(memArea);
+
+    if (AllocPlanes(memArea))
+        return;
+
+    int numBlocks = memArea.GetNumBlocks();
+    int firstBlock;
+    while ((firstBlock = Allocator->Alloc(numBlocks)) < 0) {
+        // (freeing a host frees its tenants, so one with a locked tenant has to stay)
+        CMemSlot* lruSlot = DynamicSlots.GetLRUSlot();
+        while (lruSlot && HasLockedTenants(*lruSlot))
+            lruSlot = lruSlot->GetPrev();
+        mErrorIf(lruSlot == NULL, "Failed to allocate %d blocks of GS mem.", numBlocks);
+        FreeDynamic(*lruSlot);
+    }
+
+    CMemSlot* slot = new CMemSlot(memArea.GetPixFormat(), firstBlock, numBlocks);
+    mErrorIf(slot == NULL, "Failed to create slot");
+    DynamicSlots.AddSlot(slot);
+    slot->Bind(memArea, CurFrame);
+
+    // are the upper 8 bits free for others?
+    using namespace GS;
+    tPSM psm = memArea.GetPixFormat();
+    if ((psm == kPsm24 || psm == kPsmz24 || (psm == kPsm32 && memArea.IsAlphaUnused()))
+        && CVramAllocator::GetAllocBlocks(numBlocks) >= CVramAllocator::kBlocksPerPage)
+        Allocator->AddPlaneHosts(slot->GetFirstPage(), slot->GetPageLength());
+}
+
+bool CMemManager::AllocPlanes(CMemArea& memArea)
+{
+    using namespace GS;
+    tPSM psm = memArea.GetPixFormat();
+    if (psm != kPsm8h && psm != kPsm4hl && psm != kPsm4hh)
+        return false;
+
+    // (the high formats are laid out like psmct32, so the area's pages are the
+    // host pages it needs)
+    int numPages = memArea.GetPageLength();
+    int firstPage;
+    if (psm == kPsm8h)
+        firstPage = Allocator->AllocPlanes(numPages, CVramAllocator::kPlanes8h);
+    else {
+        // either nibble will do
+        tPSM otherPsm = (psm == kPsm4hl) ? kPsm4hh : kPsm4hl;
+        firstPage     = Allocator->AllocPlanes(numPages, GetPlanes(psm));
+        if (firstPage < 0) {
+            firstPage = Allocator->AllocPlanes(numPages, GetPlanes(otherPsm));
+            psm       = otherPsm;
+        }
+    }
+    if (firstPage < 0)
+        return false;
+
+    CMemSlot* slot = new CMemSlot(psm, firstPage * CVramAllocator::kBlocksPerPage,
+        numPages * CVramAllocator::kBlocksPerPage, true);
+    mErrorIf(slot == NULL, "Failed to create slot");
+    PlaneSlots.AddSlot(slot);
+    slot->Bind(memArea, CurFrame);
+    return true;
+}
+
+void CMemManager::FreeDynamic(CMemSlot& slot)
+{
+    // A host can't give back pages that a locked area still has its pixels in.
+    // The host's area is let go, but its slot keeps the pages (unlocked, so it
+    // can be evicted once its tenants are).
+    if (HasLockedTenants(slot)) {
+        mError("Can't free an area with a locked area in its upper bits.");
+        if (slot.IsLocked())
+            slot.Unlock();
+        if (slot.IsBound())
+            slot.Unbind();
+        return;
+    }
+
+    if (slot.IsBound())
+        slot.Unbind();
+    // (locked slots are in LockedSlots)
+    slot.GetOwningList()->RemoveSlot(&slot);
+
+    if (slot.IsInPlanes())
+        Allocator->FreePlanes(slot.GetFirstPage(), slot.GetPageLength(), GetPlanes(slot.GetPixFormat()));
+    else {
+        if (CVramAllocator::GetAllocBlocks(slot.GetNumBlocks()) >= CVramAllocator::kBlocksPerPage
+            && Allocator->GetPlanesUsed(slot.GetFirstPage(), slot.GetPageLength()))
+            FreePlaneTenants(slot.GetFirstPage(), slot.GetPageLength());
+        Allocator->Free(slot.GetFirstBlock(), slot.GetNumBlocks());
+    }
+    delete &slot;
+}
+
+void CMemManager::FreePlaneTenants(int firstPage, int numPages)
+{
+    // the areas in the upper bits of the pages (locked ones are in LockedSlots,
+    // and can't be freed from under their owner)
+    std::vector<CMemSlot*> tenants;
+    for (CMemSlot* slot = PlaneSlots.GetMRUSlot(); slot; slot = slot->GetNext())
+        if (slot->GetFirstPage() < firstPage + numPages
+            && slot->GetFirstPage() + slot->GetPageLength() > firstPage)
+            tenants.push_back(slot);
+
+    for (unsigned int i = 0; i < tenants.size(); i++)
+        FreeDynamic(*tenants[i]);
+}
+
+bool CMemManager::HasLockedTenants(const CMemSlot& slot)
+{
+    if (CVramAllocator::GetAllocBlocks(slot.GetNumBlocks()) < CVramAllocator::kBlocksPerPage
+        || !Allocator->GetPlanesUsed(slot.GetFirstPage(), slot.GetPageLength()))
+        return false;
+
+    for (CMemSlot* tenant = LockedSlots.GetMRUSlot(); tenant; tenant = tenant->GetNext())
+        if (tenant->IsInPlanes()
+            && tenant->GetFirstPage() < slot.GetFirstPage() + slot.GetPageLength()
+            && tenant->GetFirstPage() + tenant->GetPageLength() > slot.GetFirstPage())
+            return true;
+    return false;
+}
+
+// compaction
+
+// transfer positions wrap at 2048, so that's 63 pages of 32 rows
+static const int kMaxMovePages = 63;
+
+static bool
+IsHigher(const CMemSlot* lhs, const CMemSlot* rhs)
+{
+    return lhs->GetFirstBlock() > rhs->GetFirstBlock();
+}
+
+void CMemManager::AddMove(CSCDmaPacket& packet, int fromPage, int toPage, int numPages)
+{
+    using namespace GS;
+
+    tGifTag gifTag = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    gifTag.NLOOP   = 4;
+    gifTag.EOP     = 1;
+    gifTag.FLG     = 0; // packed
+    gifTag.NREG    = 1;
+    gifTag.REGS0   = 0xe; // a+d
+
+    // The pages are copied as psmct32, in a buffer one page (64 pixels) wide so
+    // that they're stacked one under another.  Whatever the area's real format,
+    // a page of it is the same 2048 words in the same order.
+    tBitbltbuf bitbltbuf = { 0 };
+    bitbltbuf.src_width    = 1;
+    bitbltbuf.src_pixmode  = kPsm32;
+    bitbltbuf.dest_width   = 1;
+    bitbltbuf.dest_pixmode = kPsm32;
+
+    tTrxpos trxpos = { 0 }; // upper-left -> lower-right
+    tTrxreg trxreg = { 0 };
+    trxreg.trans_w = 64;
+    tTrxdir trxdir = { 0 };
+    trxdir.trans_dir = 2; // local -> local
+
+    for (int numMoved = 0; numMoved < numPages;) {
+        int numThisMove = Math::Min(numPages - numMoved, kMaxMovePages);
+
+        bitbltbuf.src_addr  = (fromPage + numMoved) * CVramAllocator::kBlocksPerPage;
+        bitbltbuf.dest_addr = (toPage + numMoved) * CVramAllocator::kBlocksPerPage;
+        trxreg.trans_h      = numThisMove * 32;
+
+        packet += gifTag;
+        packet += bitbltbuf;
+        packet += (uint64_t)RegAddrs::bitbltbuf;
+        packet += trxpos;
+        packet += (uint64_t)RegAddrs::trxpos;
+        packet += trxreg;
+        packet += (uint64_t)RegAddrs::trxreg;
+        packet += trxdir;
+        packet += (uint64_t)RegAddrs::trxdir;
+
+        numMoved += numThisMove;
+    }
+}
+
+int CMemManager::Compact(CSCDmaPacket& packet)
+{
+    mErrorIf(Allocator == NULL, "Compaction needs the allocator (see UseAllocator()).");
+
+    // the areas that can move (locked slots aren't in DynamicSlots), highest first.
+    // Hosts with tenants stay put, locked tenants or not, since the tenants' pixels
+    // are in the same words and their slots would have to move too.
+    std::vector<CMemSlot*> slots;
+    for (CMemSlot* slot = DynamicSlots.GetMRUSlot(); slot; slot = slot->GetNext())
+        if (CVramAllocator::GetAllocBlocks(slot->GetNumBlocks()) >= CVramAllocator::kBlocksPerPage
+            && !Allocator->GetPlanesUsed(slot->GetFirstPage(), slot->GetPageLength()))
+            slots.push_back(slot);
+    std::sort(slots.begin(), slots.end(), IsHigher);
+
+    bool openedTag = false;
+    int numMoved   = 0;
+    for (unsigned int i = 0; i < slots.size(); i++) {
+        CMemSlot* slot = slots[i];
+        int numBlocks  = CVramAllocator::GetAllocBlocks(slot->GetNumBlocks());
+        if (CompactionBudget > 0 && numMoved + numBlocks > CompactionBudget)
+            continue;
+
+        int newBlock = Allocator->AllocLow(slot->GetNumBlocks(), slot->GetFirstBlock());
+        if (newBlock < 0)
+            continue;
+
+        if (!openedTag && !packet.HasOpenTag()) {
+            packet.Cnt();
+            openedTag = true;
+        }
+        AddMove(packet, slot->GetFirstPage(), newBlock / CVramAllocator::kBlocksPerPage,
+            slot->GetPageLength());
+
+        bool isPlaneHost = Allocator->IsPlaneHost(slot->GetFirstPage());
+        Allocator->Free(slot->GetFirstBlock(), slot->GetNumBlocks());
+        slot->MoveTo(newBlock);
+        if (isPlaneHost)
+            Allocator->AddPlaneHosts(slot->GetFirstPage(), slot->GetPageLength());
+        numMoved += numBlocks;
+
+        CMemArea* area = slot->GetBoundMemArea();
+        if (area) {
+            area->Bind(*slot);
+            if (area->MoveCallback)
+                area->MoveCallback(*area, area->MoveCallbackArg);
+        }
+    }
+
+    if (numMoved > 0) {
+        // textures might be cached from the old addresses
+        tGifTag gifTag = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+        gifTag.NLOOP   = 1;
+        gifTag.EOP     = 1;
+        gifTag.FLG     = 0; // packed
+        gifTag.NREG    = 1;
+        gifTag.REGS0   = 0xe; // a+d
+
+        packet += gifTag;
+        packet += (uint64_t)0;
+        packet += (uint64_t)GS::RegAddrs::texflush;
+    }
+    if (openedTag)
+        packet.CloseTag();
+
+    return numMoved;
 }
 
 CMemSlot*
@@ -416,6 +699,11 @@ void CMemManager::PrintAllocation()
     tSlotListIter curList = SlotLists.begin();
     for (; curList != SlotLists.end(); curList++)
         (*curList)->PrintSlots();
+    DynamicSlots.PrintSlots();
+    PlaneSlots.PrintSlots();
+
+    if (Allocator)
+        Allocator->Print();
 }
 
 /********************************************
@@ -433,6 +721,9 @@ CMemArea::CMemArea(int width, int height,
     , GSWordAddr(0)
     , PixFormat(pixFormat)
     , Alignment(alignment)
+    , MoveCallback(NULL)
+    , MoveCallbackArg(NULL)
+    , AlphaUnused(false)
 {
     int width32 = width, height32 = height;
     XformDimensions(&width32, &height32, pixFormat);
@@ -442,6 +733,13 @@ CMemArea::CMemArea(int width, int height,
     int wPages = DivUp(width32, 64);
     int hPages = DivUp(height32, 32);
     PageLength = wPages * hPages;
+
+    NumBlocks = PageLength * CVramAllocator::kBlocksPerPage;
+    if (alignment == kAlignBlock && PageLength == 1) {
+        int footprint = GetBlockFootprint(width, height, pixFormat);
+        if (footprint > 0)
+            NumBlocks = footprint;
+    }
 }
 
 CMemArea::~CMemArea()
@@ -459,13 +757,13 @@ void CMemArea::Alloc()
 void CMemArea::Free()
 {
     if (Slot)
-        Slot->Unbind();
+        MemManager->Free(*this);
 }
 
 void CMemArea::Bind(CMemSlot& slot)
 {
     Slot       = &slot;
-    GSWordAddr = slot.GetFirstPage() * 2048;
+    GSWordAddr = slot.GetFirstBlock() * CVramAllocator::kWordsPerBlock;
     PixFormat  = slot.GetPixFormat();
 }
 
@@ -474,6 +772,51 @@ void CMemArea::Unbind()
     Slot = NULL;
 }
 
+// the number of blocks from the first that an area smaller than a page covers
+// (some of them might not be used), or 0 if it doesn't fit in a page
+int CMemArea::GetBlockFootprint(int width, int height, GS::tPSM pixFormat)
+{
+    using Math::DivUp;
+    using namespace GS;
+
+    const int* table;
+    int tableW, tableH, blockW, blockH;
+    switch (pixFormat) {
+    case kPsm32:
+    case kPsm24:
+    case kPsm8h:
+    case kPsm4hh:
+    case kPsm4hl:
+        table = &BlockTable32[0][0], tableW = 8, tableH = 4, blockW = 8, blockH = 8;
+        break;
+    case kPsm16:
+        table = &BlockTable16[0][0], tableW = 4, tableH = 8, blockW = 16, blockH = 8;
+        break;
+    case kPsm16s:
+        table = &BlockTable16s[0][0], tableW = 4, tableH = 8, blockW = 16, blockH = 8;
+        break;
+    case kPsm8:
+        table = &BlockTable32[0][0], tableW = 8, tableH = 4, blockW = 16, blockH = 16;
+        break;
+    case kPsm4:
+        table = &BlockTable16[0][0], tableW = 4, tableH = 8, blockW = 32, blockH = 16;
+        break;
+    default:
+        // depth buffers are allocated in pages anyway
+        return 0;
+    }
+
+    int blocksW = DivUp(width, blockW), blocksH = DivUp(height, blockH);
+    if (blocksW > tableW || blocksH > tableH)
+        return 0;
+
+    int lastBlock = 0;
+    for (int y = 0; y < blocksH; y++)
+        for (int x = 0; x < blocksW; x++)
+            lastBlock = Math::Max(lastBlock, table[y * tableW + x]);
+    return lastBlock + 1;
+}
+
 void CMemArea::XformDimensions(int* width, int* height, GS::tPSM pixFormat)
 {
     using Math::DivUp;
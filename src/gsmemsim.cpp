@@ -0,0 +1,474 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ps2s/debug.h"
+#include "ps2s/gs_consts.h"
+#include "ps2s/gsmemsim.h"
+
+/********************************************
+ * GsMemSim
+ */
+
+using namespace GS;
+
+// Every format's columns are made of 32-bit words in the same order:  a column
+// is 16 words, and these are the words of its 8x2 pixels as psmct32.  The
+// smaller formats put 2 (16-bit), 4 (8-bit) or 8 (4-bit) pixels in each word,
+// and in the 8- and 4-bit formats every other pair of rows is shifted over by 4
+// pixels.
+static const uint32_t ColumnWords[2][8] = {
+    { 0, 1, 4, 5, 8, 9, 12, 13 },
+    { 2, 3, 6, 7, 10, 11, 14, 15 }
+};
+
+// transfer positions are 11 bits
+static const uint32_t kCoordMask = 2047;
+static const uint32_t kNumBlocks = CGsMemSim::kNumWords / 64;
+
+static bool
+IsValidPsm(tPSM psm)
+{
+    switch (psm) {
+    case kPsm32:
+    case kPsm24:
+    case kPsm16:
+    case kPsm16s:
+    case kPsm8:
+    case kPsm8h:
+    case kPsm4:
+    case kPsm4hh:
+    case kPsm4hl:
+    case kPsmz32:
+    case kPsmz24:
+    case kPsmz16:
+    case kPsmz16s:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline uint32_t
+GetPixelMask(uint32_t bits)
+{
+    return (bits == 32) ? 0xffffffff : (1 << bits) - 1;
+}
+
+// pixels packed as in a transfer (the ee is little-endian, like the gs)
+
+static inline uint32_t
+GetPacked(const uint8_t* data, uint32_t bits, uint32_t index)
+{
+    if (bits == 4)
+        return (data[index / 2] >> ((index & 1) * 4)) & 0xf;
+
+    const uint8_t* bytes = data + index * (bits / 8);
+    uint32_t value       = 0;
+    for (uint32_t i = 0; i < bits / 8; i++)
+        value |= (uint32_t)bytes[i] << (i * 8);
+    return value;
+}
+
+static inline void
+SetPacked(uint8_t* data, uint32_t bits, uint32_t index, uint32_t value)
+{
+    if (bits == 4) {
+        uint32_t shift  = (index & 1) * 4;
+        data[index / 2] = (data[index / 2] & ~(0xf << shift)) | ((value & 0xf) << shift);
+        return;
+    }
+
+    uint8_t* bytes = data + index * (bits / 8);
+    for (uint32_t i = 0; i < bits / 8; i++)
+        bytes[i] = value >> (i * 8);
+}
+
+CGsMemSim::CGsMemSim(void)
+    : Mem(kNumWords)
+{
+    Reset();
+}
+
+void CGsMemSim::Reset(void)
+{
+    memset(&Mem[0], 0, kNumWords * 4);
+
+    ulBitbltbuf = ulTrxpos = ulTrxreg = 0;
+    uiQwordsLeft = uiNumRegs = uiRegIndex = uiFlag = 0;
+    ulRegs                                       = 0;
+    uiXferX = uiXferY = uiXferPixelsLeft = 0;
+    ulXferBits                           = 0;
+    uiXferNumBits                        = 0;
+    pError                               = NULL;
+
+    ResetStats();
+}
+
+void CGsMemSim::ResetStats(void)
+{
+    uiNumPixelsWritten = uiNumTransfers = 0;
+}
+
+// addressing
+
+uint32_t
+CGsMemSim::GetBlockWidth(tPSM psm)
+{
+    switch (psm) {
+    case kPsm16:
+    case kPsm16s:
+    case kPsmz16:
+    case kPsmz16s:
+    case kPsm8:
+        return 16;
+    case kPsm4:
+        return 32;
+    default:
+        return 8;
+    }
+}
+
+uint32_t
+CGsMemSim::GetBlockAddr(tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y)
+{
+    // pages are 64x32 (32-bit), 64x64 (16-bit), 128x64 (8-bit) or 128x128 (4-bit),
+    // and bw is in units of 64 pixels
+    uint32_t block;
+    switch (psm) {
+    case kPsm16:
+    case kPsmz16:
+        block = (y / 64) * bw * 32 + (x / 64) * 32 + BlockTable16[(y >> 3) & 7][(x >> 4) & 3];
+        break;
+    case kPsm16s:
+    case kPsmz16s:
+        block = (y / 64) * bw * 32 + (x / 64) * 32 + BlockTable16s[(y >> 3) & 7][(x >> 4) & 3];
+        break;
+    case kPsm8:
+        block = (y / 64) * (bw / 2) * 32 + (x / 128) * 32 + BlockTable32[(y >> 4) & 3][(x >> 4) & 7];
+        break;
+    case kPsm4:
+        block = (y / 128) * (bw / 2) * 32 + (x / 128) * 32 + BlockTable16[(y >> 4) & 7][(x >> 5) & 3];
+        break;
+    default:
+        block = (y / 32) * bw * 32 + (x / 64) * 32 + BlockTable32[(y >> 3) & 3][(x >> 3) & 7];
+        break;
+    }
+
+    // the z formats' blocks go the other way round the page
+    if (psm == kPsmz32 || psm == kPsmz24 || psm == kPsmz16 || psm == kPsmz16s)
+        block ^= 24;
+
+    return (bp + block) % kNumBlocks;
+}
+
+uint32_t
+CGsMemSim::GetColumnAddr(tPSM psm, uint32_t x, uint32_t y, uint32_t* shift)
+{
+    switch (psm) {
+    case kPsm16:
+    case kPsm16s:
+    case kPsmz16:
+    case kPsmz16s:
+        // pixels 8 apart share a word
+        *shift = ((x >> 3) & 1) * 16;
+        return ((y >> 1) & 3) * 16 + ColumnWords[y & 1][x & 7];
+    case kPsm8:
+    case kPsm4: {
+        // a column is 4 rows; the second pair of rows of even columns and the
+        // first pair of odd columns are shifted over
+        uint32_t column = (y >> 2) & 3;
+        uint32_t swap   = ((y >> 1) ^ column) & 1;
+        if (psm == kPsm8)
+            *shift = (((x >> 3) & 1) * 2 + ((y >> 1) & 1)) * 8;
+        else
+            *shift = (((x >> 3) & 3) * 2 + ((y >> 1) & 1)) * 4;
+        return column * 16 + ColumnWords[y & 1][(x ^ (swap << 2)) & 7];
+    }
+    case kPsm8h:
+    case kPsm4hl:
+        *shift = 24;
+        break;
+    case kPsm4hh:
+        *shift = 28;
+        break;
+    default:
+        *shift = 0;
+        break;
+    }
+    return ((y >> 1) & 3) * 16 + ColumnWords[y & 1][x & 7];
+}
+
+uint32_t
+CGsMemSim::GetWordAddr(tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y, uint32_t* shift)
+{
+    uint32_t pixelShift;
+    uint32_t column = GetColumnAddr(psm, x, y, &pixelShift);
+    if (shift)
+        *shift = pixelShift;
+    return GetBlockAddr(psm, bp, bw, x, y) * 64 + column;
+}
+
+// pixels
+
+uint32_t
+CGsMemSim::ReadPixel(tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y) const
+{
+    uint32_t shift;
+    uint32_t addr = GetWordAddr(psm, bp, bw, x, y, &shift);
+    return (Mem[addr] >> shift) & GetPixelMask(GetBitsPerPixel(psm));
+}
+
+void CGsMemSim::WritePixel(tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y, uint32_t value)
+{
+    uint32_t shift;
+    uint32_t addr = GetWordAddr(psm, bp, bw, x, y, &shift);
+    uint32_t mask = GetPixelMask(GetBitsPerPixel(psm)) << shift;
+    Mem[addr]     = (Mem[addr] & ~mask) | ((value << shift) & mask);
+    uiNumPixelsWritten++;
+}
+
+// A row of a block has the same column addresses whichever block it's in, so the
+// bulk paths work them out once a row and look up the block once per block.
+
+void CGsMemSim::Write(tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+    const void* data)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint32_t bits        = GetBitsPerPixel(psm);
+    uint32_t pixelMask   = GetPixelMask(bits);
+    uint32_t blockW      = GetBlockWidth(psm);
+
+    uint32_t columnAddrs[32], shifts[32];
+    uint32_t index = 0;
+    for (uint32_t row = 0; row < h; row++) {
+        uint32_t py = (y + row) & kCoordMask;
+        for (uint32_t bx = 0; bx < blockW; bx++)
+            columnAddrs[bx] = GetColumnAddr(psm, bx, py, &shifts[bx]);
+
+        uint32_t blockAddr = 0;
+        for (uint32_t col = 0; col < w; col++, index++) {
+            uint32_t px = (x + col) & kCoordMask;
+            uint32_t bx = px & (blockW - 1);
+            if (col == 0 || bx == 0)
+                blockAddr = GetBlockAddr(psm, bp, bw, px, py) * 64;
+
+            uint32_t& word = Mem[blockAddr + columnAddrs[bx]];
+            uint32_t mask  = pixelMask << shifts[bx];
+            word           = (word & ~mask) | ((GetPacked(bytes, bits, index) << shifts[bx]) & mask);
+        }
+    }
+
+    uiNumPixelsWritten += w * h;
+}
+
+void CGsMemSim::Read(tPSM psm, uint32_t bp, uint32_t bw, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+    void* data) const
+{
+    uint8_t* bytes     = (uint8_t*)data;
+    uint32_t bits      = GetBitsPerPixel(psm);
+    uint32_t pixelMask = GetPixelMask(bits);
+    uint32_t blockW    = GetBlockWidth(psm);
+
+    uint32_t columnAddrs[32], shifts[32];
+    uint32_t index = 0;
+    for (uint32_t row = 0; row < h; row++) {
+        uint32_t py = (y + row) & kCoordMask;
+        for (uint32_t bx = 0; bx < blockW; bx++)
+            columnAddrs[bx] = GetColumnAddr(psm, bx, py, &shifts[bx]);
+
+        uint32_t blockAddr = 0;
+        for (uint32_t col = 0; col < w; col++, index++) {
+            uint32_t px = (x + col) & kCoordMask;
+            uint32_t bx = px & (blockW - 1);
+            if (col == 0 || bx == 0)
+                blockAddr = GetBlockAddr(psm, bp, bw, px, py) * 64;
+
+            SetPacked(bytes, bits, index, (Mem[blockAddr + columnAddrs[bx]] >> shifts[bx]) & pixelMask);
+        }
+    }
+}
+
+uint32_t
+CGsMemSim::GetPackedBytes(tPSM psm, uint32_t w, uint32_t h)
+{
+    return (w * h * GetBitsPerPixel(psm) + 7) / 8;
+}
+
+// the gif stream
+
+void CGsMemSim::Receive(tDmaChannelId channel, const uint128_t* data, uint32_t numQwords, bool isTag)
+{
+    if (!isTag)
+        Feed(data, numQwords);
+}
+
+void CGsMemSim::Feed(const uint128_t* qwords, uint32_t numQwords)
+{
+    const uint32_t* words = (const uint32_t*)qwords;
+    for (uint32_t i = 0; i < numQwords; i++)
+        FeedQword(words + i * 4);
+}
+
+void CGsMemSim::FeedQword(const uint32_t* words)
+{
+    if (pError)
+        return;
+
+    uint64_t lo = words[0] | ((uint64_t)words[1] << 32);
+    uint64_t hi = words[2] | ((uint64_t)words[3] << 32);
+
+    if (uiQwordsLeft == 0) {
+        // a giftag
+        uint32_t nloop = lo & 0x7fff;
+        uiFlag         = (lo >> 58) & 3;
+        uiNumRegs      = (lo >> 60) & 0xf;
+        if (uiNumRegs == 0)
+            uiNumRegs = 16;
+        ulRegs     = hi;
+        uiRegIndex = 0;
+
+        if (uiFlag == 0) // packed
+            uiQwordsLeft = nloop * uiNumRegs;
+        else if (uiFlag == 1) // reglist, a register per dword
+            uiQwordsLeft = (nloop * uiNumRegs + 1) / 2;
+        else // image
+            uiQwordsLeft = nloop;
+        return;
+    }
+
+    uiQwordsLeft--;
+    if (uiFlag == 0) {
+        uint32_t reg = (ulRegs >> (uiRegIndex * 4)) & 0xf;
+        if (reg == 0xe) // a+d
+            SetReg(hi & 0xff, lo);
+        uiRegIndex = (uiRegIndex + 1) % uiNumRegs;
+    } else if (uiFlag >= 2 && uiXferPixelsLeft > 0) {
+        // (image data with no transfer under way is dropped)
+        for (uint32_t i = 0; i < 4; i++)
+            TransferWord(words[i]);
+    }
+}
+
+void CGsMemSim::SetReg(uint32_t addr, uint64_t value)
+{
+    switch (addr) {
+    case RegAddrs::bitbltbuf:
+        ulBitbltbuf = value;
+        break;
+    case RegAddrs::trxpos:
+        ulTrxpos = value;
+        break;
+    case RegAddrs::trxreg:
+        ulTrxreg = value;
+        break;
+    case RegAddrs::trxdir:
+        // (local -> host isn't modeled)
+        if ((value & 3) == 0)
+            StartTransfer();
+        else if ((value & 3) == 2)
+            CopyLocal();
+        break;
+    }
+}
+
+void CGsMemSim::StartTransfer(void)
+{
+    uint32_t w = ulTrxreg & 0xfff, h = (ulTrxreg >> 32) & 0xfff;
+    uiXferX = uiXferY = 0;
+    uiXferPixelsLeft  = w * h;
+    ulXferBits        = 0;
+    uiXferNumBits     = 0;
+    uiNumTransfers++;
+}
+
+void CGsMemSim::TransferWord(uint32_t word)
+{
+    tPSM psm    = (tPSM)((ulBitbltbuf >> 56) & 0x3f);
+    uint32_t bp = (ulBitbltbuf >> 32) & 0x3fff;
+    uint32_t bw = (ulBitbltbuf >> 48) & 0x3f;
+    uint32_t dx = (ulTrxpos >> 32) & kCoordMask;
+    uint32_t dy = (ulTrxpos >> 48) & kCoordMask;
+    uint32_t w  = ulTrxreg & 0xfff;
+
+    if (!IsValidPsm(psm)) {
+        pError = "bad transfer pixel format";
+        return;
+    }
+    uint32_t bits = GetBitsPerPixel(psm);
+
+    ulXferBits |= (uint64_t)word << uiXferNumBits;
+    uiXferNumBits += 32;
+    while (uiXferNumBits >= bits && uiXferPixelsLeft > 0) {
+        WritePixel(psm, bp, bw, (dx + uiXferX) & kCoordMask, (dy + uiXferY) & kCoordMask,
+            ulXferBits & GetPixelMask(bits));
+        ulXferBits >>= bits;
+        uiXferNumBits -= bits;
+
+        if (++uiXferX == w) {
+            uiXferX = 0;
+            uiXferY++;
+        }
+        uiXferPixelsLeft--;
+    }
+
+    // the rest of the last qword is padding
+    if (uiXferPixelsLeft == 0) {
+        ulXferBits    = 0;
+        uiXferNumBits = 0;
+    }
+}
+
+void CGsMemSim::CopyLocal(void)
+{
+    tPSM srcPsm  = (tPSM)((ulBitbltbuf >> 24) & 0x3f);
+    uint32_t sbp = ulBitbltbuf & 0x3fff;
+    uint32_t sbw = (ulBitbltbuf >> 16) & 0x3f;
+    tPSM dstPsm  = (tPSM)((ulBitbltbuf >> 56) & 0x3f);
+    uint32_t dbp = (ulBitbltbuf >> 32) & 0x3fff;
+    uint32_t dbw = (ulBitbltbuf >> 48) & 0x3f;
+
+    uint32_t sx  = ulTrxpos & kCoordMask;
+    uint32_t sy  = (ulTrxpos >> 16) & kCoordMask;
+    uint32_t dx  = (ulTrxpos >> 32) & kCoordMask;
+    uint32_t dy  = (ulTrxpos >> 48) & kCoordMask;
+    uint32_t dir = (ulTrxpos >> 59) & 3;
+    uint32_t w = ulTrxreg & 0xfff, h = (ulTrxreg >> 32) & 0xfff;
+
+    if (!IsValidPsm(srcPsm) || !IsValidPsm(dstPsm)) {
+        pError = "bad transfer pixel format";
+        return;
+    }
+
+    // the direction matters when the two rectangles overlap:  bit 0 copies from
+    // the bottom up, bit 1 from right to left
+    for (uint32_t j = 0; j < h; j++) {
+        uint32_t row = (dir & 1) ? h - 1 - j : j;
+        for (uint32_t i = 0; i < w; i++) {
+            uint32_t col   = (dir & 2) ? w - 1 - i : i;
+            uint32_t pixel = ReadPixel(srcPsm, sbp, sbw, (sx + col) & kCoordMask, (sy + row) & kCoordMask);
+            WritePixel(dstPsm, dbp, dbw, (dx + col) & kCoordMask, (dy + row) & kCoordMask, pixel);
+        }
+    }
+    uiNumTransfers++;
+}
+
+void CGsMemSim::Print(void) const
+{
+    printf("gs mem: %d transfers, %d pixels written\n", uiNumTransfers, uiNumPixelsWritten);
+    printf("  bitbltbuf 0x%016llx trxpos 0x%016llx trxreg 0x%016llx\n",
+        (unsigned long long)ulBitbltbuf, (unsigned long long)ulTrxpos, (unsigned long long)ulTrxreg);
+    if (uiXferPixelsLeft > 0)
+        printf("  host -> local transfer under way, %d pixels left\n", uiXferPixelsLeft);
+    if (pError)
+        printf("  error: %s\n", pError);
+}
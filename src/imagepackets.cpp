@@ -13,7 +13,7 @@
  * CImageUploadPkt methods
  */
 
-#define kPacketLength 21
+#define kPacketLength 22
 
 CImageUploadPkt::CImageUploadPkt(void)
     : CVifSCDmaPacket(&FirstDmaTag, kPacketLength, DMAC::Channels::gif, Packet::kDontXferTags)
@@ -85,7 +85,7 @@ void CImageUploadPkt::BuildXferTags(void)
 
     // transfer the registers
     this->Cnt();
-    this->Nop().OpenDirect();
+    this->OpenDirect();
     pNext += 5 * 16;
     this->CloseDirect().CloseTag();
 
@@ -124,22 +124,23 @@ void CImageUploadPkt::BuildXferTags(void)
 
         // xfer giftag
         this->Cnt();
-        this->Nop().OpenDirect();
+        this->OpenDirect();
         *this += imageDataGifTag;
         this->CloseDirect();
         this->CloseTag();
 
-        if (numQuadsThisGT == numQuadsLeft)
-            this->Refe(&image[numQuadsInImage - numQuadsLeft], numQuadsThisGT, Packet::kNoIrq, imageOnSP);
-        else
-            this->Ref(&image[numQuadsInImage - numQuadsLeft], numQuadsThisGT, Packet::kNoIrq, imageOnSP);
+        this->Ref(&image[numQuadsInImage - numQuadsLeft], numQuadsThisGT, Packet::kNoIrq, imageOnSP);
 
-        // these will fit in the upper 64 bits after the dma tag (ref or refe)
-        this->Nop().OpenDirect().CloseDirect(numQuadsThisGT);
+        // these will fit in the upper 64 bits after the dma tag
+        this->OpenDirect().CloseDirect(numQuadsThisGT);
 
         numQuadsLeft -= numQuadsThisGT;
     }
 
+    // end with a ret so that the chain can be called; sent on its own, the ret ends the transfer
+    this->Ret();
+    this->CloseTag();
+
     // see comment above this function
     SetTTE(false);
 }
@@ -148,22 +149,39 @@ void CImageUploadPkt::Send(CSCDmaPacket& packet)
 {
     mErrorIf(packet.GetTTE(), "Only vif source chain packets can use this class to xfer images with tte on.");
 
-    uint128_t* thisPktCopy = packet.Add((CDmaPacket&)*this);
-
-    // change the last refe in the copy to a ref
-    tSourceChainTag* lastRefe = reinterpret_cast<tSourceChainTag*>(thisPktCopy + this->GetByteLength() / 16 - 1);
-    mErrorIf(lastRefe->ID != DMAC::kRefe, "Something ain't right..");
-    lastRefe->ID = DMAC::kRef;
+    if (!packet.CallIfPossible(GetBase()))
+        CopyInto(packet);
 }
 
 void CImageUploadPkt::Send(CVifSCDmaPacket& packet)
 {
     mErrorIf(!packet.GetTTE(), "Vif source chains need to turn tte on to xfer images with this class.");
 
-    uint128_t* thisPktCopy = packet.Add((CDmaPacket&)*this);
+    if (!packet.CallIfPossible(GetBase()))
+        CopyInto(packet);
+}
 
-    // change the last refe in the copy to a ref
-    tSourceChainTag* lastRefe = reinterpret_cast<tSourceChainTag*>(thisPktCopy + this->GetByteLength() / 16 - 1);
-    mErrorIf(lastRefe->ID != DMAC::kRefe, "Something ain't right..");
-    lastRefe->ID = DMAC::kRef;
+void CImageUploadPkt::CopyInto(CSCDmaPacket& packet)
+{
+    // copy everything but the final ret
+    uint32_t numQuads        = this->GetByteLength() / 16 - 1;
+    tSourceChainTag* lastTag = reinterpret_cast<tSourceChainTag*>(GetBase() + numQuads);
+    mErrorIf(lastTag->ID != DMAC::kRet, "Something ain't right..");
+
+    mErrorIf(packet.HasOpenTag(), "The image chain can't be copied into an open tag.");
+
+    // the tags have to start on a qword, not in the upper half of the last one
+    packet.FillTTE();
+
+    // A chunked packet can be split between two tags but not in the middle of a
+    // cnt's data, so copy one tag at a time.
+    const uint128_t* next = GetBase();
+    const uint128_t* end  = GetBase() + numQuads;
+    while (next < end) {
+        const tSourceChainTag* tag = reinterpret_cast<const tSourceChainTag*>(next);
+        uint32_t tagQuads          = (tag->ID == DMAC::kCnt) ? tag->QWC + 1 : 1;
+        packet.EnsureRoom(tagQuads * 16);
+        ((CDmaPacket&)packet).Add(next, tagQuads);
+        next += tagQuads;
+    }
 }
@@ -10,12 +10,16 @@
 
 #include <malloc.h>
 #include <stdio.h>
+#include <string.h>
 
+#ifdef _EE
 #include "kernel.h"
+#endif
 
-#include "ps2s/gs.h"
-#include "ps2s/math.h"
+#include "ps2s/chainverify.h"
+#include "ps2s/dmastats.h"
 #include "ps2s/packet.h"
+#include "ps2s/packetpool.h"
 
 /********************************************
  * DmaPacket
@@ -24,12 +28,13 @@
 CDmaPacket::CDmaPacket(uint128_t* buffer, uint32_t bufferQWSize, tDmaChannelId channel, uint32_t memMapping, bool isFull)
     : pBase((uint8_t*)buffer)
     , pNext((uint8_t*)((isFull) ? buffer + bufferQWSize : buffer))
+    , pBufferEnd((uint8_t*)(buffer + bufferQWSize))
     , dmaChannelId(channel)
     , uiBufferQwordSize(bufferQWSize)
     , bDeallocateBuffer(false)
 {
     // PLIN
-    mErrorIf(memMapping == Core::MemMappings::Uncached || ((memMapping == Core::MemMappings::UncachedAccl) && ((uint32_t)buffer & (64 - 1))),
+    mErrorIf(memMapping == Core::MemMappings::Uncached || ((memMapping == Core::MemMappings::UncachedAccl) && ((uintptr_t)buffer & (64 - 1))),
         "Dma buffer should be aligned on a cache line (64-byte boundary) when using the uncached mem mappings!");
     mErrorIf((memMapping == Core::MemMappings::Uncached || memMapping == Core::MemMappings::UncachedAccl) && bufferQWSize & (4 - 1),
         "Dma buffer size should be a whole number of cache lines (64 bytes = 4 quads) when using the uncached mem mappings!");
@@ -46,6 +51,7 @@ CDmaPacket::CDmaPacket(uint32_t bufferQWSize, tDmaChannelId channel, uint32_t me
 
     pBase = pNext = (uint8_t*)AllocBuffer(bufferQWSize, memMapping);
     mAssert(pBase != NULL);
+    pBufferEnd = pBase + bufferQWSize * 16;
 }
 
 CDmaPacket::~CDmaPacket()
@@ -59,11 +65,11 @@ void* CDmaPacket::AllocBuffer(int numQwords, unsigned int memMapping)
     // an alignment of 64 bytes is strictly only necessary for uncached or uncached accl mem mappings, but
     // it ain't a bad idea in general..
     uint32_t alignment = 64;
-    void* mem      = (void*)((uint32_t)memalign(alignment, numQwords * 16) | memMapping);
+    void* mem      = (void*)((uintptr_t)memalign(alignment, numQwords * 16) | memMapping);
     // I hate to do this, but I've wasted FAR too much time hunting down cache incoherency
     if (memMapping == Core::MemMappings::Uncached || memMapping == Core::MemMappings::UncachedAccl) {
         // PLIN
-        FlushCache(0);
+        CDmaBackend::Get().FlushCache();
     }
     return mem;
 }
@@ -72,42 +78,48 @@ void* CDmaPacket::SwapOutBuffer(void* newBuffer)
 {
     void* oldBuffer = (void*)pBase;
     pBase           = (uint8_t*)newBuffer;
+    pBufferEnd      = pBase + uiBufferQwordSize * 16;
     return oldBuffer;
 }
 
-#define mCheckPktLength() mErrorIf((uint32_t)pNext & 0xf, "You don't really want to send a packet that isn't an even number of quads, do you?")
+#define mCheckPktLength() mErrorIf((uintptr_t)pNext & 0xf, "You don't really want to send a packet that isn't an even number of quads, do you?")
 
-void CDmaPacket::Send(bool waitForEnd, bool flushCache)
+CDmaFence
+CDmaPacket::Send(bool waitForEnd, bool flushCache)
 {
     mCheckPktLength();
 
-    uint32_t pktQWLength = ((uint32_t)pNext - (uint32_t)pBase) / 16;
+    uint32_t pktQWLength = GetByteLength() / 16;
     mAssert(pktQWLength != 0);
 
     // dma_channel_send_normal always flushes the data cache
     //if (flushCache)
     //    FlushCache(0);
 
-    // clear any memory mappings (this won't work for sp)
-    dma_channel_wait(dmaChannelId, 1000000);
-    dma_channel_send_normal(dmaChannelId, (void*)((uint32_t)pBase & 0x0fffffff), pktQWLength, 0, 0);
+    CDmaBackend& dmac = CDmaBackend::Get();
+    DmaStats::Wait(dmac, dmaChannelId);
+    DmaStats::RecordNormal(dmaChannelId, pktQWLength);
+    CDmaFence fence = CDmaFence::BeginSend(dmaChannelId);
+    dmac.SendNormal(dmaChannelId, pBase, pktQWLength);
+    CDmaFence::EndSend(fence);
 
     if (waitForEnd)
-        dma_channel_wait(dmaChannelId, 1000000);
+        fence.Wait();
+    return fence;
 }
 
 void CDmaPacket::HexDump(uint32_t numQwords)
 {
     if (numQwords == 0)
-        numQwords = ((uint32_t)pNext - (uint32_t)pBase) / 16;
+        numQwords = GetByteLength() / 16;
 
-    printf("dumping %ld words (%ld qwords)\n", ((uint32_t)pNext - (uint32_t)pBase) / 4, numQwords);
+    printf("dumping %lu words (%lu qwords)\n", (unsigned long)GetByteLength() / 4, (unsigned long)numQwords);
 
     uint32_t i = 0;
     for (uint32_t *nextWord = (uint32_t*)pBase; nextWord != (uint32_t*)pNext; nextWord++, i++) {
         if ((i % 4) == 0)
-            printf("\n0x%08lx:  ", (uint32_t)nextWord);
-        printf("0x%08lx ", *nextWord);
+            printf("\n0x%08lx:  ", (unsigned long)(uintptr_t)nextWord);
+        printf("0x%08lx ", (unsigned long)*nextWord);
         if (i / 4 == numQwords)
             break;
     }
@@ -124,11 +136,17 @@ void CDmaPacket::Print(void)
  * Source Chain DmaPacket
  */
 
+bool CSCDmaPacket::bVerifyOnSend = true;
+
 CSCDmaPacket::CSCDmaPacket(uint32_t bufferQWSize, tDmaChannelId channel, bool tte, uint32_t memMapping)
     : CDmaPacket(bufferQWSize, channel, memMapping)
     , bTTE(tte)
     , pOpenTag(NULL)
     , uiTTEBytesLeft(0)
+    , EmbedMode(Packet::kEmbedCopy)
+    , uiCallDepth(0)
+    , pChunkPool(NULL)
+    , pChunkLimit(NULL)
 {
 }
 
@@ -137,26 +155,180 @@ CSCDmaPacket::CSCDmaPacket(uint128_t* buffer, uint32_t bufferQWSize, tDmaChannel
     , bTTE(tte)
     , pOpenTag(NULL)
     , uiTTEBytesLeft(0)
+    , EmbedMode(Packet::kEmbedCopy)
+    , uiCallDepth(0)
+    , pChunkPool(NULL)
+    , pChunkLimit(NULL)
+{
+}
+
+CSCDmaPacket::CSCDmaPacket(CPacketChunkPool& pool, tDmaChannelId channel, bool tte)
+    : CDmaPacket(pool.Get(), pool.GetChunkQWSize(), channel, pool.GetMemMapping())
+    , bTTE(tte)
+    , pOpenTag(NULL)
+    , uiTTEBytesLeft(0)
+    , EmbedMode(Packet::kEmbedCopy)
+    , uiCallDepth(0)
+    , pChunkPool(&pool)
+{
+    tPacketChunk firstChunk = { GetBase() };
+    Chunks.push_back(firstChunk);
+    pChunkLimit = pBufferEnd - 16;
+}
+
+CSCDmaPacket::~CSCDmaPacket(void)
+{
+    if (pChunkPool)
+        LastSend.Wait();
+    for (uint32_t i = 0; i < Chunks.size(); i++)
+        pChunkPool->Release(Chunks[i].Qwords);
+}
+
+void CSCDmaPacket::Reset(void)
+{
+    if (pChunkPool) {
+        // The chunks go back to a pool other packets draw from, so the dmac must be
+        // done reading them first.  (The first chunk is kept, so it's up to the
+        // caller as for any other packet.)
+        if (Chunks.size() > 1)
+            LastSend.Wait();
+
+        // hang on to the first chunk
+        for (uint32_t i = 1; i < Chunks.size(); i++)
+            pChunkPool->Release(Chunks[i].Qwords);
+        Chunks.resize(1);
+        ChunkLengths.clear();
+
+        pBufferEnd  = pBase + uiBufferQwordSize * 16;
+        pChunkLimit = pBufferEnd - 16;
+    }
+
+    uiCallDepth    = 0;
+    uiTTEBytesLeft = 0;
+    CDmaPacket::Reset();
+}
+
+bool CSCDmaPacket::CallIfPossible(const void* chain, uint32_t chainCallDepth)
+{
+    if (EmbedMode != Packet::kEmbedCall || chainCallDepth + 1 > DMAC::kMaxCallDepth)
+        return false;
+
+    // (with tte on, closing it nops out the upper half)
+    Call(Core::MakePtrNormal(chain));
+    CloseTag();
+    AddCallDepth(chainCallDepth);
+
+    return true;
+}
+
+void CSCDmaPacket::HexDump(uint32_t numQwords)
+{
+    if (numQwords == 0)
+        numQwords = GetByteLength() / 16;
+
+    printf("dumping %lu chunk(s) (%lu qwords)\n", (unsigned long)GetNumChunks(), (unsigned long)numQwords);
+
+    for (uint32_t chunk = 0; chunk < GetNumChunks() && numQwords > 0; chunk++) {
+        uint32_t chunkQwords = (GetChunkByteLength(chunk) + 15) / 16;
+        if (chunkQwords > numQwords)
+            chunkQwords = numQwords;
+        printf("\nchunk %lu:\n", (unsigned long)chunk);
+        Utils::QwordHexDump((uint32_t*)GetChunk(chunk), chunkQwords);
+        numQwords -= chunkQwords;
+    }
+
+    printf("\n");
+}
+
+void CSCDmaPacket::NextChunk(void)
 {
+    LinkNewChunk();
+
+    // the vif would take the upper half of the tag as vifcodes
+    FillTTE();
+}
+
+void CSCDmaPacket::LinkNewChunk(void)
+{
+    mErrorIf(pChunkPool == NULL, "Not enough space in packet!");
+    mErrorIf(((uintptr_t)pNext & 0xf) != 0, "Chunked packets can only be split on qword boundaries.");
+
+    uint128_t* newChunk        = pChunkPool->Get();
+    const uint128_t* chunkAddr = Core::MakePtrNormal(newChunk);
+
+    // The open tag becomes a Next to the new chunk, and the new chunk starts with a copy of it
+    // to take the rest of the data.  This works for any tag that counts its qwords.  If nothing
+    // is open, link with an empty Next in the qword kept free at the end of the chunk.
+    tDmaTag carriedTag;
+    bool carryTag = (pOpenTag != NULL);
+    if (carryTag) {
+        carriedTag = *pOpenTag;
+        // any interrupt should go with the last of the data
+        SetDmaTag(pOpenTag, 0, carriedTag.PCE, DMAC::kNext, false, chunkAddr, false);
+        CloseTag();
+    } else {
+        tDmaTag* link = (tDmaTag*)pNext;
+        SetDmaTag(link, 0, 0, DMAC::kNext, false, chunkAddr, false);
+        link->opt1 = link->opt2 = 0;
+        pNext += 16;
+    }
+    mAssert(pNext <= pBufferEnd);
+
+    ChunkLengths.push_back((uintptr_t)pNext - (uintptr_t)Chunks.back().Qwords);
+    tPacketChunk chunk = { newChunk };
+    Chunks.push_back(chunk);
+
+    pNext       = (uint8_t*)newChunk;
+    pBufferEnd  = pNext + uiBufferQwordSize * 16;
+    pChunkLimit = pBufferEnd - 16;
+
+    if (carryTag) {
+        const uint128_t* addr = (carriedTag.ID == DMAC::kNext || carriedTag.ID == DMAC::kCall)
+            ? (const uint128_t*)DMAC::GetTagPtr(carriedTag.ADDR)
+            : NULL;
+        AddDmaTag(countQWC, carriedTag.PCE, carriedTag.ID, carriedTag.IRQ, addr, carriedTag.SPR);
+    }
 }
 
-void CSCDmaPacket::Send(bool waitForEnd, bool flushCache)
+CDmaFence
+CSCDmaPacket::Send(bool waitForEnd, bool flushCache)
 {
     mCheckPktLength();
 
     // make sure we haven't forgotten to close the last dma tag
     mAssert(pOpenTag == NULL);
+    // (a ref at the end might not have used its upper half)
+    FillTTE();
+
+#ifdef _DEBUG
+    // a bad chain hangs the dmac without saying why, so catch it here
+    if (bVerifyOnSend) {
+        CDmaChainVerifier verifier;
+        if (!verifier.Verify(*this)) {
+            verifier.Print();
+            mError("This dma chain would hang or corrupt the dmac.");
+        }
+    }
+#endif
+
+    CDmaBackend& dmac = CDmaBackend::Get();
 
     // dma_channel_send_chain does NOT flush all data that is "source chained"
     if (flushCache)
-        FlushCache(0);
+        dmac.FlushCache();
 
-    // clear any memory mappings (this won't work for sp)
-    dma_channel_wait(dmaChannelId, 1000000);
-    dma_channel_send_chain(dmaChannelId, (void*)((uint32_t)pBase & 0x0fffffff), 0, bTTE ? DMA_FLAG_TRANSFERTAG : 0, 0);
+    DmaStats::Wait(dmac, dmaChannelId);
+    // (walk the chain for the stats before the fence is handed out, so that the
+    // fence isn't outstanding for any longer than the send itself)
+    DmaStats::RecordChain(dmaChannelId, pBase, bTTE);
+    CDmaFence fence = CDmaFence::BeginSend(dmaChannelId);
+    dmac.SendChain(dmaChannelId, pBase, bTTE);
+    CDmaFence::EndSend(fence);
+    LastSend = fence;
 
     if (waitForEnd)
-        dma_channel_wait(dmaChannelId, 1000000);
+        fence.Wait();
+    return fence;
 }
 
 /********************************************
@@ -166,6 +338,7 @@ void CSCDmaPacket::Send(bool waitForEnd, bool flushCache)
 CVifSCDmaPacket::CVifSCDmaPacket(uint32_t bufferQWSize, tDmaChannelId channel, bool tte, uint32_t memMapping)
     : CSCDmaPacket(bufferQWSize, channel, tte, memMapping)
     , pOpenVifCode(NULL)
+    , uiOpenVifCodeCarried(0)
     , uiWL(1)
     , uiCL(1)
 {
@@ -175,9 +348,98 @@ CVifSCDmaPacket::CVifSCDmaPacket(uint128_t* buffer, uint32_t bufferQWSize, tDmaC
     uint32_t memMapping, bool isFull)
     : CSCDmaPacket(buffer, bufferQWSize, channel, tte, memMapping, isFull)
     , pOpenVifCode(NULL)
+    , uiOpenVifCodeCarried(0)
+    , uiWL(1)
+    , uiCL(1)
 {
 }
 
+CVifSCDmaPacket::CVifSCDmaPacket(CPacketChunkPool& pool, tDmaChannelId channel, bool tte)
+    : CSCDmaPacket(pool, channel, tte)
+    , pOpenVifCode(NULL)
+    , uiOpenVifCodeCarried(0)
+    , uiWL(1)
+    , uiCL(1)
+{
+}
+
+bool CVifSCDmaPacket::CallIfPossible(const void* chain, uint32_t chainCallDepth)
+{
+    mAssert(pOpenVifCode == NULL);
+    return bTTE && CSCDmaPacket::CallIfPossible(chain, chainCallDepth);
+}
+
+void CVifSCDmaPacket::NextChunk(void)
+{
+    // data that doesn't make up a whole qword (direct) or a whole write cycle (unpack)
+    // has to move to the next chunk.  That's less than one cycle of the widest
+    // unpack (v4-32) with the largest write length.
+    static const uint32_t kMaxCarryBytes = 16 * 256;
+    uint8_t carry[kMaxCarryBytes];
+    uint32_t numCarryBytes = 0;
+
+    Vifs::tVifCode reopen;
+    bool reopenVifCode = (pOpenVifCode != NULL);
+    if (reopenVifCode) {
+        reopen = *pOpenVifCode;
+
+        uint32_t numBytes = (uintptr_t)pNext - (uintptr_t)pOpenVifCode - 4;
+        uint32_t numQuads;
+        if ((reopen.cmd & 0x7f) == Vifs::Opcodes::direct) {
+            numCarryBytes = numBytes & 0xf;
+            numQuads      = numBytes / 16;
+        } else {
+            mAssert((reopen.cmd & 0x60) == 0x60);
+            uint32_t vn        = (reopen.cmd & 0xc) >> 2;
+            uint32_t vl        = reopen.cmd & 0x3;
+            uint32_t vecBytes  = (vl == 3) ? 2 : (vn + 1) * (4 >> vl);
+            // split on whole write cycles so that the next unpack starts a fresh one
+            uint32_t blockVecs = (uiWL < uiCL) ? uiWL : uiCL;
+            uint32_t blockAddr = (uiWL < uiCL) ? uiCL : uiWL;
+            uint32_t numBlocks = numBytes / (vecBytes * blockVecs);
+            numCarryBytes      = numBytes - numBlocks * vecBytes * blockVecs;
+            numQuads           = numBlocks * uiWL;
+            mAssert(numQuads <= 256);
+
+            uint32_t vuAddr  = ((reopen.immediate & 0x3ff) + numBlocks * blockAddr) & 0x3ff;
+            reopen.immediate = (reopen.immediate & ~0x3ff) | vuAddr;
+        }
+        mErrorIf(numCarryBytes > sizeof(carry), "Too much unpack data left over to carry to the next chunk.");
+
+        memcpy(carry, pNext - numCarryBytes, numCarryBytes);
+        pNext -= numCarryBytes;
+
+        // close what we have, or drop the vifcode if nothing made it (0 means 256 or 65536)
+        if (numQuads == 0)
+            pNext = (uint8_t*)pOpenVifCode;
+        else if ((reopen.cmd & 0x7f) == Vifs::Opcodes::direct)
+            pOpenVifCode->immediate = numQuads;
+        else
+            pOpenVifCode->num = (numQuads == 256) ? 0 : numQuads;
+        uiOpenVifCodeCarried += numQuads;
+        pOpenVifCode = NULL;
+
+        // unpack data ends on a word boundary
+        while ((uintptr_t)pNext & 0x3)
+            *pNext++ = 0;
+    }
+
+    Pad128();
+    LinkNewChunk();
+
+    if (reopenVifCode) {
+        if ((reopen.cmd & 0x7f) == Vifs::Opcodes::direct) {
+            reopen.immediate = 0;
+            Pad96();
+        } else
+            reopen.num = 0;
+
+        pOpenVifCode = (Vifs::tVifCode*)pNext;
+        *this += reopen;
+        Add(carry, numCarryBytes);
+    }
+}
+
 CVifSCDmaPacket&
 CVifSCDmaPacket::CloseUnpack(void)
 {
@@ -189,9 +451,14 @@ CVifSCDmaPacket::CloseUnpack(void)
     // qwords ACTUALLY WRITTEN to vu memory (it does not count quads that are skipped in
     // "skipping write" mode.)  But first forget about skipping/filling writes and compute the number
     // of qwords that the data in this packet will expand to.
-    uint32_t numBytes         = (uint32_t)pNext - (uint32_t)pOpenVifCode - 4;
+    uint32_t numBytes         = (uintptr_t)pNext - (uintptr_t)pOpenVifCode - 4;
     uint32_t numBytesPerBlock = 4 >> vl;
     uint32_t numBlocksPerQuad = vn + 1;
+    // v4_5 packs a whole quad into 16 bits
+    if (vl == 3) {
+        numBytesPerBlock = 2;
+        numBlocksPerQuad = 1;
+    }
     // make sure that the data length is a multiple of 8, 16, or 32 bits, whichever is appropriate
     mAssert((numBytes & (numBytesPerBlock - 1)) == 0);
     uint32_t numQuads = (numBytes / numBytesPerBlock) / numBlocksPerQuad;
@@ -213,7 +480,8 @@ CVifSCDmaPacket::CloseUnpack(void)
         numQuads           = numWLBlocks * uiWL + lastBlockQuads;
     }
 
-    return CloseUnpack(numQuads);
+    // (in a chunked packet this only counts the data in the current chunk)
+    return CloseUnpack(numQuads + uiOpenVifCodeCarried);
 }
 
 #undef mCheckPktLength
@@ -0,0 +1,73 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdlib.h>
+
+#include "ps2s/debug.h"
+#include "ps2s/packet.h"
+#include "ps2s/packetpool.h"
+
+/********************************************
+ * PacketChunkPool
+ */
+
+CPacketChunkPool::CPacketChunkPool(uint32_t chunkQWSize, uint32_t numPrealloc, uint32_t memMapping)
+    : uiChunkQWSize(chunkQWSize)
+    , uiMemMapping(memMapping)
+    , uiMaxInUse(0)
+{
+    // a chunk needs room for a tag, some vif padding, and the link to the next chunk
+    // with some space left over for data
+    mErrorIf(chunkQWSize < 4, "Packet chunks need to be at least 4 quads.");
+    mErrorIf((memMapping == Core::MemMappings::Uncached || memMapping == Core::MemMappings::UncachedAccl) && chunkQWSize & (4 - 1),
+        "Chunk size should be a whole number of cache lines (64 bytes = 4 quads) when using the uncached mem mappings!");
+
+    for (uint32_t i = 0; i < numPrealloc; i++) {
+        tPacketChunk chunk = { (uint128_t*)CDmaPacket::AllocBuffer(uiChunkQWSize, uiMemMapping) };
+        mAssert(chunk.Qwords != NULL);
+        AllChunks.push_back(chunk);
+        FreeChunks.push_back(chunk);
+    }
+}
+
+CPacketChunkPool::~CPacketChunkPool(void)
+{
+    mErrorIf(GetNumInUse() != 0, "Destroying a chunk pool that still has chunks in use.");
+
+    for (uint32_t i = 0; i < AllChunks.size(); i++)
+        free(Core::MakePtrNormal(AllChunks[i].Qwords));
+}
+
+uint128_t*
+CPacketChunkPool::Get(void)
+{
+    tPacketChunk chunk;
+    if (FreeChunks.empty()) {
+        chunk.Qwords = (uint128_t*)CDmaPacket::AllocBuffer(uiChunkQWSize, uiMemMapping);
+        mAssert(chunk.Qwords != NULL);
+        AllChunks.push_back(chunk);
+    } else {
+        chunk = FreeChunks.back();
+        FreeChunks.pop_back();
+    }
+
+    if (GetNumInUse() > uiMaxInUse)
+        uiMaxInUse = GetNumInUse();
+
+    return chunk.Qwords;
+}
+
+void CPacketChunkPool::Release(uint128_t* qwords)
+{
+    mAssert(qwords != NULL);
+    mAssert(FreeChunks.size() < AllChunks.size());
+    tPacketChunk chunk = { qwords };
+    FreeChunks.push_back(chunk);
+}
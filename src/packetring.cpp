@@ -0,0 +1,94 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include "ps2s/debug.h"
+#include "ps2s/dmabackend.h"
+#include "ps2s/dmastats.h"
+#include "ps2s/packetring.h"
+
+/********************************************
+ * PacketRing
+ */
+
+CPacketRing::CPacketRing(uint32_t numFrames, uint32_t frameQWSize, tDmaChannelId channel, bool tte, uint32_t memMapping)
+    : uiNumFrames(numFrames)
+    , uiCurFrame(numFrames - 1)
+    , dmaChannelId(channel)
+    , uiStallCycles(0)
+    , uiNumStalls(0)
+{
+    mErrorIf(numFrames == 0, "A packet ring needs at least one frame.");
+
+    Frames      = new CVifSCDmaPacket*[numFrames];
+    FrameFences = new CDmaFence[numFrames];
+    for (uint32_t i = 0; i < numFrames; i++)
+        Frames[i] = new CVifSCDmaPacket(frameQWSize, channel, tte, memMapping);
+}
+
+CPacketRing::~CPacketRing(void)
+{
+    // don't pull the buffers out from under the dmac
+    for (uint32_t i = 0; i < uiNumFrames; i++)
+        WaitForFence(FrameFences[i]);
+
+    for (uint32_t i = 0; i < uiNumFrames; i++)
+        delete Frames[i];
+    delete[] Frames;
+    delete[] FrameFences;
+}
+
+static inline uint32_t
+GetCycles(void)
+{
+#ifdef _EE
+    return Core::GetCount();
+#else
+    return 0;
+#endif
+}
+
+void CPacketRing::WaitForFence(const CDmaFence& fence)
+{
+    if (!fence.IsDone()) {
+        uint32_t start = GetCycles();
+        CDmaBackend::Get().Wait(dmaChannelId);
+        uint32_t numCycles = GetCycles() - start;
+        uiStallCycles += numCycles;
+        uiNumStalls++;
+        DmaStats::AddWaitCycles(dmaChannelId, numCycles);
+        fence.Wait();
+    }
+}
+
+CVifSCDmaPacket&
+CPacketRing::BeginFrame(void)
+{
+    uiCurFrame = (uiCurFrame + 1) % uiNumFrames;
+
+    // sends on a channel are serialized, so every frame but the last one kicked
+    // has passed its fence, and this only stalls with a one-frame ring or when a
+    // frame is begun twice without a kick
+    WaitForFence(FrameFences[uiCurFrame]);
+
+    CVifSCDmaPacket& frame = *Frames[uiCurFrame];
+    frame.Reset();
+    return frame;
+}
+
+CDmaFence
+CPacketRing::Kick(bool flushCache)
+{
+    // wait here rather than in Send() so that the stall is counted (the last
+    // frame kicked is the only one that can still be in flight)
+    WaitForFence(FrameFences[(uiCurFrame + uiNumFrames - 1) % uiNumFrames]);
+
+    FrameFences[uiCurFrame] = Frames[uiCurFrame]->Send(Packet::kDontWait, flushCache);
+    return FrameFences[uiCurFrame];
+}
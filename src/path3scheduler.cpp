@@ -0,0 +1,177 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <string.h>
+
+#include "ps2s/core.h"
+#include "ps2s/debug.h"
+#include "ps2s/gs.h"
+#include "ps2s/imagepackets.h"
+#include "ps2s/packet.h"
+#include "ps2s/path3scheduler.h"
+
+/********************************************
+ * Path3Scheduler
+ */
+
+// limited by the NLOOP field
+static const uint32_t kMaxSliceQwords = (1 << 15) - 1;
+
+CPath3Scheduler::CPath3Scheduler(uint32_t sliceQwords)
+    : pVifPacket(NULL)
+    , pGifPacket(NULL)
+    , uiSliceQwords(sliceQwords)
+    , bMasked(false)
+    , bWaited(false)
+    , uiNumPendingBytes(0)
+{
+    mErrorIf(sliceQwords == 0 || sliceQwords > kMaxSliceQwords, "Slices are 1 to %d qwords.", kMaxSliceQwords);
+    memset(&Frame, 0, sizeof(Frame));
+    memset(&LastFrame, 0, sizeof(LastFrame));
+}
+
+void CPath3Scheduler::SetMask(bool masked)
+{
+    if (masked != bMasked) {
+        pVifPacket->Mskpath3((masked) ? 1 : 0);
+        bMasked = masked;
+    }
+}
+
+void CPath3Scheduler::BeginFrame(CVifSCDmaPacket& vifPacket, CSCDmaPacket& gifPacket)
+{
+    mErrorIf(gifPacket.GetTTE(), "The gif channel doesn't take tte.");
+
+    pVifPacket        = &vifPacket;
+    pGifPacket        = &gifPacket;
+    bWaited           = false;
+    uiNumPendingBytes = 0;
+    memset(&Frame, 0, sizeof(Frame));
+
+    // (whatever the last frame left, the vif packet starts by masking)
+    pVifPacket->Mskpath3(1);
+    bMasked = true;
+}
+
+const CPath3Scheduler::tFrameStats&
+CPath3Scheduler::EndFrame(void)
+{
+    mAssert(pVifPacket != NULL);
+    SetMask(false);
+
+    LastFrame  = Frame;
+    pVifPacket = NULL;
+    pGifPacket = NULL;
+    return LastFrame;
+}
+
+void CPath3Scheduler::AddUpload(const CClutUploadPkt& upload)
+{
+    AddUpload((const CImageUploadPkt&)upload);
+}
+
+void CPath3Scheduler::AddUpload(const CImageUploadPkt& upload)
+{
+    mAssert(pGifPacket != NULL);
+    CSCDmaPacket& gif = *pGifPacket;
+
+    // the transfer settings, as CImageUploadPkt sends them
+    tGifTag settingsTag = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    settingsTag.NLOOP   = 4;
+    settingsTag.EOP     = 1;
+    settingsTag.FLG     = 0; // packed
+    settingsTag.NREG    = 1;
+    settingsTag.REGS0   = 0xe;
+
+    gif.Cnt();
+    gif += settingsTag;
+    gif += upload.gsrBitBltBuf;
+    gif += (uint64_t)GS::RegAddrs::bitbltbuf;
+    gif += upload.gsrTrxPos;
+    gif += (uint64_t)GS::RegAddrs::trxpos;
+    gif += upload.gsrTrxReg;
+    gif += (uint64_t)GS::RegAddrs::trxreg;
+    gif += upload.gsrTrxDir;
+    gif += (uint64_t)GS::RegAddrs::trxdir;
+    gif.CloseTag();
+
+    uint128_t* image = upload.pImage;
+    mAssert(image != NULL);
+    bool imageOnSP = (((uintptr_t)image & 0xf0000000) == Core::MemMappings::SP);
+    if (imageOnSP)
+        image = (uint128_t*)((uintptr_t)image & 0x3ff0);
+
+    uint32_t numBytes = upload.gsrTrxReg.trans_w * upload.gsrTrxReg.trans_h
+        * GS::GetBitsPerPixel((GS::tPSM)upload.gsrBitBltBuf.dest_pixmode) / 8;
+    uint32_t numQuads = (numBytes + 15) / 16;
+
+    // every slice is a gif packet of its own, so that path3 can be stopped between them
+    for (uint32_t done = 0; done < numQuads;) {
+        uint32_t numInSlice = numQuads - done;
+        if (numInSlice > uiSliceQwords)
+            numInSlice = uiSliceQwords;
+
+        tGifTag imageTag = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+        imageTag.FLG     = 2; // image mode
+        imageTag.NLOOP   = numInSlice;
+        imageTag.EOP     = 1;
+
+        gif.Cnt();
+        gif += imageTag;
+        gif.CloseTag();
+        gif.Ref(&image[done], numInSlice, Packet::kNoIrq, imageOnSP);
+
+        done += numInSlice;
+    }
+
+    Frame.NumUploads++;
+    Frame.NumUploadBytes += numQuads * 16;
+    // (after a FLUSHA these have already gone with it)
+    if (!bWaited)
+        uiNumPendingBytes += numQuads * 16;
+}
+
+void CPath3Scheduler::VuBusy(uint32_t vuCycles)
+{
+    mAssert(pVifPacket != NULL);
+    if (uiNumPendingBytes == 0)
+        return;
+
+    if (bMasked)
+        Frame.NumWindows++;
+    SetMask(false);
+
+    uint32_t numBytes = vuCycles * kBytesPerVuCycle;
+    if (numBytes > uiNumPendingBytes)
+        numBytes = uiNumPendingBytes;
+    Frame.NumOverlappedBytes += numBytes;
+    uiNumPendingBytes -= numBytes;
+}
+
+void CPath3Scheduler::CloseWindow(void)
+{
+    mAssert(pVifPacket != NULL);
+    SetMask(true);
+}
+
+void CPath3Scheduler::WaitForUploads(void)
+{
+    mAssert(pVifPacket != NULL);
+    if (Frame.NumUploads == 0 || bWaited)
+        return;
+
+    SetMask(false);
+    pVifPacket->Flusha();
+    SetMask(true);
+
+    Frame.NumWaits++;
+    uiNumPendingBytes = 0;
+    bWaited           = true;
+}
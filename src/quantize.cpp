@@ -0,0 +1,442 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <string.h>
+
+#if !defined(_EE) && defined(__SSE2__)
+#include <emmintrin.h>
+#define QUANTIZE_SSE2
+#endif
+
+// (not tied to NO_ASM, which the makefile always sets for the vu0 code in
+// cpu_vector.h; see quantize.h)
+#if !defined(_EE)
+#undef QUANTIZE_VU0
+#endif
+
+#include "ps2s/debug.h"
+#include "ps2s/packet.h"
+#include "ps2s/quantize.h"
+#include "ps2s/vif.h"
+
+/********************************************
+ * Quantize
+ */
+
+namespace Quantize {
+
+// Every path computes x * Scale + Offset, clamps it to [Lo, Hi] and truncates.
+// Offset includes 0.5 (for the rounding) and a shift that keeps the result
+// positive, so that truncation rounds the same way for every value.  The
+// shifts are multiples of 2^bits, so the ee can take the low bits without
+// subtracting them.
+typedef struct {
+    float Scale[4] __attribute__((aligned(16)));
+    float Offset[4] __attribute__((aligned(16)));
+    float Lo[4] __attribute__((aligned(16)));
+    float Hi[4] __attribute__((aligned(16)));
+} tLanes;
+
+typedef struct {
+    uint32_t NumBytes;
+    int32_t Lo, Hi, Shift;
+} tFormatInfo;
+
+static const tFormatInfo FormatInfos[] = {
+    { 2, -32768, 32767, 65536 }, // kS16
+    { 2, 0, 65535, 0 },          // kU16
+    { 1, -128, 127, 256 },       // kS8
+    { 1, 0, 255, 0 }             // kU8
+};
+
+// with 3 components the lane pattern repeats every 3 vectors, otherwise every vector
+static const uint32_t kMaxLanePeriod = 3;
+
+static inline uint32_t
+GetLanePeriod(uint32_t numComponents)
+{
+    return (numComponents == 3) ? 3 : 1;
+}
+
+// lanes for the vectors starting at element firstElement of a packed stream
+static void
+BuildLanes(tLanes* lanes, const tQuantizer& quantizer, uint32_t numComponents, tFormat format, uint32_t firstElement)
+{
+    const tFormatInfo& info = FormatInfos[format];
+    for (uint32_t k = 0; k < kMaxLanePeriod; k++) {
+        for (uint32_t j = 0; j < 4; j++) {
+            uint32_t component  = (firstElement + k * 4 + j) % numComponents;
+            float scale         = quantizer.Scale[component];
+            lanes[k].Scale[j]   = scale;
+            lanes[k].Offset[j]  = -quantizer.Bias[component] * scale + (float)info.Shift + 0.5f;
+            lanes[k].Lo[j]      = (float)(info.Lo + info.Shift) + 0.5f;
+            lanes[k].Hi[j]      = (float)(info.Hi + info.Shift) + 0.5f;
+        }
+    }
+}
+
+static inline int32_t
+QuantizeScalar(float x, const tLanes& lanes, uint32_t lane, int32_t shift)
+{
+    float v = x * lanes.Scale[lane] + lanes.Offset[lane];
+    if (v < lanes.Lo[lane])
+        v = lanes.Lo[lane];
+    if (v > lanes.Hi[lane])
+        v = lanes.Hi[lane];
+    return (int32_t)v - shift;
+}
+
+static inline void
+StoreScalar(uint8_t* dest, int32_t value, uint32_t numBytes)
+{
+    if (numBytes == 2) {
+        uint16_t half = (uint16_t)value;
+        memcpy(dest, &half, 2);
+    } else
+        *dest = (uint8_t)value;
+}
+
+/********************************************
+ * vector paths -- each converts blocks of 4 vectors (16 floats) of a packed
+ * stream and returns how many vectors it did
+ */
+
+#if defined(QUANTIZE_VU0)
+
+// one vector through vu0 (the source needn't be aligned)
+static inline uint128_t
+QuantizeVecEE(const float* src, const tLanes* lanes)
+{
+    uint128_t result, lo, hi;
+    asm volatile(
+        "ldl		%[lo], 7(%[src])	\n"
+        "ldr		%[lo], 0(%[src])	\n"
+        "ldl		%[hi], 15(%[src])	\n"
+        "ldr		%[hi], 8(%[src])	\n"
+        "pcpyld		%[result], %[hi], %[lo]	\n"
+        "qmtc2		%[result], $vf1		\n"
+        "lqc2		$vf2, 0(%[lanes])	\n"
+        "lqc2		$vf3, 16(%[lanes])	\n"
+        "lqc2		$vf4, 32(%[lanes])	\n"
+        "lqc2		$vf5, 48(%[lanes])	\n"
+        "vmul.xyzw	$vf1, $vf1, $vf2	\n"
+        "vadd.xyzw	$vf1, $vf1, $vf3	\n"
+        "vmax.xyzw	$vf1, $vf1, $vf4	\n"
+        "vmini.xyzw	$vf1, $vf1, $vf5	\n"
+        "vftoi0.xyzw	$vf1, $vf1		\n"
+        "qmfc2		%[result], $vf1		\n"
+        : [result] "=&r"(result), [lo] "=&r"(lo), [hi] "=&r"(hi)
+        : [src] "r"(src), [lanes] "r"(lanes)
+        : "$vf1", "$vf2", "$vf3", "$vf4", "$vf5", "memory");
+    return result;
+}
+
+// the low halfwords of high and low, low's first
+static inline uint128_t
+PackHalves(uint128_t high, uint128_t low)
+{
+    uint128_t result;
+    asm("ppach	%0, %1, %2	\n"
+        : "=r"(result)
+        : "r"(high), "r"(low));
+    return result;
+}
+
+static inline uint128_t
+PackBytes(uint128_t high, uint128_t low)
+{
+    uint128_t result;
+    asm("ppacb	%0, %1, %2	\n"
+        : "=r"(result)
+        : "r"(high), "r"(low));
+    return result;
+}
+
+// the packet only keeps words aligned
+static inline void
+StoreUnaligned(uint8_t* dest, uint128_t value)
+{
+    uint128_t upper;
+    asm volatile(
+        "pcpyud		%[upper], %[value], %[value]	\n"
+        "sdl		%[value], 7(%[dest])		\n"
+        "sdr		%[value], 0(%[dest])		\n"
+        "sdl		%[upper], 15(%[dest])		\n"
+        "sdr		%[upper], 8(%[dest])		\n"
+        : [upper] "=&r"(upper)
+        : [value] "r"(value), [dest] "r"(dest)
+        : "memory");
+}
+
+static uint32_t
+QuantizeVectors(uint8_t* dest, const float* src, uint32_t numVecs, const tLanes* lanes, uint32_t period, tFormat format)
+{
+    uint32_t numBlocks = numVecs / 4;
+    uint32_t lane      = 0;
+    for (uint32_t b = 0; b < numBlocks; b++) {
+        uint128_t v[4];
+        for (uint32_t i = 0; i < 4; i++) {
+            v[i] = QuantizeVecEE(src + i * 4, &lanes[lane]);
+            if (++lane == period)
+                lane = 0;
+        }
+        src += 16;
+
+        uint128_t low = PackHalves(v[1], v[0]), high = PackHalves(v[3], v[2]);
+        if (FormatInfos[format].NumBytes == 2) {
+            StoreUnaligned(dest, low);
+            StoreUnaligned(dest + 16, high);
+            dest += 32;
+        } else {
+            StoreUnaligned(dest, PackBytes(high, low));
+            dest += 16;
+        }
+    }
+    return numBlocks * 4;
+}
+
+static inline void
+QuantizeVec(const float* src, const tLanes& lanes, int32_t shift, int32_t* result)
+{
+    uint128_t ints = QuantizeVecEE(src, &lanes);
+    memcpy(result, &ints, 16);
+    for (uint32_t i = 0; i < 4; i++)
+        result[i] -= shift;
+}
+
+#elif defined(QUANTIZE_SSE2)
+
+static inline __m128i
+QuantizeVecSSE(const float* src, const tLanes& lanes, __m128i shift)
+{
+    __m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src), _mm_load_ps(lanes.Scale)), _mm_load_ps(lanes.Offset));
+    v        = _mm_min_ps(_mm_max_ps(v, _mm_load_ps(lanes.Lo)), _mm_load_ps(lanes.Hi));
+    return _mm_sub_epi32(_mm_cvttps_epi32(v), shift);
+}
+
+static uint32_t
+QuantizeVectors(uint8_t* dest, const float* src, uint32_t numVecs, const tLanes* lanes, uint32_t period, tFormat format)
+{
+    const __m128i shift = _mm_set1_epi32(FormatInfos[format].Shift);
+    // there's no unsigned 32 to 16 bit pack in sse2, so kU16 goes through a signed one
+    const __m128i half = _mm_set1_epi32(32768), flip = _mm_set1_epi16((short)0x8000);
+
+    uint32_t numBlocks = numVecs / 4;
+    uint32_t lane      = 0;
+    for (uint32_t b = 0; b < numBlocks; b++) {
+        __m128i v[4];
+        for (uint32_t i = 0; i < 4; i++) {
+            v[i] = QuantizeVecSSE(src + i * 4, lanes[lane], shift);
+            if (++lane == period)
+                lane = 0;
+        }
+        src += 16;
+
+        switch (format) {
+        case kS16:
+            _mm_storeu_si128((__m128i*)dest, _mm_packs_epi32(v[0], v[1]));
+            _mm_storeu_si128((__m128i*)(dest + 16), _mm_packs_epi32(v[2], v[3]));
+            dest += 32;
+            break;
+        case kU16:
+            _mm_storeu_si128((__m128i*)dest,
+                _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(v[0], half), _mm_sub_epi32(v[1], half)), flip));
+            _mm_storeu_si128((__m128i*)(dest + 16),
+                _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(v[2], half), _mm_sub_epi32(v[3], half)), flip));
+            dest += 32;
+            break;
+        case kS8:
+            _mm_storeu_si128((__m128i*)dest,
+                _mm_packs_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3])));
+            dest += 16;
+            break;
+        case kU8:
+            _mm_storeu_si128((__m128i*)dest,
+                _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3])));
+            dest += 16;
+            break;
+        }
+    }
+    return numBlocks * 4;
+}
+
+static inline void
+QuantizeVec(const float* src, const tLanes& lanes, int32_t shift, int32_t* result)
+{
+    _mm_storeu_si128((__m128i*)result, QuantizeVecSSE(src, lanes, _mm_set1_epi32(shift)));
+}
+
+#else
+
+static uint32_t
+QuantizeVectors(uint8_t* dest, const float* src, uint32_t numVecs, const tLanes* lanes, uint32_t period, tFormat format)
+{
+    return 0;
+}
+
+static inline void
+QuantizeVec(const float* src, const tLanes& lanes, int32_t shift, int32_t* result)
+{
+    for (uint32_t i = 0; i < 4; i++)
+        result[i] = QuantizeScalar(src[i], lanes, i, shift);
+}
+
+#endif
+
+/********************************************
+ * quantizers
+ */
+
+void SetQuantizer(tQuantizer& quantizer, float scale, float bias)
+{
+    for (uint32_t i = 0; i < 4; i++) {
+        quantizer.Scale[i] = scale;
+        quantizer.Bias[i]  = bias;
+    }
+}
+
+void FitQuantizer(tQuantizer& quantizer, const float* minValues, const float* maxValues,
+    uint32_t numComponents, tFormat format)
+{
+    mAssert(numComponents > 0 && numComponents <= 4);
+    const tFormatInfo& info = FormatInfos[format];
+
+    SetQuantizer(quantizer, 1.0f);
+    for (uint32_t i = 0; i < numComponents; i++) {
+        float range = maxValues[i] - minValues[i];
+        float scale = (range > 0.0f) ? (float)(info.Hi - info.Lo) / range : 1.0f;
+        // minValues[i] maps to the bottom of the format
+        quantizer.Scale[i] = scale;
+        quantizer.Bias[i]  = minValues[i] - (float)info.Lo / scale;
+    }
+}
+
+void GetDecode(const tQuantizer& quantizer, float* decodeScale, float* decodeBias)
+{
+    for (uint32_t i = 0; i < 4; i++) {
+        decodeScale[i] = 1.0f / quantizer.Scale[i];
+        decodeBias[i]  = quantizer.Bias[i];
+    }
+}
+
+void FoldIntoMatrix(const tQuantizer& quantizer, float* matrix)
+{
+    // M * (S * p + b) = (M * S) * p + M * b, for the first three components (w is
+    // the homogeneous 1)
+    for (uint32_t col = 0; col < 3; col++) {
+        for (uint32_t row = 0; row < 4; row++) {
+            matrix[12 + row] += matrix[col * 4 + row] * quantizer.Bias[col];
+            matrix[col * 4 + row] /= quantizer.Scale[col];
+        }
+    }
+}
+
+uint32_t
+GetNumBytes(tFormat format)
+{
+    return FormatInfos[format].NumBytes;
+}
+
+bool IsUnsigned(tFormat format)
+{
+    return format == kU16 || format == kU8;
+}
+
+uint32_t
+GetUnpackMode(tFormat format, uint32_t numComponents)
+{
+    mAssert(numComponents > 0 && numComponents <= 4);
+    return ((numComponents - 1) << 2) | ((FormatInfos[format].NumBytes == 2) ? 1 : 2);
+}
+
+/********************************************
+ * conversion
+ */
+
+void Convert(void* dest, tFormat format, const float* src, uint32_t numVertices, uint32_t numComponents,
+    const tQuantizer& quantizer, uint32_t srcStride)
+{
+    mAssert(numComponents > 0 && numComponents <= 4);
+
+    const tFormatInfo& info = FormatInfos[format];
+    uint8_t* out            = (uint8_t*)dest;
+    tLanes lanes[kMaxLanePeriod];
+    BuildLanes(lanes, quantizer, numComponents, format, 0);
+
+    if (srcStride == 0 || srcStride == numComponents) {
+        // a packed stream: the vector path takes the whole blocks, and the
+        // leftovers are done here
+        uint32_t numElements = numVertices * numComponents;
+        uint32_t period      = GetLanePeriod(numComponents);
+        uint32_t numDone     = QuantizeVectors(out, src, numElements / 4, lanes, period, format) * 4;
+
+        out += numDone * info.NumBytes;
+        for (uint32_t e = numDone; e < numElements; e++) {
+            StoreScalar(out, QuantizeScalar(src[e], lanes[(e / 4) % period], e % 4, info.Shift), info.NumBytes);
+            out += info.NumBytes;
+        }
+    } else if (numComponents == 4) {
+        for (uint32_t v = 0; v < numVertices; v++, src += srcStride) {
+            int32_t values[4];
+            QuantizeVec(src, lanes[0], info.Shift, values);
+            for (uint32_t i = 0; i < 4; i++, out += info.NumBytes)
+                StoreScalar(out, values[i], info.NumBytes);
+        }
+    } else {
+        for (uint32_t v = 0; v < numVertices; v++, src += srcStride) {
+            for (uint32_t i = 0; i < numComponents; i++, out += info.NumBytes)
+                StoreScalar(out, QuantizeScalar(src[i], lanes[0], i, info.Shift), info.NumBytes);
+        }
+    }
+}
+
+void ConvertRgba5551(uint16_t* dest, const float* src, uint32_t numVertices, float colorMax, uint32_t srcStride)
+{
+    if (srcStride == 0)
+        srcStride = 4;
+
+    // 5 bits of color, and 1 of alpha
+    tQuantizer quantizer;
+    SetQuantizer(quantizer, 31.0f / colorMax);
+    quantizer.Scale[3] = 1.0f / colorMax;
+    tLanes lanes[kMaxLanePeriod];
+    BuildLanes(lanes, quantizer, 4, kU8, 0);
+    lanes[0].Hi[0] = lanes[0].Hi[1] = lanes[0].Hi[2] = 31.5f;
+    lanes[0].Hi[3]                                   = 1.5f;
+
+    for (uint32_t v = 0; v < numVertices; v++, src += srcStride) {
+        int32_t values[4];
+        QuantizeVec(src, lanes[0], 0, values);
+        uint16_t color = values[0] | (values[1] << 5) | (values[2] << 10) | (values[3] << 15);
+        memcpy(dest++, &color, 2);
+    }
+}
+
+void AddToUnpack(CVifSCDmaPacket& packet, tFormat format, const float* src, uint32_t numVertices,
+    uint32_t numComponents, const tQuantizer& quantizer, uint32_t srcStride)
+{
+    uint32_t numBytes  = numVertices * numComponents * FormatInfos[format].NumBytes;
+    uint32_t numPadded = (numBytes + 3) & ~3;
+    uint8_t* dest      = packet.Reserve(numPadded);
+    Convert(dest, format, src, numVertices, numComponents, quantizer, srcStride);
+    memset(dest + numBytes, 0, numPadded - numBytes);
+}
+
+void AddRgba5551ToUnpack(CVifSCDmaPacket& packet, const float* src, uint32_t numVertices,
+    float colorMax, uint32_t srcStride)
+{
+    uint32_t numBytes  = numVertices * 2;
+    uint32_t numPadded = (numBytes + 3) & ~3;
+    uint8_t* dest      = packet.Reserve(numPadded);
+    ConvertRgba5551((uint16_t*)dest, src, numVertices, colorMax, srcStride);
+    memset(dest + numBytes, 0, numPadded - numBytes);
+}
+
+} // namespace Quantize
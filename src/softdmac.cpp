@@ -0,0 +1,193 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <string.h>
+
+#include "ps2s/debug.h"
+#include "ps2s/softdmac.h"
+
+/********************************************
+ * DmaCountingSink
+ */
+
+void CDmaCountingSink::Receive(tDmaChannelId channel, const uint128_t* data, uint32_t numQwords, bool isTag)
+{
+    if (isTag)
+        uiNumTagQwords += numQwords;
+    else
+        uiNumQwords += numQwords;
+
+    const uint32_t* words = (const uint32_t*)data;
+    for (uint32_t i = 0; i < numQwords * 4; i += 4)
+        uiChecksum += words[i] ^ words[i + 1] ^ words[i + 2] ^ words[i + 3];
+}
+
+/********************************************
+ * SoftDmac
+ */
+
+CSoftDmac::CSoftDmac(void)
+    : pScratchpad((uint8_t*)LocalScratchpad)
+    , uiMaxTags(1 << 20)
+    , pError(NULL)
+    , uiNumTags(0)
+    , uiNumQwords(0)
+    , uiNumTransfers(0)
+{
+    for (uint32_t i = 0; i < kNumChannels; i++)
+        Sinks[i] = NULL;
+    memset(LocalScratchpad, 0, sizeof(LocalScratchpad));
+}
+
+void CSoftDmac::SetSink(tDmaChannelId channel, CDmaSink* sink)
+{
+    mAssert((uint32_t)channel < kNumChannels);
+    Sinks[channel] = sink;
+}
+
+void CSoftDmac::DecodeTag(const tDmaTag& tag, uint32_t tagAddr, tTagStep& step)
+{
+    uint32_t afterTag = tagAddr + 16;
+
+    step.DataQWC     = tag.QWC;
+    step.DataFromSpr = false;
+    step.Push = step.Pop = step.Last = false;
+
+    switch (tag.ID) {
+    case DMAC::kCnt:
+        step.DataAddr    = afterTag;
+        step.NextTagAddr = afterTag + tag.QWC * 16;
+        break;
+    case DMAC::kNext:
+        step.DataAddr    = afterTag;
+        step.NextTagAddr = tag.ADDR;
+        break;
+    case DMAC::kRef:
+    case DMAC::kRefs:
+        step.DataAddr    = tag.ADDR;
+        step.DataFromSpr = tag.SPR;
+        step.NextTagAddr = afterTag;
+        break;
+    case DMAC::kRefe:
+        step.DataAddr    = tag.ADDR;
+        step.DataFromSpr = tag.SPR;
+        step.NextTagAddr = afterTag;
+        step.Last        = true;
+        break;
+    case DMAC::kCall:
+        // the address pushed is that of the qword after the data
+        step.DataAddr    = afterTag;
+        step.NextTagAddr = tag.ADDR;
+        step.Push        = true;
+        break;
+    case DMAC::kRet:
+        step.DataAddr    = afterTag;
+        step.NextTagAddr = 0;
+        step.Pop         = true;
+        break;
+    case DMAC::kEnd:
+        step.DataAddr    = afterTag;
+        step.NextTagAddr = afterTag + tag.QWC * 16;
+        step.Last        = true;
+        break;
+    }
+}
+
+const uint128_t*
+CSoftDmac::GetDataPtr(uint32_t addr, bool fromSpr) const
+{
+    if (fromSpr)
+        return (const uint128_t*)(pScratchpad + (addr & (kScratchpadSize - 16)));
+    else
+        return (const uint128_t*)DMAC::GetTagPtr(addr);
+}
+
+inline void
+CSoftDmac::Transfer(tDmaChannelId channel, const uint128_t* data, uint32_t numQwords, bool isTag)
+{
+    if (numQwords == 0)
+        return;
+    if (!isTag)
+        uiNumQwords += numQwords;
+    if (Sinks[channel])
+        Sinks[channel]->Receive(channel, data, numQwords, isTag);
+}
+
+void CSoftDmac::SendNormal(tDmaChannelId channel, const void* data, uint32_t numQwords)
+{
+    mErrorIf((uintptr_t)data & 0xf, "Dma data must be qword aligned.");
+    uiNumTransfers++;
+    Transfer(channel, (const uint128_t*)data, numQwords, false);
+}
+
+void CSoftDmac::SendChain(tDmaChannelId channel, const void* firstTag, bool tte)
+{
+    if (!WalkChain(channel, firstTag, tte)) {
+        mError("Soft dmac: %s", pError);
+    }
+}
+
+bool CSoftDmac::WalkChain(tDmaChannelId channel, const void* firstTag, bool tte)
+{
+    mAssert((uint32_t)channel < kNumChannels);
+
+    uint32_t addrStack[DMAC::kMaxCallDepth];
+    uint32_t stackDepth = 0;
+    uint32_t tagAddr    = DMAC::MakeTagAddr(firstTag);
+    uint32_t numTags    = 0;
+    tTagStep step;
+
+    pError = NULL;
+    uiNumTransfers++;
+
+    while (true) {
+        if (tagAddr & 0xf) {
+            pError = "tag address is not qword aligned";
+            return false;
+        }
+        if (++numTags > uiMaxTags) {
+            pError = "too many tags; the chain probably loops";
+            return false;
+        }
+
+        const tDmaTag* tag = (const tDmaTag*)DMAC::GetTagPtr(tagAddr);
+        DecodeTag(*tag, tagAddr, step);
+        uiNumTags++;
+
+        if (tte)
+            Transfer(channel, (const uint128_t*)tag, 1, true);
+
+        if ((step.DataAddr & 0xf) && step.DataQWC > 0) {
+            pError = "data address is not qword aligned";
+            return false;
+        }
+        Transfer(channel, GetDataPtr(step.DataAddr, step.DataFromSpr), step.DataQWC, false);
+
+        if (step.Push) {
+            if (stackDepth == DMAC::kMaxCallDepth) {
+                pError = "call with a full address stack";
+                return false;
+            }
+            addrStack[stackDepth++] = step.DataAddr + step.DataQWC * 16;
+        } else if (step.Pop) {
+            // a ret with nothing on the stack ends the transfer
+            if (stackDepth == 0)
+                break;
+            step.NextTagAddr = addrStack[--stackDepth];
+        }
+
+        if (step.Last)
+            break;
+
+        tagAddr = step.NextTagAddr;
+    }
+
+    return true;
+}
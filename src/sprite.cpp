@@ -21,6 +21,17 @@ CSprite::CSprite(GS::tContext context, uint32_t minX, uint32_t minY, uint32_t wi
 {
     GS::tPrim prim;
 
+    // a ret so that the sprite can be called from other chains
+    DrawDmaTag.QWC  = 6;
+    DrawDmaTag.PCE  = 0;
+    DrawDmaTag.ID   = DMAC::kRet;
+    DrawDmaTag.IRQ  = 0;
+    DrawDmaTag.ADDR = 0;
+    DrawDmaTag.SPR  = 0;
+    // for calls from vif1 chains with tte on
+    DrawDmaTag.opt1 = 0; // vif nop
+    DrawDmaTag.opt2 = (Vifs::Opcodes::direct << 24) | 6;
+
     DrawGifTag.NLOOP = 1;
     DrawGifTag.EOP   = 1;
     DrawGifTag.PRE   = 1; // enable prim
@@ -117,6 +128,9 @@ void CSprite::SetUVsFix4(uint16_t minU, uint16_t minV, uint16_t maxU, uint16_t m
 
 void CSprite::Draw(CSCDmaPacket& packet)
 {
+    if (packet.CallIfPossible(&DrawDmaTag))
+        return;
+
     packet.Cnt();
     packet.Add((uint128_t*)&DrawGifTag, 6);
     packet.CloseTag();
@@ -124,15 +138,11 @@ void CSprite::Draw(CSCDmaPacket& packet)
 
 void CSprite::Draw(CVifSCDmaPacket& packet)
 {
+    if (packet.CallIfPossible(&DrawDmaTag))
+        return;
+
     packet.Cnt();
     {
-        // the data needs to be qword-aligned, so pad with appropriate # of vifnops to
-        // put the direct vifcode at the end of a qword
-        packet.Nop();
-        if (!packet.GetTTE()) {
-            packet.Nop().Nop();
-        }
-
         packet.OpenDirect();
         packet.Add((uint128_t*)&DrawGifTag, 6);
         packet.CloseDirect();
@@ -15,6 +15,7 @@
 
 #include "ps2s/core.h"
 #include "ps2s/gs.h"
+#include "ps2s/gsmem.h"
 #include "ps2s/imagepackets.h"
 #include "ps2s/math.h"
 #include "ps2s/texture.h"
@@ -66,13 +67,17 @@ void CTexEnv::InitCommon(GS::tContext context)
 
     uiTexPixelWidth = uiTexPixelHeight = 0;
 
-    // set up the settings xfer dma tag
+    // set up the settings xfer dma tag.  It's a ret so that the settings can be called
+    // from other chains (and a ret with nothing on the call stack ends the transfer)
     SettingsDmaTag.QWC  = uiNumSettingsGSRegs + 1; // num regs + 1 giftag
     SettingsDmaTag.PCE  = 0;
-    SettingsDmaTag.ID   = DMAC::kEnd;
+    SettingsDmaTag.ID   = DMAC::kRet;
     SettingsDmaTag.IRQ  = 0; // no irq
     SettingsDmaTag.ADDR = 0; // no next tag
     SettingsDmaTag.SPR  = 0; // not from sp
+    // for calls from vif1 chains with tte on
+    SettingsDmaTag.opt1 = 0; // vif nop
+    SettingsDmaTag.opt2 = (Vifs::Opcodes::direct << 24) | (uiNumSettingsGSRegs + 1);
 
     // setup the texturing settings gif tag
     SettingsGifTag.NLOOP = uiNumSettingsGSRegs;
@@ -150,6 +155,16 @@ void CTexEnv::SetClutGsAddr(uint32_t gsMemWordAddress)
     gsrTex0.cb_addr = gsMemWordAddress / 64;
 }
 
+void CTexEnv::ImageAreaMoved(GS::CMemArea& area, void* texEnv)
+{
+    ((CTexEnv*)texEnv)->SetImageGsAddr(area.GetWordAddr());
+}
+
+void CTexEnv::ClutAreaMoved(GS::CMemArea& area, void* texEnv)
+{
+    ((CTexEnv*)texEnv)->SetClutGsAddr(area.GetWordAddr());
+}
+
 void CTexEnv::SetContext(GS::tContext context)
 {
     // set the context-dependent registers
@@ -171,6 +186,9 @@ void CTexEnv::SendSettings(bool waitForEnd, bool flushCache)
 
 void CTexEnv::SendSettings(CSCDmaPacket& packet)
 {
+    if (packet.CallIfPossible(&SettingsDmaTag))
+        return;
+
     packet.Cnt();
     packet.Add((uint128_t*)&SettingsGifTag, uiNumSettingsGSRegs + 1);
     packet.CloseTag();
@@ -178,15 +196,11 @@ void CTexEnv::SendSettings(CSCDmaPacket& packet)
 
 void CTexEnv::SendSettings(CVifSCDmaPacket& packet)
 {
+    if (packet.CallIfPossible(&SettingsDmaTag))
+        return;
+
     packet.Cnt();
     {
-        // the data needs to be qword-aligned, so pad with appropriate # of vifnops to
-        // put the direct vifcode at the end of a qword
-        packet.Nop();
-        if (!packet.GetTTE()) {
-            packet.Nop().Nop();
-        }
-
         packet.OpenDirect();
         packet.Add((uint128_t*)&SettingsGifTag, uiNumSettingsGSRegs + 1);
         packet.CloseDirect();
@@ -9,3 +9,50 @@
  */
 
 #include "ps2s/utils.h"
+
+/********************************************
+ * bulk qword copies
+ */
+
+// how far ahead of the copy to prefetch, in qwords (two cache lines)
+static const uint32_t kPrefetchAhead = 8;
+
+// Copies a cache line (4 qwords) per iteration, loading the whole line before
+// storing any of it so the loads and stores pair up.  Prefetches past the end
+// of the source or destination are harmless (pref doesn't fault).
+static inline void
+CopyLines(uint128_t* dest, const uint128_t* src, uint32_t numQwords, bool prefetchDest)
+{
+    mAssert(((uintptr_t)dest & 0xf) == 0 && ((uintptr_t)src & 0xf) == 0);
+
+    uint32_t numLines = numQwords / 4;
+    while (numLines-- > 0) {
+        __builtin_prefetch(src + kPrefetchAhead, 0);
+        if (prefetchDest)
+            __builtin_prefetch(dest + kPrefetchAhead, 1);
+
+        uint128_t q0 = src[0], q1 = src[1], q2 = src[2], q3 = src[3];
+        dest[0] = q0;
+        dest[1] = q1;
+        dest[2] = q2;
+        dest[3] = q3;
+        src += 4;
+        dest += 4;
+    }
+
+    numQwords &= 4 - 1;
+    while (numQwords-- > 0)
+        *(dest++) = *(src++);
+}
+
+void Utils::MemCpy128Cached(uint128_t* dest, const uint128_t* src, uint32_t numQwords)
+{
+    CopyLines(dest, src, numQwords, true);
+}
+
+void Utils::MemCpy128UncachedAccl(uint128_t* dest, const uint128_t* src, uint32_t numQwords)
+{
+    // the uncached accelerated buffer merges sequential stores itself, so only
+    // keep the source coming
+    CopyLines(dest, src, numQwords, false);
+}
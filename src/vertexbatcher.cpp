@@ -0,0 +1,147 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include "ps2s/debug.h"
+#include "ps2s/packet.h"
+#include "ps2s/vertexbatcher.h"
+#include "ps2s/vertexformat.h"
+#include "ps2s/vif.h"
+
+/********************************************
+ * VertexBatcher
+ */
+
+// vu1 data memory
+static const uint32_t kDataMemQwords = 1024;
+// itop is 10 bits
+static const uint32_t kMaxItop = 0x3ff;
+
+CVertexBatcher::CVertexBatcher(const CUnpackPlan& plan, uint32_t base, uint32_t bufferQwords)
+    : pPlan(&plan)
+    , pUploader(NULL)
+{
+    Init(plan.GetVertexQwords(), base, bufferQwords);
+}
+
+CVertexBatcher::CVertexBatcher(CVertexUploader& uploader, uint32_t base, uint32_t bufferQwords)
+    : pPlan(NULL)
+    , pUploader(&uploader)
+{
+    Init(uploader.GetVertexQwords(), base, bufferQwords);
+}
+
+void CVertexBatcher::Init(uint32_t vertexQwords, uint32_t base, uint32_t bufferQwords)
+{
+    mErrorIf(base + bufferQwords * 2 > kDataMemQwords, "The double buffer doesn't fit in vu1 memory.");
+    mErrorIf(bufferQwords < vertexQwords, "A vertex doesn't fit in the buffer.");
+
+    uiVertexQwords  = vertexQwords;
+    uiBase          = base;
+    uiBufferQwords  = bufferQwords;
+    pHeader         = NULL;
+    uiHeaderQwords  = 0;
+    uiBatchMultiple = 1;
+    uiOverlap       = 0;
+    uiProgramAddr   = 0;
+    bContinue       = false;
+}
+
+void CVertexBatcher::SetHeader(const void* header, uint32_t numQwords)
+{
+    mErrorIf(numQwords + uiVertexQwords > uiBufferQwords, "No room for vertices after the header.");
+    pHeader        = header;
+    uiHeaderQwords = (header) ? numQwords : 0;
+}
+
+void CVertexBatcher::SetBatchMultiple(uint32_t batchMultiple)
+{
+    mErrorIf(batchMultiple == 0, "Batches have to be a multiple of at least 1.");
+    uiBatchMultiple = batchMultiple;
+}
+
+void CVertexBatcher::SetOverlap(uint32_t numVertices)
+{
+    uiOverlap = numVertices;
+}
+
+uint32_t
+CVertexBatcher::GetMaxBatchVertices(void) const
+{
+    uint32_t maxVertices = (uiBufferQwords - uiHeaderQwords) / uiVertexQwords;
+    if (maxVertices > kMaxItop)
+        maxVertices = kMaxItop;
+    return maxVertices - maxVertices % uiBatchMultiple;
+}
+
+uint32_t
+CVertexBatcher::GetNumBatches(uint32_t numVertices) const
+{
+    uint32_t maxVertices = GetMaxBatchVertices();
+    if (numVertices <= maxVertices)
+        return (numVertices) ? 1 : 0;
+    // every batch after the first only adds maxVertices - overlap new vertices
+    uint32_t step = maxVertices - uiOverlap;
+    return 1 + (numVertices - maxVertices + step - 1) / step;
+}
+
+void CVertexBatcher::Emit(CVifSCDmaPacket& packet, uint32_t numVertices, uint32_t firstVertex, bool setBuffers)
+{
+    uint32_t maxVertices = GetMaxBatchVertices();
+    mErrorIf(maxVertices == 0, "Not even a batch multiple fits in the buffer.");
+    mErrorIf(uiOverlap >= maxVertices, "The overlap has to be smaller than a batch.");
+
+    if (numVertices == 0)
+        return;
+
+    if (setBuffers) {
+        // (writing OFFSET also resets the double buffer to start at BASE)
+        packet.Flushe();
+        packet.Base(uiBase);
+        packet.Offset(uiBufferQwords);
+    }
+
+    bool first = true;
+    for (uint32_t done = 0;;) {
+        uint32_t numInBatch = numVertices - done;
+        if (numInBatch > maxVertices)
+            numInBatch = maxVertices;
+
+        packet.Itop(numInBatch);
+
+        if (uiHeaderQwords > 0) {
+            // the header can't be split across write cycles, so unpack it with 1,1
+            packet.Stcycl(1, 1);
+            for (uint32_t q = 0; q < uiHeaderQwords;) {
+                uint32_t numQwords = uiHeaderQwords - q;
+                if (numQwords > 256)
+                    numQwords = 256;
+                packet.OpenUnpack(Vifs::UnpackModes::v4_32, q, true);
+                packet.Add((const uint32_t*)pHeader + q * 4, numQwords * 4);
+                packet.CloseUnpack(numQwords);
+                q += numQwords;
+            }
+        }
+
+        if (pPlan)
+            pPlan->Emit(packet, uiHeaderQwords, firstVertex + done, numInBatch, true);
+        else
+            pUploader->Upload(packet, uiHeaderQwords, firstVertex + done, numInBatch, true);
+
+        if (first || !bContinue)
+            packet.Mscal(uiProgramAddr);
+        else
+            packet.Mscnt();
+        first = false;
+
+        if (done + numInBatch == numVertices)
+            break;
+        done += numInBatch - uiOverlap;
+    }
+}
@@ -0,0 +1,646 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ps2s/debug.h"
+#include "ps2s/packet.h"
+#include "ps2s/vertexformat.h"
+#include "ps2s/vif.h"
+
+/********************************************
+ * VertexLayout
+ */
+
+CVertexLayout::CVertexLayout(uint32_t vertexQwords)
+    : uiVertexQwords(vertexQwords)
+{
+    mErrorIf(vertexQwords == 0, "A vertex has to take up at least one quad.");
+}
+
+uint32_t
+CVertexLayout::AddAttribute(tSourceType type, uint32_t numComponents, uint32_t vuOffset)
+{
+    mErrorIf(numComponents == 0 || numComponents > 4, "An attribute has 1 to 4 components.");
+    mErrorIf(type == kRgba5551 && numComponents != 4, "5551 colors have 4 components.");
+    mErrorIf(vuOffset >= uiVertexQwords, "Attribute offset %d is outside the vertex.", vuOffset);
+
+    tAttribute attribute;
+    memset(&attribute, 0, sizeof(attribute));
+    attribute.SourceType    = type;
+    attribute.NumComponents = numComponents;
+    attribute.VuOffset      = vuOffset;
+    Attributes.push_back(attribute);
+    return Attributes.size() - 1;
+}
+
+uint32_t
+CVertexLayout::AddConstant(const void* value, uint32_t vuOffset)
+{
+    uint32_t attribute = AddAttribute(kUInt8, 1, vuOffset);
+    Attributes[attribute].IsConstant = true;
+    memcpy(Attributes[attribute].Constant, value, sizeof(Attributes[attribute].Constant));
+    return attribute;
+}
+
+void CVertexLayout::SetRowComponents(uint32_t attribute, uint32_t numComponents, const void* values)
+{
+    mAssert(attribute < Attributes.size());
+    tAttribute& attrib = Attributes[attribute];
+    mErrorIf(attrib.IsConstant, "Constant attributes are all row already.");
+    mErrorIf(attrib.SourceType == kRgba5551 && numComponents > 0, "5551 colors can't be split.");
+    mErrorIf(numComponents >= attrib.NumComponents, "At least one component has to be sent (use a constant).");
+
+    attrib.NumRowComponents = numComponents;
+    memcpy(attrib.Constant, values, sizeof(attrib.Constant));
+}
+
+/********************************************
+ * UnpackPlan
+ */
+
+// the largest unpack Emit() builds (256 quads written, at most a quad of data each)
+static const uint32_t kMaxUnpackBytes = 256 * 16;
+
+static inline uint32_t
+GetComponentBytes(CVertexLayout::tSourceType type)
+{
+    switch (type) {
+    case CVertexLayout::kFloat32:
+    case CVertexLayout::kInt32:
+    case CVertexLayout::kUInt32:
+        return 4;
+    case CVertexLayout::kInt16:
+    case CVertexLayout::kUInt16:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// the size of an attribute in its source
+static inline uint32_t
+GetElementBytes(const CVertexLayout::tAttribute& attribute)
+{
+    if (attribute.SourceType == CVertexLayout::kRgba5551)
+        return 2;
+    return attribute.NumComponents * GetComponentBytes(attribute.SourceType);
+}
+
+// the part of it that goes through the vif
+static inline uint32_t
+GetSentBytes(const CVertexLayout::tAttribute& attribute)
+{
+    if (attribute.SourceType == CVertexLayout::kRgba5551)
+        return 2;
+    return (attribute.NumComponents - attribute.NumRowComponents) * GetComponentBytes(attribute.SourceType);
+}
+
+static inline uint32_t
+GetUnpackMode(const CVertexLayout::tAttribute& attribute)
+{
+    uint32_t vl;
+    switch (attribute.SourceType) {
+    case CVertexLayout::kRgba5551:
+        return Vifs::UnpackModes::v4_5;
+    case CVertexLayout::kInt16:
+    case CVertexLayout::kUInt16:
+        vl = 1;
+        break;
+    case CVertexLayout::kInt8:
+    case CVertexLayout::kUInt8:
+        vl = 2;
+        break;
+    default:
+        vl = 0;
+        break;
+    }
+    return ((attribute.NumComponents - attribute.NumRowComponents - 1) << 2) | vl;
+}
+
+static inline bool
+IsUnsigned(const CVertexLayout::tAttribute& attribute)
+{
+    return attribute.SourceType != CVertexLayout::kInt16 && attribute.SourceType != CVertexLayout::kInt8;
+}
+
+// every field of the given mask rows comes from the row register
+static inline uint32_t
+MakeRowMask(uint32_t firstRow)
+{
+    uint32_t mask = 0;
+    for (uint32_t row = firstRow; row < 4; row++)
+        mask |= 0x55 << (row * 8);
+    return mask;
+}
+
+// fields from firstField up come from the row register, in every mask row
+static inline uint32_t
+MakeFieldMask(uint32_t firstField)
+{
+    uint32_t mask = 0;
+    for (uint32_t field = firstField; field < 4; field++)
+        mask |= 0x01010101 << (field * 2);
+    return mask;
+}
+
+CUnpackPlan::CUnpackPlan(const CVertexLayout& layout)
+    : uiVertexQwords(layout.GetVertexQwords())
+{
+    Compile(layout);
+}
+
+void CUnpackPlan::Compile(const CVertexLayout& layout)
+{
+    uint32_t numAttributes = layout.GetNumAttributes();
+    uint32_t stride        = uiVertexQwords;
+
+    // order the attributes by where they go
+    std::vector<uint32_t> byOffset;
+    for (uint32_t i = 0; i < numAttributes; i++) {
+        const CVertexLayout::tAttribute& attribute = layout.GetAttribute(i);
+        Attributes.push_back(attribute);
+        tSource source = { NULL, GetElementBytes(attribute) };
+        Sources.push_back(source);
+
+        uint32_t pos = byOffset.size();
+        while (pos > 0 && layout.GetAttribute(byOffset[pos - 1]).VuOffset > attribute.VuOffset)
+            pos--;
+        mErrorIf(pos > 0 && layout.GetAttribute(byOffset[pos - 1]).VuOffset == attribute.VuOffset,
+            "Two attributes at vu offset %d.", attribute.VuOffset);
+        byOffset.insert(byOffset.begin() + pos, i);
+    }
+
+    // group neighbouring data attributes with the same mode into skipping writes
+    std::vector<bool> placed(numAttributes, false);
+    for (uint32_t i = 0; i < numAttributes;) {
+        const CVertexLayout::tAttribute& first = Attributes[byOffset[i]];
+        if (first.IsConstant) {
+            i++;
+            continue;
+        }
+
+        tStep step;
+        memset(&step, 0, sizeof(step));
+        step.Mode           = GetUnpackMode(first);
+        step.Unsigned       = IsUnsigned(first);
+        step.VuOffset       = first.VuOffset;
+        step.FirstAttribute = StepAttributes.size();
+
+        // an attribute that takes some components from the row register goes alone
+        if (first.NumRowComponents > 0) {
+            step.Masked        = true;
+            step.WL            = 1;
+            step.CL            = stride;
+            step.NumAttributes = 1;
+            step.VertexBytes   = GetSentBytes(first);
+            step.SetRow        = true;
+            step.Mask          = MakeFieldMask(first.NumComponents - first.NumRowComponents);
+            memcpy(step.Row, first.Constant, sizeof(step.Row));
+            StepAttributes.push_back(byOffset[i]);
+            placed[byOffset[i]] = true;
+            Steps.push_back(step);
+            i++;
+            continue;
+        }
+
+        uint32_t j = i;
+        for (; j < numAttributes; j++) {
+            const CVertexLayout::tAttribute& attribute = Attributes[byOffset[j]];
+            if (attribute.IsConstant || attribute.NumRowComponents > 0
+                || GetUnpackMode(attribute) != step.Mode
+                || IsUnsigned(attribute) != step.Unsigned
+                || attribute.VuOffset != first.VuOffset + (j - i))
+                break;
+            StepAttributes.push_back(byOffset[j]);
+            step.VertexBytes += GetSentBytes(attribute);
+            placed[byOffset[j]] = true;
+        }
+        step.NumAttributes = j - i;
+        step.WL            = step.NumAttributes;
+        step.CL            = stride;
+        Steps.push_back(step);
+        i = j;
+    }
+
+    // Constants that fill out the vertex after a single unpack that starts it can
+    // be written by filling, if they're all the same (they come from the row
+    // register).  Filled quads use mask rows from cl up, so cl can be 3 at most.
+    if (Steps.size() == 1 && !Steps[0].SetRow && Steps[0].VuOffset == 0 && Steps[0].WL < stride
+        && Steps[0].WL <= 3) {
+        tStep& step            = Steps[0];
+        const uint32_t* value  = NULL;
+        uint32_t numConstants  = 0;
+        bool sameValue         = true;
+        for (uint32_t i = 0; i < numAttributes; i++) {
+            if (!Attributes[i].IsConstant)
+                continue;
+            if (value && memcmp(value, Attributes[i].Constant, sizeof(Attributes[i].Constant)) != 0)
+                sameValue = false;
+            value = Attributes[i].Constant;
+            numConstants++;
+        }
+
+        if (value && sameValue && step.WL + numConstants == stride) {
+            step.CL     = step.WL;
+            step.WL     = stride;
+            step.Masked = true;
+            step.SetRow = true;
+            step.Mask   = MakeRowMask(step.CL);
+            memcpy(step.Row, value, sizeof(step.Row));
+            for (uint32_t i = 0; i < numAttributes; i++)
+                if (Attributes[i].IsConstant)
+                    placed[i] = true;
+        }
+    }
+
+    // the rest of the constants are masked so that only the row register gets
+    // written, which still takes some data
+    for (uint32_t i = 0; i < numAttributes; i++) {
+        if (placed[byOffset[i]])
+            continue;
+        const CVertexLayout::tAttribute& attribute = Attributes[byOffset[i]];
+
+        tStep step;
+        memset(&step, 0, sizeof(step));
+        step.Mode           = Vifs::UnpackModes::s_8;
+        step.Unsigned       = true;
+        step.Masked         = true;
+        step.VuOffset       = attribute.VuOffset;
+        step.WL             = 1;
+        step.CL             = stride;
+        step.FirstAttribute = StepAttributes.size();
+        step.NumAttributes  = 1;
+        step.VertexBytes    = 1;
+        step.SetRow         = true;
+        step.Mask           = MakeRowMask(0);
+        memcpy(step.Row, attribute.Constant, sizeof(step.Row));
+        StepAttributes.push_back(byOffset[i]);
+        Steps.push_back(step);
+    }
+}
+
+void CUnpackPlan::SetSource(uint32_t attribute, const void* data, uint32_t byteStride)
+{
+    mAssert(attribute < Sources.size());
+    mErrorIf(Attributes[attribute].IsConstant, "Constant attributes don't have a source.");
+    Sources[attribute].Data       = (const uint8_t*)data;
+    Sources[attribute].ByteStride = (byteStride) ? byteStride : GetElementBytes(Attributes[attribute]);
+}
+
+void CUnpackPlan::Emit(CVifSCDmaPacket& packet, uint32_t vuAddr, uint32_t firstVertex, uint32_t numVertices,
+    bool dblBuffered) const
+{
+    if (numVertices == 0)
+        return;
+
+    uint32_t wl = 0, cl = 0;
+    for (uint32_t s = 0; s < Steps.size(); s++) {
+        const tStep& step = Steps[s];
+        if (step.SetRow) {
+            Vifs::tMask mask;
+            memcpy(&mask, &step.Mask, sizeof(mask));
+            packet.Strow(step.Row);
+            packet.Stmask(mask);
+        }
+        if (step.WL != wl || step.CL != cl) {
+            wl = step.WL;
+            cl = step.CL;
+            packet.Stcycl(wl, cl);
+        }
+        EmitStep(packet, step, vuAddr, firstVertex, numVertices, dblBuffered);
+    }
+}
+
+void CUnpackPlan::EmitStep(CVifSCDmaPacket& packet, const tStep& step, uint32_t vuAddr, uint32_t firstVertex,
+    uint32_t numVertices, bool dblBuffered) const
+{
+    // an unpack writes at most 256 quads, wl of them per vertex
+    uint32_t maxPerUnpack = 256 / step.WL;
+
+    // the data of a lone, packed attribute can be copied straight out of its source
+    const tSource* contiguous = NULL;
+    if (step.NumAttributes == 1 && !step.SetRow) {
+        const tSource& source = Sources[StepAttributes[step.FirstAttribute]];
+        if (source.ByteStride == step.VertexBytes)
+            contiguous = &source;
+    }
+
+    uint32_t staging[kMaxUnpackBytes / 4];
+
+    for (uint32_t done = 0; done < numVertices;) {
+        uint32_t numInUnpack = numVertices - done;
+        if (numInUnpack > maxPerUnpack)
+            numInUnpack = maxPerUnpack;
+
+        uint32_t addr = vuAddr + step.VuOffset + done * uiVertexQwords;
+        mErrorIf(addr > 0x3ff, "Vu address 0x%x is out of range.", addr);
+
+        uint32_t numBytes  = numInUnpack * step.VertexBytes;
+        uint32_t numPadded = (numBytes + 3) & ~3;
+        packet.OpenUnpack(step.Mode, addr, dblBuffered, step.Masked, step.Unsigned);
+
+        uint32_t vertex = firstVertex + done;
+        if (contiguous) {
+            mAssert(contiguous->Data != NULL);
+            packet.Add(contiguous->Data + vertex * contiguous->ByteStride, numBytes);
+        } else {
+            // interleave the attributes (constants only need the space)
+            uint8_t* out = (uint8_t*)staging;
+            if (step.SetRow && Attributes[StepAttributes[step.FirstAttribute]].IsConstant)
+                memset(out, 0, numBytes);
+            else {
+                for (uint32_t v = 0; v < numInUnpack; v++) {
+                    for (uint32_t a = 0; a < step.NumAttributes; a++) {
+                        uint32_t attribute    = StepAttributes[step.FirstAttribute + a];
+                        const tSource& source = Sources[attribute];
+                        uint32_t elementBytes = GetSentBytes(Attributes[attribute]);
+                        mAssert(source.Data != NULL);
+                        memcpy(out, source.Data + (vertex + v) * source.ByteStride, elementBytes);
+                        out += elementBytes;
+                    }
+                }
+            }
+            packet.Add((const uint8_t*)staging, numBytes);
+        }
+        for (uint32_t i = numBytes; i < numPadded; i++)
+            packet += (uint8_t)0;
+
+        packet.CloseUnpack(numInUnpack * step.WL);
+        done += numInUnpack;
+    }
+}
+
+uint32_t
+CUnpackPlan::GetNumBytesPerVertex(void) const
+{
+    uint32_t numBytes = 0;
+    for (uint32_t s = 0; s < Steps.size(); s++)
+        numBytes += Steps[s].VertexBytes;
+    return numBytes;
+}
+
+uint32_t
+CUnpackPlan::GetNumBytes(uint32_t numVertices) const
+{
+    if (numVertices == 0)
+        return 0;
+
+    uint32_t numBytes = 0, wl = 0, cl = 0;
+    for (uint32_t s = 0; s < Steps.size(); s++) {
+        const tStep& step = Steps[s];
+        if (step.SetRow)
+            numBytes += 4 * 5 + 4 * 2;
+        if (step.WL != wl || step.CL != cl) {
+            wl = step.WL;
+            cl = step.CL;
+            numBytes += 4;
+        }
+
+        uint32_t maxPerUnpack = 256 / step.WL;
+        uint32_t numUnpacks   = (numVertices + maxPerUnpack - 1) / maxPerUnpack;
+        numBytes += numUnpacks * 4;
+        // (only the last unpack can be a partial word)
+        numBytes += ((numVertices - (numUnpacks - 1) * maxPerUnpack) * step.VertexBytes + 3) & ~3;
+        numBytes += (numUnpacks - 1) * ((maxPerUnpack * step.VertexBytes + 3) & ~3);
+    }
+    return numBytes;
+}
+
+void CUnpackPlan::Print(void) const
+{
+    static const char* const modeNames[16] = {
+        "s_32", "s_16", "s_8", "?",
+        "v2_32", "v2_16", "v2_8", "?",
+        "v3_32", "v3_16", "v3_8", "?",
+        "v4_32", "v4_16", "v4_8", "v4_5"
+    };
+
+    printf("unpack plan: %d quads per vertex, %d bytes of vif data per vertex\n",
+        uiVertexQwords, GetNumBytesPerVertex());
+    for (uint32_t s = 0; s < Steps.size(); s++) {
+        const tStep& step = Steps[s];
+        printf("  %-5s%s at +%d, wl %d cl %d, %d bytes per vertex, attributes",
+            modeNames[step.Mode], (step.Masked) ? " (masked)" : "", step.VuOffset, step.WL, step.CL, step.VertexBytes);
+        for (uint32_t a = 0; a < step.NumAttributes; a++) {
+            const CVertexLayout::tAttribute& attribute = Attributes[StepAttributes[step.FirstAttribute + a]];
+            printf(" %d", StepAttributes[step.FirstAttribute + a]);
+            if (attribute.NumRowComponents > 0)
+                printf(" (%d from row)", attribute.NumRowComponents);
+        }
+        if (step.WL > step.CL) {
+            printf(" + filled");
+            for (uint32_t i = 0; i < Attributes.size(); i++)
+                if (Attributes[i].IsConstant)
+                    printf(" %d", i);
+        }
+        printf("\n");
+    }
+}
+
+/********************************************
+ * VertexUploader
+ */
+
+// what a masked step costs besides its data: STROW, STMASK, and usually an
+// extra STCYCL and unpack
+static const uint32_t kMaskedStepBytes = 4 * 5 + 4 * 2 + 4 + 4;
+
+// a component as the vif unpacks it (to a word of vu memory)
+static inline uint32_t
+UnpackComponent(CVertexLayout::tSourceType type, const uint8_t* element, uint32_t component)
+{
+    const uint8_t* data = element + component * GetComponentBytes(type);
+    switch (type) {
+    case CVertexLayout::kInt16: {
+        int16_t value;
+        memcpy(&value, data, 2);
+        return (uint32_t)(int32_t)value;
+    }
+    case CVertexLayout::kUInt16: {
+        uint16_t value;
+        memcpy(&value, data, 2);
+        return value;
+    }
+    case CVertexLayout::kInt8:
+        return (uint32_t)(int32_t)(int8_t)*data;
+    case CVertexLayout::kUInt8:
+        return *data;
+    case CVertexLayout::kRgba5551: {
+        uint16_t color;
+        memcpy(&color, element, 2);
+        if (component == 3)
+            return (color & 0x8000) ? 0x80 : 0;
+        return ((color >> (component * 5)) & 0x1f) << 3;
+    }
+    default: {
+        uint32_t value;
+        memcpy(&value, data, 4);
+        return value;
+    }
+    }
+}
+
+CVertexUploader::CVertexUploader(const CVertexLayout& layout)
+    : Layout(layout)
+    , FullPlan(layout)
+    , pBatchPlan(NULL)
+    , uiTotalBytesSaved(0)
+{
+    uint32_t numAttributes = layout.GetNumAttributes();
+    tSource source         = { NULL, 0 };
+    Sources.resize(numAttributes, source);
+    RowComponents.resize(numAttributes, 0);
+    RowValues.resize(numAttributes * 4, 0);
+    memset(&LastBatch, 0, sizeof(LastBatch));
+}
+
+CVertexUploader::~CVertexUploader()
+{
+    delete pBatchPlan;
+}
+
+void CVertexUploader::SetSource(uint32_t attribute, const void* data, uint32_t byteStride)
+{
+    mAssert(attribute < Sources.size());
+    FullPlan.SetSource(attribute, data, byteStride);
+    Sources[attribute].Data       = (const uint8_t*)data;
+    Sources[attribute].ByteStride = (byteStride) ? byteStride : GetElementBytes(Layout.GetAttribute(attribute));
+}
+
+// returns how many of the attribute's trailing components are the same for all the
+// vertices, and puts their (unpacked) values in values (the rest are 0; values is
+// left alone if there are none)
+uint32_t
+CVertexUploader::FindConstantComponents(uint32_t attribute, uint32_t firstVertex, uint32_t numVertices,
+    uint32_t* values) const
+{
+    const CVertexLayout::tAttribute& attrib = Layout.GetAttribute(attribute);
+    const tSource& source                   = Sources[attribute];
+    mAssert(source.Data != NULL);
+
+    // a 5551 color is all or nothing
+    bool isColor           = (attrib.SourceType == CVertexLayout::kRgba5551);
+    uint32_t numComponents = (isColor) ? 1 : attrib.NumComponents;
+    uint32_t compBytes     = (isColor) ? 2 : GetComponentBytes(attrib.SourceType);
+
+    // first non-constant component + 1, checked from the end
+    const uint8_t* first = source.Data + firstVertex * source.ByteStride;
+    uint32_t numSent     = 0;
+    for (uint32_t v = 1; v < numVertices && numSent < numComponents; v++) {
+        const uint8_t* element = first + v * source.ByteStride;
+        for (uint32_t c = numComponents; c > numSent; c--) {
+            if (memcmp(element + (c - 1) * compBytes, first + (c - 1) * compBytes, compBytes) != 0) {
+                numSent = c;
+                break;
+            }
+        }
+    }
+    if (numSent == numComponents)
+        return 0;
+    for (uint32_t c = 0; c < 4; c++)
+        values[c] = (c >= numSent && c < attrib.NumComponents) ? UnpackComponent(attrib.SourceType, first, c) : 0;
+
+    return (isColor) ? 4 : numComponents - numSent;
+}
+
+void CVertexUploader::CompileBatchPlan(void)
+{
+    CVertexLayout batchLayout(Layout.GetVertexQwords());
+    for (uint32_t i = 0; i < Layout.GetNumAttributes(); i++) {
+        const CVertexLayout::tAttribute& attribute = Layout.GetAttribute(i);
+        if (attribute.IsConstant) {
+            batchLayout.AddConstant(attribute.Constant, attribute.VuOffset);
+        } else if (RowComponents[i] == attribute.NumComponents) {
+            batchLayout.AddConstant(&RowValues[i * 4], attribute.VuOffset);
+        } else {
+            batchLayout.AddAttribute(attribute.SourceType, attribute.NumComponents, attribute.VuOffset);
+            if (RowComponents[i] > 0)
+                batchLayout.SetRowComponents(i, RowComponents[i], &RowValues[i * 4]);
+            else if (attribute.NumRowComponents > 0)
+                batchLayout.SetRowComponents(i, attribute.NumRowComponents, attribute.Constant);
+        }
+    }
+
+    delete pBatchPlan;
+    pBatchPlan        = new CUnpackPlan(batchLayout);
+    PlanRowComponents = RowComponents;
+    PlanRowValues     = RowValues;
+}
+
+const CVertexUploader::tBatchStats&
+CVertexUploader::Upload(CVifSCDmaPacket& packet, uint32_t vuAddr, uint32_t firstVertex, uint32_t numVertices,
+    bool dblBuffered)
+{
+    memset(&LastBatch, 0, sizeof(LastBatch));
+    if (numVertices == 0)
+        return LastBatch;
+
+    // find what's constant and worth taking out of the data
+    bool anyConstant = false;
+    for (uint32_t i = 0; i < Layout.GetNumAttributes(); i++) {
+        const CVertexLayout::tAttribute& attribute = Layout.GetAttribute(i);
+        RowComponents[i]                           = 0;
+        if (attribute.IsConstant || attribute.NumRowComponents > 0)
+            continue;
+
+        uint32_t* values     = &RowValues[i * 4];
+        uint32_t numConstant = FindConstantComponents(i, firstVertex, numVertices, values);
+        if (numConstant == 0) {
+            memset(values, 0, 4 * sizeof(uint32_t));
+            continue;
+        }
+
+        // (a constant still takes a byte per vertex, unless it's filled)
+        uint32_t numSaved = (numConstant == attribute.NumComponents)
+            ? GetElementBytes(attribute) - 1
+            : numConstant * GetComponentBytes(attribute.SourceType);
+        if (numSaved * numVertices <= kMaskedStepBytes) {
+            memset(values, 0, 4 * sizeof(uint32_t));
+            continue;
+        }
+
+        RowComponents[i] = numConstant;
+        anyConstant      = true;
+    }
+
+    const CUnpackPlan* plan = &FullPlan;
+    uint32_t fullBytes      = FullPlan.GetNumBytes(numVertices);
+    LastBatch.NumBytes      = fullBytes;
+
+    if (anyConstant) {
+        if (pBatchPlan == NULL || RowComponents != PlanRowComponents || RowValues != PlanRowValues)
+            CompileBatchPlan();
+
+        // the estimate above doesn't know how the attributes were grouped
+        uint32_t batchBytes = pBatchPlan->GetNumBytes(numVertices);
+        if (batchBytes < fullBytes) {
+            for (uint32_t i = 0; i < Layout.GetNumAttributes(); i++) {
+                const CVertexLayout::tAttribute& attribute = Layout.GetAttribute(i);
+                if (attribute.IsConstant)
+                    continue;
+                if (RowComponents[i] == attribute.NumComponents) {
+                    LastBatch.NumConstantAttributes++;
+                    continue;
+                }
+                LastBatch.NumRowComponents += RowComponents[i];
+                pBatchPlan->SetSource(i, Sources[i].Data, Sources[i].ByteStride);
+            }
+            plan                    = pBatchPlan;
+            LastBatch.NumBytes      = batchBytes;
+            LastBatch.NumBytesSaved = fullBytes - batchBytes;
+        }
+    }
+
+    plan->Emit(packet, vuAddr, firstVertex, numVertices, dblBuffered);
+    uiTotalBytesSaved += LastBatch.NumBytesSaved;
+    return LastBatch;
+}
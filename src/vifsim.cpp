@@ -0,0 +1,389 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ps2s/debug.h"
+#include "ps2s/vif.h"
+#include "ps2s/vifsim.h"
+
+/********************************************
+ * VifSim
+ */
+
+CVifSim::CVifSim(void)
+    : pGifSink(NULL)
+    , pMicroCallback(NULL)
+    , pMicroCallbackArg(NULL)
+{
+    Reset();
+}
+
+void CVifSim::Reset(void)
+{
+    memset(DataMem, 0, sizeof(DataMem));
+    memset(MicroMem, 0, sizeof(MicroMem));
+
+    uiWL = uiCL = 1;
+    uiMode = uiMask = 0;
+    memset(Row, 0, sizeof(Row));
+    memset(Col, 0, sizeof(Col));
+    uiBase = uiOffset = uiTops = uiTop = uiItops = uiItop = 0;
+    bDBF   = false;
+    uiMark = 0;
+
+    uiVifCode = uiWordsLeft = uiWordPos = 0;
+    CommandData.clear();
+    pError = NULL;
+
+    ResetStats();
+}
+
+void CVifSim::ResetStats(void)
+{
+    memset(CommandStats, 0, sizeof(CommandStats));
+    uiNumCycles = uiNumQuadsWritten = uiNumMicroCalls = 0;
+}
+
+void CVifSim::Receive(tDmaChannelId channel, const uint128_t* data, uint32_t numQwords, bool isTag)
+{
+    const uint32_t* words = (const uint32_t*)data;
+
+    if (isTag) {
+        // the vif only sees the upper 64 bits of a tag
+        for (uint32_t i = 0; i < numQwords; i++) {
+            uiWordPos = 2;
+            FeedWord(words[i * 4 + 2]);
+            FeedWord(words[i * 4 + 3]);
+        }
+    } else
+        Feed(words, numQwords * 4);
+}
+
+void CVifSim::Feed(const uint32_t* words, uint32_t numWords)
+{
+    for (uint32_t i = 0; i < numWords; i++)
+        FeedWord(words[i]);
+}
+
+void CVifSim::FeedWord(uint32_t word)
+{
+    uint32_t wordPos = uiWordPos;
+    uiWordPos        = (uiWordPos + 1) & 3;
+
+    if (pError)
+        return;
+
+    if (uiWordsLeft > 0) {
+        CommandData.push_back(word);
+        if (--uiWordsLeft == 0)
+            Execute();
+        return;
+    }
+
+    uint32_t cmd = (word >> 24) & 0x7f;
+    if (cmd == Vifs::Opcodes::mpg && (wordPos & 1) == 0) {
+        pError = "mpg data doesn't start on a dword boundary";
+        return;
+    }
+    if ((cmd == Vifs::Opcodes::direct || cmd == Vifs::Opcodes::directhl) && wordPos != 3) {
+        pError = "direct data doesn't start on a qword boundary";
+        return;
+    }
+
+    StartCommand(word);
+}
+
+void CVifSim::StartCommand(uint32_t vifcode)
+{
+    uiVifCode = vifcode;
+    CommandData.clear();
+
+    uint32_t cmd = (vifcode >> 24) & 0x7f;
+    if ((cmd & 0x60) == 0x60 && (cmd & 0x3) == 3 && (cmd & 0xc) != 0xc) {
+        // only v4 has a 5-bit format
+        pError = "bad unpack format";
+        return;
+    }
+
+    uiWordsLeft = Vifs::GetNumDataWords(vifcode, uiWL, uiCL);
+    if (uiWordsLeft == Vifs::kUnknownSize) {
+        uiWordsLeft = 0;
+        pError      = "unknown vifcode";
+        return;
+    }
+
+    if (uiWordsLeft == 0)
+        Execute();
+}
+
+void CVifSim::Execute(void)
+{
+    uint32_t cmd = (uiVifCode >> 24) & 0x7f;
+    uint32_t num = (uiVifCode >> 16) & 0xff;
+    uint32_t imm = uiVifCode & 0xffff;
+
+    uint32_t numDataWords = CommandData.size();
+    uint32_t numCycles    = 1 + (numDataWords + 3) / 4;
+    uint32_t statsCmd     = cmd;
+
+    if ((cmd & 0x60) == 0x60) {
+        uint32_t numWritten = Unpack();
+        if (numWritten + 1 > numCycles)
+            numCycles = numWritten + 1;
+        statsCmd &= ~0x10;
+    } else {
+        switch (cmd) {
+        case Vifs::Opcodes::nop:
+        case Vifs::Opcodes::mskpath3:
+        case Vifs::Opcodes::flushe:
+        case Vifs::Opcodes::flush:
+        case Vifs::Opcodes::flusha:
+            break;
+        case Vifs::Opcodes::stcycl:
+            uiCL = imm & 0xff;
+            uiWL = (imm >> 8) & 0xff;
+            break;
+        case Vifs::Opcodes::offset:
+            uiOffset = imm & 0x3ff;
+            bDBF     = false;
+            uiTops   = uiBase;
+            break;
+        case Vifs::Opcodes::base:
+            uiBase = imm & 0x3ff;
+            break;
+        case Vifs::Opcodes::itop:
+            uiItops = imm & 0x3ff;
+            break;
+        case Vifs::Opcodes::stmod:
+            uiMode = imm & 0x3;
+            break;
+        case Vifs::Opcodes::mark:
+            uiMark = imm;
+            break;
+        case Vifs::Opcodes::mscal:
+        case Vifs::Opcodes::mscalf:
+            StartMicro(imm);
+            break;
+        case Vifs::Opcodes::mscnt:
+            StartMicro(kContinue);
+            break;
+        case Vifs::Opcodes::stmask:
+            uiMask = CommandData[0];
+            break;
+        case Vifs::Opcodes::strow:
+            memcpy(Row, &CommandData[0], sizeof(Row));
+            break;
+        case Vifs::Opcodes::stcol:
+            memcpy(Col, &CommandData[0], sizeof(Col));
+            break;
+        case Vifs::Opcodes::mpg: {
+            uint32_t numDwords = (num) ? num : 256;
+            for (uint32_t i = 0; i < numDwords; i++)
+                MicroMem[(imm + i) % kMicroMemDwords] = (uint64_t)CommandData[i * 2]
+                    | ((uint64_t)CommandData[i * 2 + 1] << 32);
+            break;
+        }
+        case Vifs::Opcodes::direct:
+        case Vifs::Opcodes::directhl:
+            if (pGifSink)
+                pGifSink->Receive(DMAC::Channels::gif, (const uint128_t*)&CommandData[0], numDataWords / 4, false);
+            break;
+        }
+    }
+
+    tCommandStats& stats = CommandStats[statsCmd];
+    stats.Count++;
+    stats.NumDataWords += numDataWords;
+    stats.Cycles += numCycles;
+    uiNumCycles += numCycles;
+}
+
+// reads the unpack's packed elements, lowest bits first
+class CUnpackReader {
+public:
+    CUnpackReader(const std::vector<uint32_t>& data)
+        : pBytes((data.empty()) ? NULL : (const uint8_t*)&data[0])
+        , uiOffset(0)
+    {
+    }
+
+    uint32_t Read(uint32_t numBits, bool isSigned)
+    {
+        uint32_t value;
+        if (numBits == 32) {
+            memcpy(&value, pBytes + uiOffset, 4);
+        } else if (numBits == 16) {
+            uint16_t half;
+            memcpy(&half, pBytes + uiOffset, 2);
+            value = (isSigned) ? (uint32_t)(int32_t)(int16_t)half : half;
+        } else {
+            uint8_t byte = pBytes[uiOffset];
+            value        = (isSigned) ? (uint32_t)(int32_t)(int8_t)byte : byte;
+        }
+        uiOffset += numBits / 8;
+        return value;
+    }
+
+private:
+    const uint8_t* pBytes;
+    uint32_t uiOffset;
+};
+
+uint32_t
+CVifSim::Unpack(void)
+{
+    uint32_t cmd = (uiVifCode >> 24) & 0x7f;
+    uint32_t num = (uiVifCode >> 16) & 0xff;
+    uint32_t imm = uiVifCode & 0xffff;
+
+    uint32_t vn     = (cmd >> 2) & 0x3;
+    uint32_t vl     = cmd & 0x3;
+    bool useMask    = (cmd & 0x10) != 0;
+    bool isUnsigned = (imm & 0x4000) != 0;
+
+    uint32_t addr = imm & 0x3ff;
+    if (imm & 0x8000)
+        addr += uiTops;
+
+    uint32_t numWritten = (num) ? num : 256;
+    uint32_t wl         = (uiWL) ? uiWL : 256;
+    uint32_t cl         = (uiCL) ? uiCL : 256;
+
+    CUnpackReader reader(CommandData);
+
+    for (uint32_t i = 0; i < numWritten; i++) {
+        uint32_t block = i / wl, cycle = i % wl;
+
+        // skipping writes leave cl - wl quads between blocks; filling writes make up
+        // wl - cl quads of each block from the registers
+        uint32_t dest;
+        bool fromData;
+        if (cl >= wl) {
+            dest     = addr + block * cl + cycle;
+            fromData = true;
+        } else {
+            dest     = addr + i;
+            fromData = cycle < cl;
+        }
+        uint32_t* quad = &DataMem[(dest % kDataMemQwords) * 4];
+
+        uint32_t value[4] = { 0, 0, 0, 0 };
+        if (fromData) {
+            if (vl == 3) {
+                // v4_5: rgba 5551
+                uint32_t color = reader.Read(16, false);
+                value[0]       = (color & 0x1f) << 3;
+                value[1]       = ((color >> 5) & 0x1f) << 3;
+                value[2]       = ((color >> 10) & 0x1f) << 3;
+                value[3]       = (color & 0x8000) ? 0x80 : 0;
+            } else {
+                uint32_t numBits = 32 >> vl;
+                for (uint32_t f = 0; f <= vn; f++)
+                    value[f] = reader.Read(numBits, !isUnsigned);
+                if (vn == 0)
+                    value[1] = value[2] = value[3] = value[0];
+            }
+        }
+
+        uint32_t maskRow = (cycle < 3) ? cycle : 3;
+        for (uint32_t f = 0; f < 4; f++) {
+            uint32_t m = (useMask) ? (uiMask >> ((maskRow * 4 + f) * 2)) & 3 : 0;
+            switch (m) {
+            case 0:
+                if (!fromData)
+                    quad[f] = Row[f];
+                else if (uiMode == Vifs::AddModes::kOffset)
+                    quad[f] = value[f] + Row[f];
+                else if (uiMode == Vifs::AddModes::kAccumulate)
+                    quad[f] = Row[f] = Row[f] + value[f];
+                else
+                    quad[f] = value[f];
+                break;
+            case 1:
+                quad[f] = Row[f];
+                break;
+            case 2:
+                quad[f] = Col[maskRow];
+                break;
+            case 3:
+                // write protected
+                break;
+            }
+        }
+    }
+
+    uiNumQuadsWritten += numWritten;
+    return numWritten;
+}
+
+void CVifSim::StartMicro(uint32_t startAddr)
+{
+    // the program gets the buffer that was just filled, and the next batch goes
+    // into the other one
+    uiTop  = uiTops;
+    uiItop = uiItops;
+    bDBF   = !bDBF;
+    uiTops = (bDBF) ? uiBase + uiOffset : uiBase;
+
+    uiNumMicroCalls++;
+    if (pMicroCallback)
+        pMicroCallback(*this, startAddr, pMicroCallbackArg);
+}
+
+void CVifSim::Print(void) const
+{
+    static const char* const unpackNames[16] = {
+        "s_32", "s_16", "s_8", "?",
+        "v2_32", "v2_16", "v2_8", "?",
+        "v3_32", "v3_16", "v3_8", "?",
+        "v4_32", "v4_16", "v4_8", "v4_5"
+    };
+
+    printf("vif: %d cycles, %d quads unpacked, %d micro calls\n",
+        uiNumCycles, uiNumQuadsWritten, uiNumMicroCalls);
+    for (uint32_t cmd = 0; cmd < 128; cmd++) {
+        const tCommandStats& stats = CommandStats[cmd];
+        if (stats.Count == 0)
+            continue;
+
+        const char* name = "?";
+        if ((cmd & 0x60) == 0x60)
+            name = unpackNames[cmd & 0xf];
+        else {
+            switch (cmd) {
+            case Vifs::Opcodes::nop: name = "nop"; break;
+            case Vifs::Opcodes::stcycl: name = "stcycl"; break;
+            case Vifs::Opcodes::offset: name = "offset"; break;
+            case Vifs::Opcodes::base: name = "base"; break;
+            case Vifs::Opcodes::itop: name = "itop"; break;
+            case Vifs::Opcodes::stmod: name = "stmod"; break;
+            case Vifs::Opcodes::mskpath3: name = "mskpath3"; break;
+            case Vifs::Opcodes::mark: name = "mark"; break;
+            case Vifs::Opcodes::flushe: name = "flushe"; break;
+            case Vifs::Opcodes::flush: name = "flush"; break;
+            case Vifs::Opcodes::flusha: name = "flusha"; break;
+            case Vifs::Opcodes::mscal: name = "mscal"; break;
+            case Vifs::Opcodes::mscalf: name = "mscalf"; break;
+            case Vifs::Opcodes::mscnt: name = "mscnt"; break;
+            case Vifs::Opcodes::stmask: name = "stmask"; break;
+            case Vifs::Opcodes::strow: name = "strow"; break;
+            case Vifs::Opcodes::stcol: name = "stcol"; break;
+            case Vifs::Opcodes::mpg: name = "mpg"; break;
+            case Vifs::Opcodes::direct: name = "direct"; break;
+            case Vifs::Opcodes::directhl: name = "directhl"; break;
+            }
+        }
+        printf("  %-8s x%-5d %6d data words %7d cycles\n", name, stats.Count, stats.NumDataWords, stats.Cycles);
+    }
+    if (pError)
+        printf("  stopped: %s\n", pError);
+}
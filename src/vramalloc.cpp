@@ -0,0 +1,380 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+
+#include "ps2s/debug.h"
+#include "ps2s/math.h"
+#include "ps2s/vramalloc.h"
+
+/********************************************
+ * VramAllocator
+ */
+
+namespace GS {
+
+CVramAllocator::CVramAllocator(int firstPage, int numPages)
+    : FirstPage(firstPage)
+    , NumPages(numPages)
+{
+    mErrorIf(numPages <= 0 || firstPage < 0 || firstPage + numPages > kNumPages,
+        "The allocator's pages have to be in gs memory.");
+    Reset();
+}
+
+void CVramAllocator::Reset()
+{
+    for (int page = 0; page < kNumPages; page++) {
+        PageStates[page]  = kUsed;
+        FreeLengths[page] = 0;
+        NextFree[page] = PrevFree[page] = -1;
+        BlockMasks[page]                = 0;
+        PlaneHosts[page] = PlanesUsed[page] = 0;
+    }
+    for (int freeClass = 0; freeClass < kNumClasses; freeClass++)
+        FreeLists[freeClass] = -1;
+    SubPages.clear();
+
+    NumFreePages = 0;
+    AddFreeRange(FirstPage, NumPages);
+}
+
+int CVramAllocator::GetClass(int numPages)
+{
+    return Math::Min((int)Math::Log2(numPages), kNumClasses - 1);
+}
+
+int CVramAllocator::GetAllocBlocks(int numBlocks)
+{
+    if (numBlocks >= kBlocksPerPage)
+        return Math::DivUp(numBlocks, kBlocksPerPage) * kBlocksPerPage;
+    int allocBlocks = 1;
+    while (allocBlocks < numBlocks)
+        allocBlocks <<= 1;
+    return allocBlocks;
+}
+
+// free ranges
+
+void CVramAllocator::AddFreeRange(int firstPage, int numPages)
+{
+    int lastPage = firstPage + numPages - 1;
+    for (int page = firstPage; page <= lastPage; page++)
+        PageStates[page] = kFree;
+    FreeLengths[firstPage] = FreeLengths[lastPage] = numPages;
+
+    int freeClass       = GetClass(numPages);
+    PrevFree[firstPage] = -1;
+    NextFree[firstPage] = FreeLists[freeClass];
+    if (FreeLists[freeClass] >= 0)
+        PrevFree[FreeLists[freeClass]] = firstPage;
+    FreeLists[freeClass] = firstPage;
+
+    NumFreePages += numPages;
+}
+
+void CVramAllocator::RemoveFreeRange(int firstPage)
+{
+    int numPages = FreeLengths[firstPage];
+    int lastPage = firstPage + numPages - 1;
+
+    if (PrevFree[firstPage] >= 0)
+        NextFree[PrevFree[firstPage]] = NextFree[firstPage];
+    else
+        FreeLists[GetClass(numPages)] = NextFree[firstPage];
+    if (NextFree[firstPage] >= 0)
+        PrevFree[NextFree[firstPage]] = PrevFree[firstPage];
+
+    for (int page = firstPage; page <= lastPage; page++)
+        PageStates[page] = kUsed;
+    FreeLengths[firstPage] = FreeLengths[lastPage] = 0;
+
+    NumFreePages -= numPages;
+}
+
+int CVramAllocator::AllocPages(int numPages)
+{
+    // the smallest range in numPages' class that fits, or any range of a bigger class
+    int found = -1;
+    for (int freeClass = GetClass(numPages); freeClass < kNumClasses && found < 0; freeClass++) {
+        for (int page = FreeLists[freeClass]; page >= 0; page = NextFree[page]) {
+            if (FreeLengths[page] >= numPages
+                && (found < 0 || FreeLengths[page] < FreeLengths[found]))
+                found = page;
+            if (found >= 0 && freeClass > GetClass(numPages))
+                break;
+        }
+    }
+    if (found < 0)
+        return -1;
+
+    int rangeLength = FreeLengths[found];
+    RemoveFreeRange(found);
+    if (rangeLength > numPages)
+        AddFreeRange(found + numPages, rangeLength - numPages);
+    return found;
+}
+
+void CVramAllocator::FreePages(int firstPage, int numPages)
+{
+    for (int page = firstPage; page < firstPage + numPages; page++) {
+        mErrorIf(PageStates[page] != kUsed, "Page %d isn't allocated.", page);
+        mErrorIf(PlanesUsed[page], "The planes of page %d are still in use.", page);
+        PlaneHosts[page] = 0;
+    }
+
+    // merge with the free ranges on either side
+    if (firstPage > FirstPage && PageStates[firstPage - 1] == kFree) {
+        int prevLength = FreeLengths[firstPage - 1];
+        RemoveFreeRange(firstPage - prevLength);
+        firstPage -= prevLength;
+        numPages += prevLength;
+    }
+    int nextPage = firstPage + numPages;
+    if (nextPage < FirstPage + NumPages && PageStates[nextPage] == kFree) {
+        numPages += FreeLengths[nextPage];
+        RemoveFreeRange(nextPage);
+    }
+
+    AddFreeRange(firstPage, numPages);
+}
+
+// less than a page
+
+int CVramAllocator::AllocSubPage(int numBlocks)
+{
+    int allocBlocks = GetAllocBlocks(numBlocks);
+    uint32_t mask   = (1 << allocBlocks) - 1;
+
+    // the fullest page with room, to keep the others empty
+    int bestPage = -1, bestOffset = 0, bestUsed = -1;
+    for (unsigned int i = 0; i < SubPages.size(); i++) {
+        int page      = SubPages[i];
+        uint32_t used = BlockMasks[page];
+        for (int offset = 0; offset < kBlocksPerPage; offset += allocBlocks) {
+            if ((used & (mask << offset)) == 0) {
+                int numUsed = 0;
+                for (; used; used &= used - 1)
+                    numUsed++;
+                if (numUsed > bestUsed) {
+                    bestPage   = page;
+                    bestOffset = offset;
+                    bestUsed   = numUsed;
+                }
+                break;
+            }
+        }
+    }
+
+    if (bestPage < 0) {
+        bestPage = AllocPages(1);
+        if (bestPage < 0)
+            return -1;
+        PageStates[bestPage] = kSubPage;
+        BlockMasks[bestPage] = 0;
+        SubPages.push_back(bestPage);
+        bestOffset = 0;
+    }
+
+    BlockMasks[bestPage] |= mask << bestOffset;
+    return bestPage * kBlocksPerPage + bestOffset;
+}
+
+void CVramAllocator::FreeSubPage(int firstBlock, int numBlocks)
+{
+    int page      = firstBlock / kBlocksPerPage;
+    int offset    = firstBlock % kBlocksPerPage;
+    uint32_t mask = ((1 << GetAllocBlocks(numBlocks)) - 1) << offset;
+    mErrorIf(PageStates[page] != kSubPage || (BlockMasks[page] & mask) != mask,
+        "Blocks %d to %d aren't allocated.", firstBlock, firstBlock + numBlocks - 1);
+
+    BlockMasks[page] &= ~mask;
+    if (BlockMasks[page] == 0) {
+        for (unsigned int i = 0; i < SubPages.size(); i++) {
+            if (SubPages[i] == page) {
+                SubPages.erase(SubPages.begin() + i);
+                break;
+            }
+        }
+        PageStates[page] = kUsed;
+        FreePages(page, 1);
+    }
+}
+
+// bit planes
+
+void CVramAllocator::AddPlaneHosts(int firstPage, int numPages)
+{
+    for (int page = firstPage; page < firstPage + numPages; page++) {
+        mErrorIf(PageStates[page] != kUsed, "Only whole allocated pages can be plane hosts.");
+        PlaneHosts[page] = 1;
+    }
+}
+
+int CVramAllocator::AllocPlanes(int numPages, int planes)
+{
+    mAssert(numPages > 0 && planes != 0);
+
+    // The first run of host pages with the planes free.  A nibble looks first
+    // where the other nibble is already used, to leave whole bytes for 8h.
+    int found = -1;
+    for (int pass = (planes == kPlanes8h) ? 1 : 0; pass < 2 && found < 0; pass++) {
+        int runStart = 0, runLength = 0;
+        for (int page = FirstPage; page < FirstPage + NumPages && found < 0; page++) {
+            bool fits = PlaneHosts[page] && (PlanesUsed[page] & planes) == 0
+                && (pass == 1 || PlanesUsed[page] != 0);
+            if (!fits) {
+                runLength = 0;
+                continue;
+            }
+            if (runLength++ == 0)
+                runStart = page;
+            if (runLength == numPages)
+                found = runStart;
+        }
+    }
+    if (found < 0)
+        return -1;
+
+    for (int page = found; page < found + numPages; page++)
+        PlanesUsed[page] |= planes;
+    return found;
+}
+
+void CVramAllocator::FreePlanes(int firstPage, int numPages, int planes)
+{
+    for (int page = firstPage; page < firstPage + numPages; page++) {
+        mErrorIf((PlanesUsed[page] & planes) != planes, "The planes of page %d aren't allocated.", page);
+        PlanesUsed[page] &= ~planes;
+    }
+}
+
+int CVramAllocator::GetPlanesUsed(int firstPage, int numPages) const
+{
+    int planes = 0;
+    for (int page = firstPage; page < firstPage + numPages; page++)
+        planes |= PlanesUsed[page];
+    return planes;
+}
+
+// interface
+
+int CVramAllocator::Alloc(int numBlocks)
+{
+    mAssert(numBlocks > 0);
+    if (GetAllocBlocks(numBlocks) < kBlocksPerPage)
+        return AllocSubPage(numBlocks);
+
+    int firstPage = AllocPages(Math::DivUp(numBlocks, kBlocksPerPage));
+    return (firstPage < 0) ? -1 : firstPage * kBlocksPerPage;
+}
+
+int CVramAllocator::AllocLow(int numBlocks, int limitBlock)
+{
+    mErrorIf(GetAllocBlocks(numBlocks) < kBlocksPerPage, "AllocLow() is for a page or more.");
+    int numPages  = Math::DivUp(numBlocks, kBlocksPerPage);
+    int limitPage = limitBlock / kBlocksPerPage;
+
+    for (int page = FirstPage; page + numPages <= limitPage;) {
+        if (PageStates[page] == kFree) {
+            int rangeLength = FreeLengths[page];
+            if (rangeLength >= numPages) {
+                RemoveFreeRange(page);
+                if (rangeLength > numPages)
+                    AddFreeRange(page + numPages, rangeLength - numPages);
+                return page * kBlocksPerPage;
+            }
+            page += rangeLength;
+        } else
+            page++;
+    }
+    return -1;
+}
+
+void CVramAllocator::Free(int firstBlock, int numBlocks)
+{
+    mAssert(numBlocks > 0);
+    if (GetAllocBlocks(numBlocks) < kBlocksPerPage)
+        FreeSubPage(firstBlock, numBlocks);
+    else {
+        mErrorIf(firstBlock % kBlocksPerPage, "Allocations of a page or more start on a page.");
+        FreePages(firstBlock / kBlocksPerPage, Math::DivUp(numBlocks, kBlocksPerPage));
+    }
+}
+
+// stats
+
+int CVramAllocator::GetNumFreeSubPageBlocks() const
+{
+    int numFree = 0;
+    for (unsigned int i = 0; i < SubPages.size(); i++)
+        for (uint32_t used = BlockMasks[SubPages[i]]; used != 0xffffffff; used |= used + 1)
+            numFree++;
+    return numFree;
+}
+
+int CVramAllocator::GetLargestFreePages() const
+{
+    // only the biggest non-empty class can have it
+    for (int freeClass = kNumClasses - 1; freeClass >= 0; freeClass--) {
+        int largest = 0;
+        for (int page = FreeLists[freeClass]; page >= 0; page = NextFree[page])
+            largest = Math::Max(largest, (int)FreeLengths[page]);
+        if (largest > 0)
+            return largest;
+    }
+    return 0;
+}
+
+float CVramAllocator::GetFragmentation() const
+{
+    if (NumFreePages == 0)
+        return 0.0f;
+    return 1.0f - (float)GetLargestFreePages() / (float)NumFreePages;
+}
+
+int CVramAllocator::GetNumPlaneHosts() const
+{
+    int numHosts = 0;
+    for (int page = FirstPage; page < FirstPage + NumPages; page++)
+        numHosts += PlaneHosts[page];
+    return numHosts;
+}
+
+int CVramAllocator::GetNumFreePlanes(int planes) const
+{
+    int numFree = 0;
+    for (int page = FirstPage; page < FirstPage + NumPages; page++)
+        if (PlaneHosts[page] && (PlanesUsed[page] & planes) == 0)
+            numFree++;
+    return numFree;
+}
+
+void CVramAllocator::Print() const
+{
+    printf("vram allocator: pages %d-%d, %d free (largest %d, %d%% fragmented), %d sub-page pages (%d blocks free)\n",
+        FirstPage, FirstPage + NumPages - 1, NumFreePages, GetLargestFreePages(),
+        (int)(GetFragmentation() * 100.0f), (int)SubPages.size(), GetNumFreeSubPageBlocks());
+    if (GetNumPlaneHosts() > 0)
+        printf("  %d plane host pages, 8h free in %d, 4hl in %d, 4hh in %d\n",
+            GetNumPlaneHosts(), GetNumFreePlanes(kPlanes8h), GetNumFreePlanes(kPlanes4hl),
+            GetNumFreePlanes(kPlanes4hh));
+
+    // the free ranges in order
+    for (int page = FirstPage; page < FirstPage + NumPages;) {
+        if (PageStates[page] == kFree) {
+            printf("  free [%3d, %3d]\n", page, page + FreeLengths[page] - 1);
+            page += FreeLengths[page];
+        } else
+            page++;
+    }
+}
+
+} // namespace GS
@@ -0,0 +1,183 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+
+#include "ps2s/debug.h"
+#include "ps2s/packet.h"
+#include "ps2s/vucodecache.h"
+
+/********************************************
+ * VuCodeCache
+ */
+
+// an mpg uploads at most 256 instructions
+static const uint32_t kMaxMpgDwords = 256;
+
+CVuCodeCache::CVuCodeCache(uint32_t firstDword, uint32_t numDwords)
+    : uiFirstDword(firstDword)
+    , uiNumDwords(numDwords)
+    , uiUseCount(0)
+{
+    mErrorIf(numDwords == 0 || firstDword + numDwords > kMicroMemDwords,
+        "The cache has to be inside micro memory.");
+    ResetStats();
+}
+
+void CVuCodeCache::ResetStats(void)
+{
+    uiNumHits           = 0;
+    uiNumMisses         = 0;
+    uiNumEvictions      = 0;
+    uiNumDwordsUploaded = 0;
+}
+
+int CVuCodeCache::FindProgram(const void* code) const
+{
+    for (uint32_t i = 0; i < Programs.size(); i++)
+        if (Programs[i].Code == code)
+            return (int)i;
+    return -1;
+}
+
+uint32_t
+CVuCodeCache::GetAddress(const void* code) const
+{
+    int program = FindProgram(code);
+    mErrorIf(program < 0, "That program isn't resident.");
+    return Programs[program].Addr;
+}
+
+void CVuCodeCache::Invalidate(const void* code)
+{
+    int program = FindProgram(code);
+    if (program >= 0)
+        Programs.erase(Programs.begin() + program);
+}
+
+// the smallest gap the program fits in
+bool CVuCodeCache::FindSpace(uint32_t numDwords, uint32_t& addr) const
+{
+    uint32_t bestSize = 0xffffffff;
+    uint32_t gapStart = uiFirstDword;
+    for (uint32_t i = 0; i <= Programs.size(); i++) {
+        uint32_t gapEnd  = (i < Programs.size()) ? Programs[i].Addr : uiFirstDword + uiNumDwords;
+        uint32_t gapSize = gapEnd - gapStart;
+        if (gapSize >= numDwords && gapSize < bestSize) {
+            bestSize = gapSize;
+            addr     = gapStart;
+        }
+        if (i < Programs.size())
+            gapStart = Programs[i].Addr + Programs[i].NumDwords;
+    }
+    return bestSize != 0xffffffff;
+}
+
+void CVuCodeCache::Evict(uint32_t program)
+{
+    Programs.erase(Programs.begin() + program);
+    uiNumEvictions++;
+}
+
+// evicts whatever overlaps the range
+void CVuCodeCache::EvictRange(uint32_t addr, uint32_t numDwords)
+{
+    for (uint32_t i = 0; i < Programs.size();) {
+        const tProgram& program = Programs[i];
+        if (program.Addr < addr + numDwords && addr < program.Addr + program.NumDwords)
+            Evict(i);
+        else
+            i++;
+    }
+}
+
+void CVuCodeCache::Upload(CVifSCDmaPacket& packet, const void* code, uint32_t addr, uint32_t numDwords)
+{
+    const uint64_t* instructions = (const uint64_t*)code;
+
+    for (uint32_t done = 0; done < numDwords;) {
+        uint32_t num = numDwords - done;
+        if (num > kMaxMpgDwords)
+            num = kMaxMpgDwords;
+
+        // (Mpg() keeps the microcode dword-aligned)
+        packet.Mpg(num & 0xff, addr + done);
+        packet.Add(instructions + done, num);
+        done += num;
+    }
+    uiNumDwordsUploaded += numDwords;
+}
+
+uint32_t
+CVuCodeCache::Load(CVifSCDmaPacket& packet, const void* code, uint32_t numDwords, uint32_t fixedAddr)
+{
+    mErrorIf(numDwords == 0 || numDwords > uiNumDwords, "A %d instruction program won't fit in the cache.",
+        numDwords);
+    mErrorIf(fixedAddr != kAnywhere
+            && (fixedAddr < uiFirstDword || fixedAddr + numDwords > uiFirstDword + uiNumDwords),
+        "Address 0x%x is outside the cache.", fixedAddr);
+
+    uiUseCount++;
+
+    int found = FindProgram(code);
+    if (found >= 0) {
+        tProgram& program = Programs[found];
+        if (program.NumDwords == numDwords && (fixedAddr == kAnywhere || fixedAddr == program.Addr)) {
+            program.LastUse = uiUseCount;
+            uiNumHits++;
+            return program.Addr;
+        }
+        // it has to move
+        Evict(found);
+    }
+    uiNumMisses++;
+
+    uint32_t addr = fixedAddr;
+    if (fixedAddr != kAnywhere)
+        EvictRange(fixedAddr, numDwords);
+    else {
+        while (!FindSpace(numDwords, addr)) {
+            uint32_t lru = 0;
+            for (uint32_t i = 1; i < Programs.size(); i++)
+                if (Programs[i].LastUse < Programs[lru].LastUse)
+                    lru = i;
+            Evict(lru);
+        }
+    }
+
+    tProgram program = { code, addr, numDwords, uiUseCount };
+    uint32_t pos     = 0;
+    while (pos < Programs.size() && Programs[pos].Addr < addr)
+        pos++;
+    Programs.insert(Programs.begin() + pos, program);
+
+    Upload(packet, code, addr, numDwords);
+    return addr;
+}
+
+uint32_t
+CVuCodeCache::Call(CVifSCDmaPacket& packet, const void* code, uint32_t numDwords, uint32_t entryOffset)
+{
+    mErrorIf(entryOffset >= numDwords, "The entry point is outside the program.");
+    uint32_t addr = Load(packet, code, numDwords);
+    packet.Mscal(addr + entryOffset);
+    return addr;
+}
+
+void CVuCodeCache::Print(void) const
+{
+    uint32_t numLookups = uiNumHits + uiNumMisses;
+    printf("vu code cache: %d hits, %d misses (%d%% hits), %d evictions, %d dwords uploaded\n",
+        uiNumHits, uiNumMisses, (numLookups) ? uiNumHits * 100 / numLookups : 0, uiNumEvictions,
+        uiNumDwordsUploaded);
+    for (uint32_t i = 0; i < Programs.size(); i++)
+        printf("  0x%03x-0x%03x  %p\n", Programs[i].Addr, Programs[i].Addr + Programs[i].NumDwords - 1,
+            Programs[i].Code);
+}
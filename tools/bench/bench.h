@@ -0,0 +1,73 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_bench_h
+#define ps2s_bench_h
+
+/********************************************
+ * includes
+ */
+
+#ifndef _EE
+#include <time.h>
+#endif
+
+#include "ps2s/core.h"
+#include "ps2s/types.h"
+
+/********************************************
+ * Bench
+ */
+
+// What the benchmarks share: a clock (the cop0 count on the ee, which wraps
+// after about 14 seconds, so keep each measurement short) and a loop that runs
+// a test until it has taken long enough to time.
+
+namespace Bench {
+
+typedef void (*tTest)(void* arg);
+
+#ifdef _EE
+typedef uint32_t tTicks;
+static const double kTicksPerSec = 294912000.0;
+
+inline tTicks
+Now(void)
+{
+    return Core::GetCount();
+}
+#else
+typedef uint64_t tTicks;
+static const double kTicksPerSec = 1000000000.0;
+
+inline tTicks
+Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (tTicks)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+#endif
+
+// seconds per call of test(arg), doubling the number of calls until they take
+// at least minSeconds
+inline double
+Time(tTest test, void* arg, double minSeconds = 0.05)
+{
+    test(arg);
+    for (uint32_t numCalls = 1;; numCalls *= 2) {
+        tTicks start = Now();
+        for (uint32_t i = 0; i < numCalls; i++)
+            test(arg);
+        double seconds = (tTicks)(Now() - start) / kTicksPerSec;
+        if (seconds >= minSeconds)
+            return seconds / numCalls;
+    }
+}
+
+}
+
+#endif // ps2s_bench_h
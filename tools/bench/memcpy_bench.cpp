@@ -0,0 +1,108 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+// Qword copy speed in MB/s: the one-qword-at-a-time loop that MemCpy128 and
+// CDmaPacket::Add() used to be, against Utils::MemCpy128 and CDmaPacket::Add()
+// now.  On the ee the copies are also done into uncached accelerated memory.
+
+/********************************************
+ * includes
+ */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _EE
+#include "kernel.h"
+#endif
+
+#include "ps2s/packet.h"
+#include "ps2s/utils.h"
+
+#include "bench.h"
+
+/********************************************
+ * copies
+ */
+
+typedef struct {
+    uint128_t* Dest;
+    const uint128_t* Src;
+    uint32_t NumQwords;
+    CDmaPacket* Packet;
+} tCopy;
+
+static void
+LoopCopy(void* arg)
+{
+    tCopy& copy          = *(tCopy*)arg;
+    uint128_t* dest      = copy.Dest;
+    const uint128_t* src = copy.Src;
+    uint32_t numQwords   = copy.NumQwords;
+    while (numQwords-- > 0)
+        *(dest++) = *(src++);
+}
+
+static void
+MemCpy128(void* arg)
+{
+    tCopy& copy = *(tCopy*)arg;
+    Utils::MemCpy128(copy.Dest, copy.Src, copy.NumQwords);
+}
+
+static void
+PacketAdd(void* arg)
+{
+    tCopy& copy = *(tCopy*)arg;
+    copy.Packet->Reset();
+    copy.Packet->Add(copy.Src, copy.NumQwords);
+}
+
+static void
+Report(const char* name, tCopy& copy, Bench::tTest test)
+{
+    double seconds = Bench::Time(test, &copy);
+    printf("  %-34s %10.1f MB/s\n", name, copy.NumQwords * 16 / seconds / 1000000.0);
+}
+
+/********************************************
+ * main
+ */
+
+int main(void)
+{
+    static const uint32_t kMaxQwords   = 65536;
+    static const uint32_t kNumSizes    = 4;
+    const uint32_t numQwords[kNumSizes] = { 16, 256, 4096, kMaxQwords };
+
+    uint128_t* src  = (uint128_t*)memalign(64, kMaxQwords * 16);
+    uint128_t* dest = (uint128_t*)memalign(64, kMaxQwords * 16);
+    memset(src, 0x5a, kMaxQwords * 16);
+    memset(dest, 0, kMaxQwords * 16);
+    CDmaPacket packet((uint128_t*)dest, kMaxQwords, DMAC::Channels::gif);
+
+    for (uint32_t i = 0; i < kNumSizes; i++) {
+        printf("%d bytes:\n", numQwords[i] * 16);
+
+        tCopy copy = { dest, src, numQwords[i], &packet };
+        Report("qword loop", copy, LoopCopy);
+        Report("Utils::MemCpy128", copy, MemCpy128);
+        Report("CDmaPacket::Add", copy, PacketAdd);
+
+#ifdef _EE
+        // (nothing of dest can be left in the cache when it's written uncached)
+        FlushCache(0);
+        copy.Dest = Core::MakePtrUncachedAccl(dest);
+        Report("qword loop, uncached accl", copy, LoopCopy);
+        Report("Utils::MemCpy128, uncached accl", copy, MemCpy128);
+#endif
+    }
+
+    free(src);
+    free(dest);
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+// Bind-heavy frames against GS::CMemSlotList: every draw binds one of the
+// slots, which makes it the most recently used (CMemArea::IsAllocated() ->
+// CMemSlot::RecordAccess()).  "before" is the std::list the slots used to be
+// kept in, which had to search for the slot on every touch.
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+
+#include <list>
+
+#include "ps2s/gsmem.h"
+
+#include "bench.h"
+
+/********************************************
+ * lists
+ */
+
+// the old CMemSlotList::MakeSlotMRU()
+class COldSlotList {
+    std::list<GS::CMemSlot*> Slots;
+    typedef std::list<GS::CMemSlot*>::iterator tSlotIter;
+
+public:
+    void AddSlot(GS::CMemSlot* slot) { Slots.push_back(slot); }
+
+    void MakeSlotMRU(GS::CMemSlot* slot)
+    {
+        tSlotIter curSlot = Slots.begin();
+        for (; curSlot != Slots.end(); curSlot++)
+            if (*curSlot == slot)
+                break;
+        Slots.erase(curSlot);
+        Slots.push_front(slot);
+    }
+};
+
+static const uint32_t kDrawsPerFrame = 1000;
+
+typedef struct {
+    GS::CMemSlot** Slots;
+    uint32_t NumSlots;
+    COldSlotList* OldList;
+    int Frame;
+} tBindFrame;
+
+// which slot each draw binds: mostly a small working set, like a frame that
+// reuses a few textures, with the rest spread over all of them
+static inline uint32_t
+NextSlot(uint32_t& seed, uint32_t numSlots)
+{
+    seed            = seed * 1664525 + 1013904223;
+    uint32_t pick   = seed >> 8;
+    uint32_t numHot = (numSlots < 16) ? numSlots : 16;
+    return (pick & 3) ? pick % numHot : pick % numSlots;
+}
+
+static void
+OldFrame(void* arg)
+{
+    tBindFrame& frame = *(tBindFrame*)arg;
+    uint32_t seed     = 1;
+    for (uint32_t i = 0; i < kDrawsPerFrame; i++)
+        frame.OldList->MakeSlotMRU(frame.Slots[NextSlot(seed, frame.NumSlots)]);
+}
+
+static void
+NewFrame(void* arg)
+{
+    tBindFrame& frame = *(tBindFrame*)arg;
+    uint32_t seed     = 1;
+    frame.Frame++;
+    for (uint32_t i = 0; i < kDrawsPerFrame; i++)
+        frame.Slots[NextSlot(seed, frame.NumSlots)]->RecordAccess(frame.Frame);
+}
+
+/********************************************
+ * main
+ */
+
+int main(void)
+{
+    static const uint32_t kNumCounts      = 4;
+    const uint32_t slotCounts[kNumCounts] = { 10, 50, 150, 400 };
+
+    printf("%d binds per frame:\n", kDrawsPerFrame);
+    printf("  %8s %16s %16s\n", "slots", "before (ns/bind)", "after (ns/bind)");
+
+    for (uint32_t c = 0; c < kNumCounts; c++) {
+        uint32_t numSlots = slotCounts[c];
+
+        // the list owns (and deletes) the slots
+        GS::CMemSlotList newList(1, GS::kPsm32);
+        COldSlotList oldList;
+        GS::CMemSlot** slots = new GS::CMemSlot*[numSlots];
+        for (uint32_t i = 0; i < numSlots; i++) {
+            slots[i] = new GS::CMemSlot(i, 1, GS::kPsm32);
+            newList.AddSlot(slots[i]);
+            oldList.AddSlot(slots[i]);
+        }
+
+        tBindFrame frame = { slots, numSlots, &oldList, 0 };
+        double before = Bench::Time(OldFrame, &frame) / kDrawsPerFrame;
+        double after  = Bench::Time(NewFrame, &frame) / kDrawsPerFrame;
+        printf("  %8d %16.1f %16.1f\n", numSlots, before * 1e9, after * 1e9);
+
+        delete[] slots;
+    }
+
+    return 0;
+}
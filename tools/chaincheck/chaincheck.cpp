@@ -0,0 +1,142 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+// Runs every chain in one or more dma captures (see dmacapture.h) through
+// CDmaChainVerifier on the host:
+//
+//     chaincheck [-v] frame.dmc ...
+//
+// prints the problems it finds (and with -v what each chain sends where), and
+// exits with 1 if there were any, or 2 if a capture couldn't be read, so that
+// it can gate a build.
+
+/********************************************
+ * includes
+ */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps2s/chainverify.h"
+#include "ps2s/dmac.h"
+#include "ps2s/dmacapture.h"
+
+/********************************************
+ * check
+ */
+
+static const char* const DestNames[CDmaChainVerifier::kNumDests] = {
+    "gs", "vu data", "vu code", "vif", "other"
+};
+
+// reads the capture into memory that tag addresses can reach
+static uint8_t*
+ReadCapture(const char* fileName, uint32_t* numBytes)
+{
+    FILE* file = fopen(fileName, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t* image = (size > 0) ? (uint8_t*)memalign(16, size) : NULL;
+    bool ok        = image && fread(image, 1, size, file) == (size_t)size;
+    fclose(file);
+
+    if (!ok) {
+        free(image);
+        return NULL;
+    }
+    *numBytes = size;
+    return image;
+}
+
+// returns the number of chains with problems, or -1 if the capture couldn't be read
+static int
+CheckCapture(const char* fileName, bool verbose)
+{
+    uint32_t numBytes;
+    uint8_t* image = ReadCapture(fileName, &numBytes);
+    if (image == NULL) {
+        printf("%s: couldn't read the file\n", fileName);
+        return -1;
+    }
+
+    // (tag addresses are offsets from AddrBase off-console, and can't be 0)
+    DMAC::AddrBase = (uintptr_t)image - 16;
+
+    CDmaReplay replay;
+    if (!replay.Attach(image, numBytes)) {
+        printf("%s: %s\n", fileName, replay.GetError());
+        free(image);
+        return -1;
+    }
+
+    CDmaChainVerifier verifier;
+    uint32_t totals[CDmaChainVerifier::kNumDests] = { 0 };
+    uint32_t numChains = 0, numBad = 0;
+
+    for (uint32_t r = 0; r < replay.GetNumRecords(); r++) {
+        if (!replay.IsChain(r))
+            continue;
+        numChains++;
+
+        verifier.ClearRegions();
+        for (uint32_t s = 0; s < replay.GetNumSegments(r); s++)
+            verifier.AddRegion(replay.GetSegment(r, s), replay.GetSegmentByteLength(r, s));
+
+        bool ok = verifier.Verify(replay.GetChannel(r), replay.GetStart(r), replay.GetTTE(r));
+        for (uint32_t d = 0; d < CDmaChainVerifier::kNumDests; d++)
+            totals[d] += verifier.GetNumQwords((CDmaChainVerifier::tDest)d);
+
+        if (!ok)
+            numBad++;
+        if (!ok || verbose) {
+            printf("%s: record %d, channel %d: ", fileName, r, replay.GetChannel(r));
+            verifier.Print();
+        }
+    }
+
+    printf("%s: %d records, %d chains, %d with problems\n", fileName, replay.GetNumRecords(), numChains, numBad);
+    printf("  qwords:");
+    for (uint32_t d = 0; d < CDmaChainVerifier::kNumDests; d++)
+        printf(" %s %d%s", DestNames[d], totals[d], (d + 1 < CDmaChainVerifier::kNumDests) ? "," : "\n");
+
+    replay.Release();
+    free(image);
+    return numBad;
+}
+
+/********************************************
+ * main
+ */
+
+int main(int argc, char** argv)
+{
+    bool verbose  = false;
+    int firstFile = 1;
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+        verbose   = true;
+        firstFile = 2;
+    }
+    if (firstFile >= argc) {
+        printf("usage: chaincheck [-v] capture.dmc ...\n");
+        return 2;
+    }
+
+    bool unreadable = false, bad = false;
+    for (int i = firstFile; i < argc; i++) {
+        int numBad = CheckCapture(argv[i], verbose);
+        unreadable |= (numBad < 0);
+        bad |= (numBad > 0);
+    }
+
+    return (unreadable) ? 2 : (bad) ? 1 : 0;
+}
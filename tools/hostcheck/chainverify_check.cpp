@@ -0,0 +1,101 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+// Runs CDmaChainVerifier over a packet that refs data kept in its own buffer,
+// directly and (like tools/chaincheck) from a capture of it.
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ps2s/chainverify.h"
+#include "ps2s/dmacapture.h"
+#include "ps2s/packet.h"
+
+#include "hostcheck.h"
+
+/********************************************
+ * check
+ */
+
+static const char* const kCaptureFile = "chainverify_check.dmc";
+
+// a ref to the two qwords after the end tag.  They're zeros, which would read
+// as refe tags if they were scanned as part of the chain.
+static void
+BuildChain(CSCDmaPacket& packet, bool withStrayTag)
+{
+    const uint128_t* data = (const uint128_t*)packet.GetBase() + 2;
+    packet.Ref(data, 2);
+    packet.End();
+    packet.CloseTag();
+
+    uint128_t zero[2];
+    memset(zero, 0, sizeof(zero));
+    ((CDmaPacket&)packet).Add(zero, 2);
+
+    // a tag nothing gets to
+    if (withStrayTag) {
+        packet.Cnt();
+        packet.CloseTag();
+    }
+}
+
+static void
+CheckRefData(void)
+{
+    CSCDmaPacket packet(16, DMAC::Channels::vif1, false);
+    BuildChain(packet, false);
+
+    CDmaChainVerifier verifier;
+    mCheck(verifier.Verify(packet));
+    mCheck(verifier.GetNumTags() == 2);
+    mCheck(verifier.GetNumQwords(CDmaChainVerifier::kDestVif) == 2);
+
+    // the data is skipped, but not what comes after it
+    packet.Reset();
+    BuildChain(packet, true);
+    mCheck(!verifier.Verify(packet));
+    mCheck(verifier.GetNumIssues() == 1
+        && verifier.GetIssue(0).Type == CDmaChainVerifier::kUnreachable
+        && verifier.GetIssue(0).TagAddr == DMAC::MakeTagAddr((const uint128_t*)packet.GetBase() + 4));
+}
+
+static void
+CheckCapture(void)
+{
+    CSCDmaPacket packet(16, DMAC::Channels::vif1, false);
+    BuildChain(packet, false);
+
+    CDmaCapture capture;
+    mCheck(capture.AddChain(DMAC::Channels::vif1, packet.GetBase(), false));
+    mCheck(capture.Write(kCaptureFile));
+
+    CDmaReplay replay;
+    mCheck(replay.Load(kCaptureFile));
+    remove(kCaptureFile);
+    if (replay.GetNumRecords() != 1)
+        return;
+
+    CDmaChainVerifier verifier;
+    for (uint32_t s = 0; s < replay.GetNumSegments(0); s++)
+        verifier.AddRegion(replay.GetSegment(0, s), replay.GetSegmentByteLength(0, s));
+    mCheck(verifier.Verify(replay.GetChannel(0), replay.GetStart(0), replay.GetTTE(0)));
+    mCheck(verifier.GetNumQwords(CDmaChainVerifier::kDestVif) == 2);
+}
+
+int main(void)
+{
+    HostCheck::Init();
+
+    CheckRefData();
+    CheckCapture();
+
+    return HostCheck::Finish();
+}
@@ -0,0 +1,102 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+// Sends through a backend whose channel stays busy until it's waited on, and
+// checks when fences pass and their callbacks run.
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+
+#include "ps2s/packet.h"
+#include "ps2s/softdmac.h"
+
+#include "hostcheck.h"
+
+/********************************************
+ * check
+ */
+
+// like the real dmac, a transfer is in flight until someone waits for it
+class CSlowDmac : public CDmaBackend {
+public:
+    CSlowDmac(void)
+        : bBusy(false)
+    {
+        Soft.SetSink(DMAC::Channels::vif1, &Sink);
+    }
+
+    virtual void SendNormal(tDmaChannelId channel, const void* data, uint32_t numQwords)
+    {
+        Soft.SendNormal(channel, data, numQwords);
+        bBusy = true;
+    }
+    virtual void SendChain(tDmaChannelId channel, const void* firstTag, bool tte)
+    {
+        Soft.SendChain(channel, firstTag, tte);
+        bBusy = true;
+    }
+    virtual void Wait(tDmaChannelId channel) { bBusy = false; }
+    virtual bool IsBusy(tDmaChannelId channel) { return bBusy; }
+    virtual void FlushCache(void) {}
+
+    CSoftDmac Soft;
+    CDmaCountingSink Sink;
+    bool bBusy;
+};
+
+static uint32_t NumCalled = 0;
+
+static void
+Called(void* arg)
+{
+    NumCalled++;
+}
+
+static void
+CheckCallbacks(void)
+{
+    CSlowDmac dmac;
+    CDmaBackend::Set(&dmac);
+
+    CSCDmaPacket packet(16, DMAC::Channels::vif1, false);
+    packet.Cnt();
+    packet += (uint64_t)0;
+    packet += (uint64_t)0;
+    packet.CloseTag();
+    packet.End();
+    packet.CloseTag();
+
+    CDmaFence fence = packet.Send();
+    mCheck(!fence.IsDone());
+
+    // the ones that fit are left pending; the one after that waits for the
+    // channel, which runs them all
+    for (uint32_t i = 0; i < CDmaFence::kMaxCallbacks; i++)
+        fence.OnDone(Called, NULL);
+    mCheck(NumCalled == 0);
+    fence.OnDone(Called, NULL);
+    mCheck(fence.IsDone());
+    mCheck(NumCalled == CDmaFence::kMaxCallbacks + 1);
+
+    // and a callback for a fence that has passed runs at once
+    fence.OnDone(Called, NULL);
+    mCheck(NumCalled == CDmaFence::kMaxCallbacks + 2);
+
+    CDmaBackend::Set(NULL);
+}
+
+int main(void)
+{
+    HostCheck::Init();
+    CSCDmaPacket::SetVerifyOnSend(false);
+
+    CheckCallbacks();
+
+    return HostCheck::Finish();
+}
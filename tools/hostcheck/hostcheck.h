@@ -0,0 +1,66 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+#ifndef ps2s_hostcheck_h
+#define ps2s_hostcheck_h
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ps2s/dmac.h"
+#include "ps2s/types.h"
+
+/********************************************
+ * HostCheck
+ */
+
+// What the host checks share.  mCheck() reports a failed condition and carries
+// on, so that one run shows everything that's wrong; Finish() gives the exit
+// status.
+
+#define mCheck(__cond)                                                                 \
+    do {                                                                               \
+        if (!(__cond))                                                                 \
+            HostCheck::Fail(__FILE__, __LINE__, #__cond);                              \
+    } while (0)
+
+namespace HostCheck {
+
+// (each check is one source file)
+static uint32_t NumFailed = 0;
+
+inline void
+Fail(const char* file, int line, const char* cond)
+{
+    printf("%s, %d: check failed: %s\n", file, line, cond);
+    NumFailed++;
+}
+
+// Tag addresses are offsets from DMAC::AddrBase off-console, so point it just
+// below the heap the packets and data will be allocated from.
+inline void
+Init(void)
+{
+    DMAC::AddrBase = (uintptr_t)malloc(16) - (1 << 20);
+}
+
+inline int
+Finish(void)
+{
+    if (NumFailed)
+        printf("%d check(s) failed\n", NumFailed);
+    else
+        printf("all checks passed\n");
+    return (NumFailed) ? 1 : 0;
+}
+
+}
+
+#endif // ps2s_hostcheck_h
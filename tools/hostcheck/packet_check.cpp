@@ -0,0 +1,150 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+// Adds packets to chunked packets and checks that the dmac gets the same
+// qwords it would from one big buffer.
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ps2s/packet.h"
+#include "ps2s/packetpool.h"
+#include "ps2s/softdmac.h"
+
+#include "hostcheck.h"
+
+/********************************************
+ * check
+ */
+
+// what one send delivers to the channel, leaving out the tags (which differ
+// when tte is on and the chain has been split into chunks)
+class CDataSink : public CDmaSink {
+public:
+    CDataSink(void)
+        : uiNumQwords(0)
+        , uiChecksum(0)
+    {
+    }
+
+    virtual void Receive(tDmaChannelId channel, const uint128_t* data, uint32_t numQwords, bool isTag)
+    {
+        if (isTag)
+            return;
+        uiNumQwords += numQwords;
+        const uint32_t* words = (const uint32_t*)data;
+        for (uint32_t i = 0; i < numQwords * 4; i++)
+            uiChecksum = uiChecksum * 31 + words[i];
+    }
+
+    uint32_t uiNumQwords, uiChecksum;
+};
+
+static CDataSink
+Deliver(CSCDmaPacket& packet)
+{
+    CSoftDmac dmac;
+    CDataSink sink;
+    dmac.SetSink(packet.GetDmaChannel(), &sink);
+    CDmaBackend::Set(&dmac);
+
+    packet.Send();
+    mCheck(dmac.GetError() == NULL);
+
+    CDmaBackend::Set(NULL);
+    return sink;
+}
+
+static bool
+operator==(const CDataSink& a, const CDataSink& b)
+{
+    return a.uiNumQwords == b.uiNumQwords && a.uiChecksum == b.uiChecksum;
+}
+
+static void
+FillData(CDmaPacket& data, uint32_t numQwords)
+{
+    for (uint32_t i = 0; i < numQwords; i++) {
+        uint32_t qword[4] = { i, i * 3, i * 5, i * 7 };
+        data.Add(qword, 4);
+    }
+}
+
+// data for an open tag that's several chunks long
+static void
+CheckDataAcrossChunks(void)
+{
+    CDmaPacket data(40, DMAC::Channels::vif1);
+    FillData(data, 40);
+
+    CPacketChunkPool pool(16);
+    CSCDmaPacket chunked(pool, DMAC::Channels::vif1, false);
+    CSCDmaPacket whole(64, DMAC::Channels::vif1, false);
+    CSCDmaPacket* packets[2] = { &chunked, &whole };
+    for (uint32_t i = 0; i < 2; i++) {
+        CSCDmaPacket& packet = *packets[i];
+        packet.Cnt();
+        packet.Add(data);
+        packet.CloseTag();
+        packet.End();
+        packet.CloseTag();
+    }
+    // (each chunk keeps its last qword for a link, and starts with a copy of the open tag)
+    mCheck(chunked.GetNumChunks() == 3);
+    mCheck(chunked.GetByteLength() == (3 + 40 + 1) * 16);
+
+    CDataSink fromChunked = Deliver(chunked), fromWhole = Deliver(whole);
+    mCheck(fromChunked.uiNumQwords == 40);
+    mCheck(fromChunked == fromWhole);
+}
+
+// a chain of its own, added where the last tag left its upper half for the vif
+static void
+CheckChainAfterTTE(void)
+{
+    CSCDmaPacket chain(8, DMAC::Channels::vif1, true);
+    chain.Cnt();
+    FillData(chain, 3);
+    chain.CloseTag();
+
+    CPacketChunkPool pool(16);
+    CSCDmaPacket chunked(pool, DMAC::Channels::vif1, true);
+    CSCDmaPacket whole(64, DMAC::Channels::vif1, true);
+    CSCDmaPacket* packets[2] = { &chunked, &whole };
+    for (uint32_t i = 0; i < 2; i++) {
+        CSCDmaPacket& packet = *packets[i];
+        // (three times: the last one has to go in a new chunk)
+        for (uint32_t n = 0; n < 3; n++) {
+            packet.Cnt();
+            packet.CloseTag();
+            uint128_t* added = packet.Add((CDmaPacket&)chain);
+            mCheck(added != NULL && ((uintptr_t)added & 0xf) == 0);
+        }
+        packet.End();
+        packet.CloseTag();
+    }
+    mCheck(chunked.GetNumChunks() == 2);
+
+    CDataSink fromChunked = Deliver(chunked), fromWhole = Deliver(whole);
+    mCheck(fromChunked.uiNumQwords == 3 * 3);
+    mCheck(fromChunked == fromWhole);
+}
+
+int main(void)
+{
+    HostCheck::Init();
+    // (the data isn't vifcodes)
+    CSCDmaPacket::SetVerifyOnSend(false);
+
+    CheckDataAcrossChunks();
+    CheckChainAfterTTE();
+
+    return HostCheck::Finish();
+}
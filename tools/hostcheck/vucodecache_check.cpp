@@ -0,0 +1,123 @@
+/*	  Copyright (C) 2000,2001,2002  Sony Computer Entertainment America
+
+       	  This file is subject to the terms and conditions of the GNU Lesser
+	  General Public License Version 2.1. See the file "COPYING" in the
+	  main directory of this archive for more details.                             */
+
+// Runs CVuCodeCache against a CVifSim's micro memory: every program the cache
+// says is resident has to be there, and every MSCAL has to start it at the
+// right address.
+
+/********************************************
+ * includes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ps2s/packet.h"
+#include "ps2s/softdmac.h"
+#include "ps2s/vifsim.h"
+#include "ps2s/vucodecache.h"
+
+#include "hostcheck.h"
+
+/********************************************
+ * check
+ */
+
+static uint32_t LastCallAddr;
+
+static void
+MicroCalled(CVifSim& sim, uint32_t startAddr, void* arg)
+{
+    LastCallAddr = startAddr;
+}
+
+// a program whose instructions say which program and dword they are
+static uint64_t*
+MakeProgram(uint32_t numDwords, uint32_t id)
+{
+    uint64_t* code = (uint64_t*)malloc(numDwords * 8);
+    for (uint32_t i = 0; i < numDwords; i++)
+        code[i] = ((uint64_t)id << 32) | i;
+    return code;
+}
+
+static bool
+IsResident(const CVifSim& sim, const uint64_t* code, uint32_t numDwords, uint32_t addr)
+{
+    for (uint32_t i = 0; i < numDwords; i++)
+        if (sim.GetMicroMem()[addr + i] != code[i])
+            return false;
+    return true;
+}
+
+static void
+Finish(CVifSCDmaPacket& packet)
+{
+    packet.Pad128();
+    packet.CloseTag();
+    packet.End();
+    packet.Pad128();
+    packet.CloseTag();
+    packet.Send();
+}
+
+static void
+CheckCache(bool tte)
+{
+    CSoftDmac dmac;
+    CVifSim* sim = new CVifSim;
+    sim->SetMicroCallback(MicroCalled, NULL);
+    dmac.SetSink(DMAC::Channels::vif1, sim);
+    CDmaBackend::Set(&dmac);
+
+    // 2300 dwords of programs in 2048 dwords of micro memory
+    const uint32_t numDwords[4] = { 700, 600, 900, 100 };
+    uint64_t* programs[4];
+    for (uint32_t i = 0; i < 4; i++)
+        programs[i] = MakeProgram(numDwords[i], i + 1);
+
+    CVuCodeCache cache;
+    const uint32_t order[8] = { 0, 1, 0, 2, 1, 3, 0, 0 };
+    for (uint32_t i = 0; i < 8; i++) {
+        uint32_t program = order[i];
+        CVifSCDmaPacket packet(4096, DMAC::Channels::vif1, tte);
+        packet.Cnt();
+        packet.Nop();
+        uint32_t addr = cache.Call(packet, programs[program], numDwords[program], 1);
+        Finish(packet);
+
+        mCheck(sim->GetError() == NULL);
+        mCheck(IsResident(*sim, programs[program], numDwords[program], addr));
+        mCheck(LastCallAddr == addr + 1);
+    }
+    mCheck(cache.GetNumHits() + cache.GetNumMisses() == 8);
+    mCheck(cache.GetNumHits() >= 2);
+
+    // loading at a fixed address evicts whatever is there
+    CVifSCDmaPacket packet(4096, DMAC::Channels::vif1, tte);
+    packet.Cnt();
+    cache.Load(packet, programs[3], numDwords[3], 0);
+    Finish(packet);
+    mCheck(cache.GetAddress(programs[3]) == 0);
+    mCheck(IsResident(*sim, programs[3], numDwords[3], 0));
+
+    cache.Print();
+
+    CDmaBackend::Set(NULL);
+    for (uint32_t i = 0; i < 4; i++)
+        free(programs[i]);
+    delete sim;
+}
+
+int main(void)
+{
+    HostCheck::Init();
+
+    CheckCache(false);
+    CheckCache(true);
+
+    return HostCheck::Finish();
+}